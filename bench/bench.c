@@ -0,0 +1,701 @@
+/*
+ * Common pieces of the rate control benchmarks, see bench.h.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <math.h>
+#include <linux/debugfs.h>
+#include "bench.h"
+
+u64 bench_now_us;
+double bench_ns_per_cycle = 1.0;
+u64 bench_cycles_overhead;
+
+/* 802.11b/g in the order ath9k registers them */
+static const struct ieee80211_rate bench_bitrates[BENCH_N_LEGACY] = {
+	{ .bitrate = 10 },
+	{ .bitrate = 20, .flags = IEEE80211_RATE_SHORT_PREAMBLE },
+	{ .bitrate = 55, .flags = IEEE80211_RATE_SHORT_PREAMBLE },
+	{ .bitrate = 110, .flags = IEEE80211_RATE_SHORT_PREAMBLE },
+	{ .bitrate = 60, .flags = IEEE80211_RATE_ERP_G },
+	{ .bitrate = 90, .flags = IEEE80211_RATE_ERP_G },
+	{ .bitrate = 120, .flags = IEEE80211_RATE_ERP_G },
+	{ .bitrate = 180, .flags = IEEE80211_RATE_ERP_G },
+	{ .bitrate = 240, .flags = IEEE80211_RATE_ERP_G },
+	{ .bitrate = 360, .flags = IEEE80211_RATE_ERP_G },
+	{ .bitrate = 480, .flags = IEEE80211_RATE_ERP_G },
+	{ .bitrate = 540, .flags = IEEE80211_RATE_ERP_G },
+};
+
+/* Data bits per OFDM symbol and stream for MCS 0-7 */
+static const int bench_mcs_dbps[2][MCS_GROUP_RATES] = {
+	{ 26, 52, 78, 104, 156, 208, 234, 260 },
+	{ 54, 108, 162, 216, 324, 432, 486, 540 },
+};
+
+/* Register every module, as their module_init would */
+void
+bench_init_all(void)
+{
+	rc80211_cogtra_init();
+	rc80211_cogtra_ht_init();
+	rc80211_cora_init();
+	rc80211_arf_init();
+	rc80211_aarf_init();
+	rc80211_minstrel_init();
+	rc80211_minstrel_ht_init();
+	rc80211_pid_init();
+}
+
+void
+bench_exit_all(void)
+{
+	rc80211_pid_exit();
+	rc80211_minstrel_ht_exit();
+	rc80211_minstrel_exit();
+	rc80211_aarf_exit();
+	rc80211_arf_exit();
+	rc80211_cora_exit();
+	rc80211_cogtra_ht_exit();
+	rc80211_cogtra_exit();
+}
+
+/* Whether name is in a comma separated list; a NULL list selects all */
+int
+bench_selected(const char *list, const char *name)
+{
+	size_t len = strlen(name);
+	const char *p = list;
+
+	if (!list)
+		return 1;
+	while ((p = strstr(p, name)) != NULL) {
+		if ((p == list || p[-1] == ',') && (p[len] == ',' || !p[len]))
+			return 1;
+		p += len;
+	}
+	return 0;
+}
+
+int
+bench_phy_init(struct bench_phy *phy, const struct bench_phy_cfg *cfg,
+	       int id)
+{
+	struct ieee80211_hw *hw = &phy->local.hw;
+	struct ieee80211_sta_ht_cap *ht = &phy->sband.ht_cap;
+	int i;
+
+	memset(phy, 0, sizeof(*phy));
+	phy->cfg = *cfg;
+	if (phy->cfg.streams < 1)
+		phy->cfg.streams = 1;
+	if (phy->cfg.streams > MINSTREL_MAX_STREAMS)
+		phy->cfg.streams = MINSTREL_MAX_STREAMS;
+	snprintf(phy->name, sizeof(phy->name), "phy%d", id);
+
+	memcpy(phy->bitrates, bench_bitrates, sizeof(phy->bitrates));
+	phy->chan.band = IEEE80211_BAND_2GHZ;
+	phy->chan.center_freq = 2437;
+
+	phy->sband.band = IEEE80211_BAND_2GHZ;
+	phy->sband.channels = &phy->chan;
+	phy->sband.n_channels = 1;
+	phy->sband.bitrates = phy->bitrates;
+	phy->sband.n_bitrates = BENCH_N_LEGACY;
+	if (phy->cfg.ht) {
+		ht->ht_supported = true;
+		if (phy->cfg.ht40)
+			ht->cap |= IEEE80211_HT_CAP_SUP_WIDTH_20_40;
+		if (phy->cfg.sgi)
+			ht->cap |= IEEE80211_HT_CAP_SGI_20 |
+				   (phy->cfg.ht40 ? IEEE80211_HT_CAP_SGI_40 : 0);
+		ht->ampdu_factor = 3;
+		ht->ampdu_density = 6;
+		for (i = 0; i < phy->cfg.streams; i++)
+			ht->mcs.rx_mask[i] = 0xff;
+	}
+
+	phy->wiphy.bands[IEEE80211_BAND_2GHZ] = &phy->sband;
+	phy->wiphy.name = phy->name;
+
+	hw->wiphy = &phy->wiphy;
+	hw->conf.channel = &phy->chan;
+	if (!phy->cfg.ht)
+		hw->conf.channel_type = NL80211_CHAN_NO_HT;
+	else if (phy->cfg.ht40)
+		hw->conf.channel_type = NL80211_CHAN_HT40PLUS;
+	else
+		hw->conf.channel_type = NL80211_CHAN_HT20;
+	hw->conf.long_frame_max_tx_count = 4;
+	hw->conf.short_frame_max_tx_count = 7;
+	hw->queues = 4;
+	hw->max_rates = 4;
+	hw->max_rate_tries = 10;
+
+	phy->bss_conf.use_short_preamble = true;
+	phy->bss_conf.use_short_slot = true;
+
+	phy->dir = debugfs_create_dir(phy->name, NULL);
+	phy->rc_dir = debugfs_create_dir("rc", phy->dir);
+	phy->sta_dir = debugfs_create_dir("stations", phy->dir);
+	if (!phy->dir || !phy->rc_dir || !phy->sta_dir)
+		return -ENOMEM;
+	return 0;
+}
+
+int
+bench_phy_start(struct bench_phy *phy, struct rate_control_ops *ops)
+{
+	phy->ops = ops;
+	phy->priv = ops->alloc(&phy->local.hw, phy->rc_dir);
+	return phy->priv ? 0 : -ENOMEM;
+}
+
+void
+bench_phy_stop(struct bench_phy *phy)
+{
+	shim_run_tasklets();
+	if (phy->priv)
+		phy->ops->free(phy->priv);
+	phy->priv = NULL;
+}
+
+void
+bench_phy_free(struct bench_phy *phy)
+{
+	debugfs_remove_recursive(phy->dir);
+	phy->dir = NULL;
+}
+
+void
+bench_sta_init(struct bench_phy *phy, struct bench_sta *sta, int id, int ht)
+{
+	struct ieee80211_sta *s = &sta->si.sta;
+
+	memset(sta, 0, sizeof(*sta));
+	s->addr[0] = 0x02;
+	s->addr[4] = id >> 8;
+	s->addr[5] = id;
+	s->aid = id + 1;
+	s->wme = true;
+	s->supp_rates[IEEE80211_BAND_2GHZ] = BIT(BENCH_N_LEGACY) - 1;
+	if (ht && phy->cfg.ht)
+		s->ht_cap = phy->sband.ht_cap;
+}
+
+int
+bench_sta_add(struct bench_phy *phy, struct bench_sta *sta, gfp_t gfp)
+{
+	struct ieee80211_sta *s = &sta->si.sta;
+	char name[18];
+
+	sta->priv_sta = phy->ops->alloc_sta(phy->priv, s, gfp);
+	if (!sta->priv_sta)
+		return -ENOMEM;
+
+	snprintf(name, sizeof(name), "%02x:%02x:%02x:%02x:%02x:%02x",
+		 s->addr[0], s->addr[1], s->addr[2],
+		 s->addr[3], s->addr[4], s->addr[5]);
+	sta->dir = debugfs_create_dir(name, phy->sta_dir);
+	if (phy->ops->add_sta_debugfs)
+		phy->ops->add_sta_debugfs(phy->priv, sta->priv_sta, sta->dir);
+
+	phy->ops->rate_init(phy->priv, &phy->sband, s, sta->priv_sta);
+	return 0;
+}
+
+void
+bench_sta_remove(struct bench_phy *phy, struct bench_sta *sta)
+{
+	if (!sta->priv_sta)
+		return;
+	if (phy->ops->remove_sta_debugfs)
+		phy->ops->remove_sta_debugfs(phy->priv, sta->priv_sta);
+	debugfs_remove_recursive(sta->dir);
+	sta->dir = NULL;
+	phy->ops->free_sta(phy->priv, &sta->si.sta, sta->priv_sta);
+	sta->priv_sta = NULL;
+}
+
+/* 802.1d priority used for each access category */
+static const u8 bench_ac_tid[IEEE80211_NUM_ACS] = { 6, 5, 0, 1 };
+
+void
+bench_frame_init(struct bench_phy *phy, struct bench_sta *sta,
+		 struct bench_frame *f, int ac)
+{
+	struct ieee80211_hdr *hdr = (struct ieee80211_hdr *)f->data;
+	struct ieee80211_tx_rate_control *txrc = &f->txrc;
+
+	memset(f, 0, sizeof(*f));
+	hdr->frame_control = cpu_to_le16(IEEE80211_FTYPE_DATA |
+					 IEEE80211_STYPE_QOS_DATA |
+					 IEEE80211_FCTL_FROMDS);
+	memcpy(hdr->addr1, sta->si.sta.addr, ETH_ALEN);
+	hdr->seq_ctrl = cpu_to_le16(sta->seq++ << 4);
+	*ieee80211_get_qos_ctl(hdr) = bench_ac_tid[ac];
+
+	f->skb.data = f->data;
+	f->skb.len = BENCH_FRAME_LEN;
+	f->skb.protocol = cpu_to_be16(0x0800);
+	f->skb.queue_mapping = ac;
+	bench_frame_info(f)->band = phy->sband.band;
+
+	txrc->hw = &phy->local.hw;
+	txrc->sband = &phy->sband;
+	txrc->bss_conf = &phy->bss_conf;
+	txrc->skb = &f->skb;
+	txrc->reported_rate.idx = -1;
+	txrc->short_preamble = phy->bss_conf.use_short_preamble;
+	txrc->rate_idx_mask = BIT(phy->sband.n_bitrates) - 1;
+	txrc->max_rate_idx = phy->sband.n_bitrates - 1;
+	memset(txrc->rate_idx_mcs_mask, 0xff, sizeof(txrc->rate_idx_mcs_mask));
+	txrc->bss = true;
+}
+
+/*
+ * SNR (dB) at which a 1500 byte frame gets through half of the time on
+ * each rate, and how fast delivery changes around that point. Legacy
+ * rates follow bench_bitrates; MCS values are for one stream at 20 MHz,
+ * each extra stream costs 3 dB, 40 MHz costs 3 dB and SGI half a dB.
+ */
+static const double bench_legacy_snr[BENCH_N_LEGACY] = {
+	1.0, 3.0, 5.0, 8.0, 5.0, 6.5, 8.0, 10.5, 13.5, 17.0, 21.0, 22.5,
+};
+
+static const double bench_mcs_snr[MCS_GROUP_RATES] = {
+	5.0, 8.0, 10.5, 13.5, 17.0, 21.0, 22.5, 24.0,
+};
+
+#define BENCH_SNR_SLOPE		1.5
+
+static double
+bench_snr_prob(double snr, double threshold)
+{
+	return 1.0 / (1.0 + exp(-BENCH_SNR_SLOPE * (snr - threshold)));
+}
+
+void
+bench_chan_snr(struct bench_chan *chan, double snr)
+{
+	const struct mcs_group *g;
+	double thr;
+	int i, j;
+
+	for (i = 0; i < BENCH_N_LEGACY; i++)
+		chan->legacy[i] = bench_snr_prob(snr, bench_legacy_snr[i]);
+
+	for (i = 0; i < BENCH_N_GROUPS; i++) {
+		g = &minstrel_mcs_groups[i];
+		for (j = 0; j < MCS_GROUP_RATES; j++) {
+			thr = bench_mcs_snr[j] + 3.0 * (g->streams - 1);
+			if (g->flags & IEEE80211_TX_RC_40_MHZ_WIDTH)
+				thr += 3.0;
+			if (g->flags & IEEE80211_TX_RC_SHORT_GI)
+				thr += 0.5;
+			chan->mcs[i][j] = bench_snr_prob(snr, thr);
+		}
+	}
+}
+
+/*
+ * Per attempt delivery probability of a rate as handed to the driver.
+ * Rates the phy cannot send (an MCS beyond its streams or flags it does
+ * not support, a legacy index past the band) never get through. With no
+ * channel only the validity is checked.
+ */
+double
+bench_rate_prob(const struct bench_phy *phy, const struct bench_chan *chan,
+		const struct ieee80211_tx_rate *rate, int *valid)
+{
+	int streams, sgi, ht40;
+
+	*valid = 0;
+	if (rate->idx < 0)
+		return 0;
+
+	if (!(rate->flags & IEEE80211_TX_RC_MCS)) {
+		if (rate->idx >= phy->sband.n_bitrates)
+			return 0;
+		*valid = 1;
+		return chan ? chan->legacy[rate->idx] : 0;
+	}
+
+	streams = rate->idx / MCS_GROUP_RATES + 1;
+	sgi = !!(rate->flags & IEEE80211_TX_RC_SHORT_GI);
+	ht40 = !!(rate->flags & IEEE80211_TX_RC_40_MHZ_WIDTH);
+	if (!phy->cfg.ht || streams > phy->cfg.streams ||
+	    (sgi && !phy->cfg.sgi) || (ht40 && !phy->cfg.ht40))
+		return 0;
+
+	*valid = 1;
+	if (!chan)
+		return 0;
+	return chan->mcs[MINSTREL_GROUP_IDX(streams, sgi, ht40)]
+			[rate->idx % MCS_GROUP_RATES];
+}
+
+/* DIFS with short slots, and the mean backoff before attempt n */
+#define BENCH_SLOT	9
+#define BENCH_DIFS	(10 + 2 * BENCH_SLOT)
+
+static int
+bench_backoff(int attempt)
+{
+	int cw = min((16 << min(attempt, 6)) - 1, 1023);
+
+	return cw * BENCH_SLOT / 2;
+}
+
+/* Air time of one attempt: data frame, SIFS and the ACK */
+int
+bench_rate_airtime(struct bench_phy *phy, const struct ieee80211_tx_rate *rate,
+		   int len)
+{
+	struct ieee80211_local *local = &phy->local;
+	struct ieee80211_rate *r;
+	int streams, dbps, nsym, dur, ack;
+
+	/* ACKs at 24 Mbps (OFDM) or 2 Mbps (CCK), SIFS included */
+	if (rate->flags & IEEE80211_TX_RC_MCS ||
+	    phy->bitrates[clamp_t(int, rate->idx, 0, BENCH_N_LEGACY - 1)].flags &
+	    IEEE80211_RATE_ERP_G)
+		ack = ieee80211_frame_duration(local, 10, 240, 1, 0);
+	else
+		ack = ieee80211_frame_duration(local, 10, 20, 0, 1);
+
+	if (!(rate->flags & IEEE80211_TX_RC_MCS)) {
+		r = &phy->bitrates[clamp_t(int, rate->idx, 0, BENCH_N_LEGACY - 1)];
+		dur = ieee80211_frame_duration(local, len, r->bitrate,
+				!!(r->flags & IEEE80211_RATE_ERP_G),
+				!!(rate->flags & IEEE80211_TX_RC_USE_SHORT_PREAMBLE));
+		return dur + ack;
+	}
+
+	streams = clamp_t(int, rate->idx / MCS_GROUP_RATES + 1, 1,
+			  MINSTREL_MAX_STREAMS);
+	dbps = streams * bench_mcs_dbps[!!(rate->flags & IEEE80211_TX_RC_40_MHZ_WIDTH)]
+				       [rate->idx % MCS_GROUP_RATES];
+	nsym = DIV_ROUND_UP(16 + 8 * len + 6 * streams, dbps);
+	if (rate->flags & IEEE80211_TX_RC_SHORT_GI)
+		dur = DIV_ROUND_UP(nsym * 36, 10);
+	else
+		dur = nsym * 4;
+
+	/* HT mixed format preamble, one HT-LTF per stream (3 take 4) */
+	dur += 32 + 4 * (streams == 3 ? 4 : streams);
+	/* SIFS and signal extension */
+	dur += 16;
+	return dur + ack;
+}
+
+/*
+ * Send a frame the way ath9k does: each of the four rate series is tried
+ * count times in order until the frame is acknowledged, series with no
+ * tries or a negative index are skipped. The status then carries the
+ * number of tries on the last series used and idx -1 after it, as
+ * ath_tx_rc_status() reports them.
+ *
+ * A frame flagged IEEE80211_TX_CTL_AMPDU stands for an aggregate of n
+ * subframes: every attempt carries the subframes not delivered yet, and
+ * the series stop at the first attempt with a block ack. Subframes still
+ * missing then are lost, software retries are not emulated.
+ */
+void
+bench_xmit(struct bench_phy *phy, const struct bench_chan *chan,
+	   struct bench_frame *f, int n, struct bench_tx *tx)
+{
+	struct ieee80211_tx_info *info = bench_frame_info(f);
+	struct ieee80211_tx_rate *rates = info->control.rates;
+	int max_rates = phy->local.hw.max_rates;
+	int ampdu = !!(info->flags & IEEE80211_TX_CTL_AMPDU);
+	int i, k, s, dur, valid, left, sent = 0, tries = 0;
+	double p;
+
+	memset(tx, 0, sizeof(*tx));
+	tx->last = -1;
+	if (!ampdu)
+		n = 1;
+	left = n;
+
+	for (i = 0; i < max_rates && !tx->acked; i++) {
+		if (rates[i].idx < 0 || !rates[i].count)
+			continue;
+
+		p = bench_rate_prob(phy, chan, &rates[i], &valid);
+		for (k = 0; k < rates[i].count && !tx->acked; k++) {
+			/* The A-MPDU delimiter takes 4 bytes per subframe */
+			dur = BENCH_DIFS + bench_backoff(sent++) +
+			      bench_rate_airtime(phy, &rates[i], ampdu ?
+						 left * (f->skb.len + 4) : f->skb.len);
+			tx->airtime += dur;
+			tx->series_airtime[i] += dur;
+			tx->series_attempts[i] += left;
+			tx->attempts += left;
+			if (!valid)
+				tx->invalid += left;
+			for (s = 0; s < left; s++)
+				if (bench_rand_double() < p)
+					tx->acked++;
+			left = n - tx->acked;
+		}
+		tx->last = i;
+		tries = k;
+	}
+
+	/* No series with tries: the frame completes unsent, and ath9k still
+	 * reports one try (long retries + 1) on the first series */
+	if (tx->last < 0) {
+		tx->last = 0;
+		tries = 1;
+	}
+
+	for (i = tx->last + 1; i < max_rates; i++) {
+		info->status.rates[i].count = 0;
+		info->status.rates[i].idx = -1;
+	}
+	info->status.rates[tx->last].count = tries;
+	if (tx->acked)
+		info->flags |= IEEE80211_TX_STAT_ACK;
+	if (!ampdu)
+		return;
+	info->flags |= IEEE80211_TX_STAT_AMPDU;
+	info->status.ampdu_len = n;
+	info->status.ampdu_ack_len = tx->acked;
+}
+
+/* Index of a rate in the per-rate tables: legacy rates first, then the
+ * MCS rates of every minstrel_mcs_groups entry. -1 if the phy cannot send
+ * it */
+int
+bench_rate_key(const struct bench_phy *phy, const struct ieee80211_tx_rate *rate)
+{
+	int valid, streams;
+
+	bench_rate_prob(phy, NULL, rate, &valid);
+	if (!valid)
+		return -1;
+	if (!(rate->flags & IEEE80211_TX_RC_MCS))
+		return rate->idx;
+
+	streams = rate->idx / MCS_GROUP_RATES + 1;
+	return BENCH_N_LEGACY + MCS_GROUP_RATES *
+	       MINSTREL_GROUP_IDX(streams,
+				  !!(rate->flags & IEEE80211_TX_RC_SHORT_GI),
+				  !!(rate->flags & IEEE80211_TX_RC_40_MHZ_WIDTH)) +
+	       rate->idx % MCS_GROUP_RATES;
+}
+
+/* Expected goodput (Mbit/s) of sending every frame at one rate until it
+ * gets through, aggregated n at a time on MCS rates */
+static double
+bench_rate_goodput(struct bench_phy *phy, const struct bench_chan *chan,
+		   const struct ieee80211_tx_rate *rate, int n)
+{
+	int valid, len = BENCH_FRAME_LEN;
+	double p;
+
+	p = bench_rate_prob(phy, chan, rate, &valid);
+	if (!valid || p <= 0)
+		return 0;
+	if (!(rate->flags & IEEE80211_TX_RC_MCS))
+		n = 1;
+	else if (n > 1)
+		len = n * (BENCH_FRAME_LEN + 4);
+
+	return 8.0 * BENCH_FRAME_PAYLOAD * n * p /
+	       (BENCH_DIFS + bench_backoff(0) + bench_rate_airtime(phy, rate, len));
+}
+
+/*
+ * The airtime-optimal rate for a channel, among the legacy rates only or
+ * among every rate the phy can send. Returns its expected goodput, and its
+ * key in *key.
+ */
+double
+bench_oracle(struct bench_phy *phy, const struct bench_chan *chan, int n,
+	     int legacy, int *key)
+{
+	struct ieee80211_tx_rate rate = { .count = 1 };
+	const struct mcs_group *g;
+	double best = 0, tp;
+	int i, j;
+
+	*key = -1;
+	for (i = 0; i < phy->sband.n_bitrates; i++) {
+		rate.idx = i;
+		rate.flags = 0;
+		if (phy->bss_conf.use_short_preamble &&
+		    phy->bitrates[i].flags & IEEE80211_RATE_SHORT_PREAMBLE)
+			rate.flags = IEEE80211_TX_RC_USE_SHORT_PREAMBLE;
+		tp = bench_rate_goodput(phy, chan, &rate, n);
+		if (tp > best) {
+			best = tp;
+			*key = bench_rate_key(phy, &rate);
+		}
+	}
+	if (legacy)
+		return best;
+
+	for (i = 0; i < BENCH_N_GROUPS; i++) {
+		g = &minstrel_mcs_groups[i];
+		for (j = 0; j < MCS_GROUP_RATES; j++) {
+			rate.idx = (g->streams - 1) * MCS_GROUP_RATES + j;
+			rate.flags = IEEE80211_TX_RC_MCS | g->flags;
+			tp = bench_rate_goodput(phy, chan, &rate, n);
+			if (tp > best) {
+				best = tp;
+				*key = bench_rate_key(phy, &rate);
+			}
+		}
+	}
+	return best;
+}
+
+/* "54M", "MCS15", "MCS7 SGI 40" */
+const char *
+bench_rate_name(int key, char *buf, size_t size)
+{
+	const struct mcs_group *g;
+	int rate;
+
+	if (key < BENCH_N_LEGACY) {
+		rate = bench_bitrates[key].bitrate;
+		if (rate % 10)
+			snprintf(buf, size, "%d.%dM", rate / 10, rate % 10);
+		else
+			snprintf(buf, size, "%dM", rate / 10);
+		return buf;
+	}
+
+	key -= BENCH_N_LEGACY;
+	g = &minstrel_mcs_groups[key / MCS_GROUP_RATES];
+	snprintf(buf, size, "MCS%d%s%s",
+		 (g->streams - 1) * MCS_GROUP_RATES + key % MCS_GROUP_RATES,
+		 g->flags & IEEE80211_TX_RC_SHORT_GI ? " SGI" : "",
+		 g->flags & IEEE80211_TX_RC_40_MHZ_WIDTH ? " 40" : "");
+	return buf;
+}
+
+/* The channel draws have their own generator, so every algorithm sees the
+ * same channel for the same seed whatever randomness it consumes. */
+static u64 bench_rand_state = 0x2545f4914f6cdd1dULL;
+
+void
+bench_seed(u64 seed)
+{
+	bench_rand_state = seed ? seed : 0x2545f4914f6cdd1dULL;
+}
+
+double
+bench_rand_double(void)
+{
+	u64 x = bench_rand_state;
+
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	bench_rand_state = x;
+	return ((x * 0x2545f4914f6cdd1dULL) >> 11) * (1.0 / (1ULL << 53));
+}
+
+void
+bench_clock_init(void)
+{
+	struct timespec a, b;
+	u64 c0, c1, t, best = ~0ULL;
+	int i;
+
+	for (i = 0; i < 10000; i++) {
+		c0 = shim_cycles();
+		c1 = shim_cycles();
+		if (c1 - c0 < best)
+			best = c1 - c0;
+	}
+	bench_cycles_overhead = best;
+
+	if (!SHIM_HAVE_CYCLES) {
+		bench_ns_per_cycle = 1.0;
+		return;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &a);
+	c0 = shim_cycles();
+	do {
+		clock_gettime(CLOCK_MONOTONIC, &b);
+		t = (b.tv_sec - a.tv_sec) * 1000000000ULL + b.tv_nsec - a.tv_nsec;
+	} while (t < 50000000);
+	c1 = shim_cycles();
+	bench_ns_per_cycle = (double)t / (c1 - c0);
+}
+
+static u64
+bench_lat_bucket_max(int idx)
+{
+	int shift;
+
+	if (idx < BENCH_LAT_SUB)
+		return idx;
+	shift = (idx >> BENCH_LAT_SUB_SHIFT) - 1;
+	return (((u64)(BENCH_LAT_SUB + (idx & (BENCH_LAT_SUB - 1)))) << shift) +
+	       (1ULL << shift) - 1;
+}
+
+/* Upper bound of the bucket holding the given percentile, in cycles */
+u64
+bench_lat_pct(const struct bench_lat *l, double pct)
+{
+	u64 target, sum = 0;
+	int i;
+
+	if (!l->calls)
+		return 0;
+	target = (u64)ceil(pct * l->calls);
+	for (i = 0; i < BENCH_LAT_BUCKETS; i++) {
+		sum += l->hist[i];
+		if (sum >= target)
+			return min(bench_lat_bucket_max(i), l->max);
+	}
+	return l->max;
+}
+
+void
+bench_lat_merge(struct bench_lat *to, const struct bench_lat *from)
+{
+	int i;
+
+	to->calls += from->calls;
+	to->sum += from->sum;
+	if (from->max > to->max)
+		to->max = from->max;
+	for (i = 0; i < BENCH_LAT_BUCKETS; i++)
+		to->hist[i] += from->hist[i];
+}
+
+void
+bench_lat_header(FILE *out)
+{
+	fprintf(out, "%-12s %-12s %10s %9s %10s %9s %9s\n",
+		"algorithm", "call", "calls", "ns/op", "cycles/op",
+		"p99.9 ns", "max ns");
+}
+
+void
+bench_lat_print(FILE *out, const char *alg, const char *op,
+		const struct bench_lat *l)
+{
+	double mean = l->calls ? (double)l->sum / l->calls : 0;
+
+	fprintf(out, "%-12s %-12s %10llu %9.1f ", alg, op,
+		(unsigned long long)l->calls, mean * bench_ns_per_cycle);
+	if (SHIM_HAVE_CYCLES)
+		fprintf(out, "%10.1f ", mean);
+	else
+		fprintf(out, "%10s ", "-");
+	fprintf(out, "%9.0f %9.0f\n",
+		bench_lat_pct(l, 0.999) * bench_ns_per_cycle,
+		l->max * bench_ns_per_cycle);
+}
@@ -0,0 +1,246 @@
+/*
+ * Common pieces of the rate control benchmarks: a fake phy and stations
+ * driven through a module's rate_control_ops, ath9k style multi-rate retry
+ * emulation over a channel model, and per-call latency statistics.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#ifndef __BENCH_H
+#define __BENCH_H
+
+#include <linux/types.h>
+#include <net/mac80211.h>
+#include "rate.h"
+#include "rc80211_mcs_groups.h"
+#include "shim.h"
+
+#define BENCH_N_LEGACY		12
+#define BENCH_N_GROUPS		(MINSTREL_MAX_STREAMS * MINSTREL_STREAM_GROUPS)
+#define BENCH_FRAME_LEN		1500
+#define BENCH_FRAME_PAYLOAD	(BENCH_FRAME_LEN - 26)	// without the QoS header
+
+/* What the phy supports; stations get the same capabilities */
+struct bench_phy_cfg {
+	int ht;				// advertise HT at all
+	int streams;			// spatial streams, 1..MINSTREL_MAX_STREAMS
+	int ht40;			// 40 MHz channel
+	int sgi;			// short guard interval
+};
+
+struct bench_phy {
+	struct ieee80211_local local;	// hw is embedded, hw_to_local() works
+	struct wiphy wiphy;
+	struct ieee80211_supported_band sband;
+	struct ieee80211_rate bitrates[BENCH_N_LEGACY];
+	struct ieee80211_channel chan;
+	struct ieee80211_bss_conf bss_conf;
+	struct bench_phy_cfg cfg;
+	char name[8];
+
+	struct rate_control_ops *ops;
+	void *priv;
+	struct dentry *dir;		// phyN
+	struct dentry *rc_dir;		// phyN/rc, handed to ops->alloc
+	struct dentry *sta_dir;		// phyN/stations
+};
+
+struct bench_sta {
+	struct sta_info si;
+	void *priv_sta;
+	struct dentry *dir;
+	u16 seq;
+};
+
+/* One frame on its way through get_rate, the hardware and tx_status */
+struct bench_frame {
+	struct sk_buff skb;
+	u8 data[64];
+	struct ieee80211_tx_rate_control txrc;
+};
+
+/* Per attempt delivery probability of every rate the phy can send */
+struct bench_chan {
+	double legacy[BENCH_N_LEGACY];
+	double mcs[BENCH_N_GROUPS][MCS_GROUP_RATES];
+};
+
+/* What the emulated hardware did with one frame */
+struct bench_tx {
+	int acked;			// frames (A-MPDU subframes) delivered
+	int attempts;			// per frame (A-MPDU subframe)
+	int airtime;			// us, including retries and backoff
+	int last;			// index of the last MRR stage used
+	int invalid;			// attempts on rates the phy cannot send
+	int series_attempts[IEEE80211_TX_MAX_RATES];
+	int series_airtime[IEEE80211_TX_MAX_RATES];
+};
+
+/* Number of rates in the per-rate tables, see bench_rate_key() */
+#define BENCH_N_RATES		(BENCH_N_LEGACY + BENCH_N_GROUPS * MCS_GROUP_RATES)
+
+/*
+ * A channel trace, read as the simulation goes. Each sample holds from its
+ * start time until the next one and starts as a copy of the previous one:
+ *
+ *   # comment
+ *   @ <ms>                       start of a sample
+ *   snr <dB>                     every rate from the SNR model
+ *   legacy <p> x 12              per attempt delivery of the b/g rates
+ *   mcs <group> <p> x 8          same for one minstrel_mcs_groups entry
+ *   end <ms>                     length of the trace (default: one second
+ *                                past the last sample)
+ */
+struct bench_trace {
+	FILE *f;
+	const char *name;
+	int line;
+	u64 end_us;			// length of the trace
+	struct bench_chan cur;		// channel in effect
+	unsigned long gen;		// bumped each time cur changes
+	struct bench_chan next;		// the sample after it, if have_next
+	u64 next_us;
+	int have_next;
+	int pending;			// "@" line read, its sample not yet
+	u64 pending_us;
+};
+
+void bench_init_all(void);
+void bench_exit_all(void);
+int bench_selected(const char *list, const char *name);
+
+int bench_phy_init(struct bench_phy *phy, const struct bench_phy_cfg *cfg,
+		   int id);
+int bench_phy_start(struct bench_phy *phy, struct rate_control_ops *ops);
+void bench_phy_stop(struct bench_phy *phy);
+void bench_phy_free(struct bench_phy *phy);
+
+void bench_sta_init(struct bench_phy *phy, struct bench_sta *sta, int id,
+		    int ht);
+int bench_sta_add(struct bench_phy *phy, struct bench_sta *sta, gfp_t gfp);
+void bench_sta_remove(struct bench_phy *phy, struct bench_sta *sta);
+
+void bench_frame_init(struct bench_phy *phy, struct bench_sta *sta,
+		      struct bench_frame *f, int ac);
+
+static inline struct ieee80211_tx_info *
+bench_frame_info(struct bench_frame *f)
+{
+	return IEEE80211_SKB_CB(&f->skb);
+}
+
+/* Clear the rate table as mac80211 does before calling get_rate */
+static inline void
+bench_frame_reset(struct bench_frame *f)
+{
+	struct ieee80211_tx_info *info = bench_frame_info(f);
+	int i;
+
+	info->flags = 0;
+	for (i = 0; i < IEEE80211_TX_MAX_RATES; i++) {
+		info->control.rates[i].idx = -1;
+		info->control.rates[i].flags = 0;
+		info->control.rates[i].count = 1;
+	}
+}
+
+static inline void
+bench_get_rate(struct bench_phy *phy, struct bench_sta *sta,
+	       struct bench_frame *f)
+{
+	phy->ops->get_rate(phy->priv, &sta->si.sta, sta->priv_sta, &f->txrc);
+}
+
+static inline void
+bench_tx_status(struct bench_phy *phy, struct bench_sta *sta,
+		struct bench_frame *f)
+{
+	phy->ops->tx_status(phy->priv, &phy->sband, &sta->si.sta,
+			    sta->priv_sta, &f->skb);
+}
+
+void bench_seed(u64 seed);
+double bench_rand_double(void);
+
+void bench_chan_snr(struct bench_chan *chan, double snr);
+double bench_rate_prob(const struct bench_phy *phy,
+		       const struct bench_chan *chan,
+		       const struct ieee80211_tx_rate *rate, int *valid);
+int bench_rate_airtime(struct bench_phy *phy, const struct ieee80211_tx_rate *rate,
+		       int len);
+void bench_xmit(struct bench_phy *phy, const struct bench_chan *chan,
+		struct bench_frame *f, int n, struct bench_tx *tx);
+int bench_rate_key(const struct bench_phy *phy,
+		   const struct ieee80211_tx_rate *rate);
+const char *bench_rate_name(int key, char *buf, size_t size);
+double bench_oracle(struct bench_phy *phy, const struct bench_chan *chan,
+		    int n, int legacy, int *key);
+
+int bench_trace_open(struct bench_trace *tr, const char *name);
+int bench_trace_rewind(struct bench_trace *tr);
+const struct bench_chan *bench_trace_at(struct bench_trace *tr, u64 us);
+void bench_trace_close(struct bench_trace *tr);
+void bench_trace_write(FILE *out, u64 us, const struct bench_chan *chan);
+
+/* The harness' virtual clock, which drives jiffies */
+extern u64 bench_now_us;
+
+static inline void
+bench_advance(u64 us)
+{
+	bench_now_us += us;
+	jiffies = INITIAL_JIFFIES + bench_now_us * HZ / 1000000;
+}
+
+/*
+ * Per-call latency: count, sum and max in cycles and a log-linear
+ * histogram with 32 buckets per power of two for the percentiles.
+ */
+#define BENCH_LAT_SUB_SHIFT	5
+#define BENCH_LAT_SUB		(1 << BENCH_LAT_SUB_SHIFT)
+#define BENCH_LAT_BUCKETS	(64 * BENCH_LAT_SUB)
+
+struct bench_lat {
+	u64 calls;
+	u64 sum;
+	u64 max;
+	u32 hist[BENCH_LAT_BUCKETS];
+};
+
+extern double bench_ns_per_cycle;
+extern u64 bench_cycles_overhead;
+
+void bench_clock_init(void);
+
+static inline void
+bench_lat_add(struct bench_lat *l, u64 t0, u64 t1)
+{
+	u64 c = t1 - t0;
+	int msb, shift, idx;
+
+	c = c > bench_cycles_overhead ? c - bench_cycles_overhead : 0;
+	l->calls++;
+	l->sum += c;
+	if (c > l->max)
+		l->max = c;
+	if (c < BENCH_LAT_SUB) {
+		idx = c;
+	} else {
+		msb = 63 - __builtin_clzll(c);
+		shift = msb - BENCH_LAT_SUB_SHIFT;
+		idx = ((shift + 1) << BENCH_LAT_SUB_SHIFT) +
+		      ((c >> shift) & (BENCH_LAT_SUB - 1));
+	}
+	l->hist[idx]++;
+}
+
+u64 bench_lat_pct(const struct bench_lat *l, double pct);
+void bench_lat_merge(struct bench_lat *to, const struct bench_lat *from);
+
+void bench_lat_header(FILE *out);
+void bench_lat_print(FILE *out, const char *alg, const char *op,
+		     const struct bench_lat *l);
+
+#endif
@@ -0,0 +1,636 @@
+/*
+ * Minimal userspace stand-in for the kernel interfaces used by the
+ * rc80211 rate control modules. Only what the modules actually touch is
+ * provided; everything here follows the 2.6.32-era semantics closely
+ * enough for the algorithms to behave as they do on the router.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#ifndef __KSHIM_H
+#define __KSHIM_H
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int8_t s8;
+typedef int16_t s16;
+typedef int32_t s32;
+typedef int64_t s64;
+typedef uint16_t __le16;
+typedef uint16_t __be16;
+typedef unsigned int gfp_t;
+typedef unsigned long cycles_t;
+
+#define __init
+#define __exit
+#define __read_mostly
+#define __user
+#define __percpu
+#define __packed		__attribute__((packed))
+#define ____cacheline_aligned	__attribute__((aligned(L1_CACHE_BYTES)))
+#define ____cacheline_aligned_in_smp ____cacheline_aligned
+
+/* The ar71xx (24Kc) data cache line */
+#define L1_CACHE_BYTES		32
+#define SMP_CACHE_BYTES		L1_CACHE_BYTES
+#define PAGE_SIZE		4096UL
+#define BITS_PER_LONG		((int)(8 * sizeof(long)))
+#define NR_CPUS			1
+
+#define EXPORT_SYMBOL(x)
+#define EXPORT_SYMBOL_GPL(x)
+#define THIS_MODULE		((struct module *)0)
+#define module_param(name, type, perm)
+#define MODULE_PARM_DESC(name, desc)
+
+#define EAGAIN		11
+#define EFAULT		14
+#define ENOMEM		12
+#define EBUSY		16
+#define EINVAL		22
+#define ESPIPE		29
+#define EALREADY	114
+#define ERESTARTSYS	512
+#define O_NONBLOCK	04000
+
+#define HZ		100
+
+#define S_IRUSR		0400
+#define S_IWUSR		0200
+#define S_IRUGO		0444
+#define S_IWUGO		0222
+
+#define __GFP_WAIT	0x10u
+#define GFP_ATOMIC	0x20u
+#define GFP_KERNEL	0xd0u
+#define __GFP_NOWARN	0x200u
+
+#define BIT(nr)			(1UL << (nr))
+#define ARRAY_SIZE(a)		(sizeof(a) / sizeof((a)[0]))
+#define likely(x)		__builtin_expect(!!(x), 1)
+#define unlikely(x)		__builtin_expect(!!(x), 0)
+#define barrier()		__asm__ __volatile__("" ::: "memory")
+#define cpu_relax()		barrier()
+#define ACCESS_ONCE(x)		(*(volatile typeof(x) *)&(x))
+#define container_of(ptr, type, member) \
+	((type *)((char *)(ptr) - offsetof(type, member)))
+
+#define BUILD_BUG_ON(c)		((void)sizeof(char[1 - 2 * !!(c)]))
+#define BUG_ON(c)		do { if (unlikely(c)) abort(); } while (0)
+
+void shim_warn(const char *file, int line);
+
+#define WARN_ON(c) ({							\
+	int __ret_warn = !!(c);						\
+	if (unlikely(__ret_warn))					\
+		shim_warn(__FILE__, __LINE__);				\
+	__ret_warn;							\
+})
+
+#define WARN_ON_ONCE(c) ({						\
+	static bool __warned;						\
+	int __ret_warn_once = !!(c);					\
+	if (unlikely(__ret_warn_once) && !__warned) {			\
+		__warned = true;					\
+		shim_warn(__FILE__, __LINE__);				\
+	}								\
+	__ret_warn_once;						\
+})
+
+#define min(x, y) ({							\
+	typeof(x) _min1 = (x);						\
+	typeof(y) _min2 = (y);						\
+	(void) (&_min1 == &_min2);					\
+	_min1 < _min2 ? _min1 : _min2; })
+#define max(x, y) ({							\
+	typeof(x) _max1 = (x);						\
+	typeof(y) _max2 = (y);						\
+	(void) (&_max1 == &_max2);					\
+	_max1 > _max2 ? _max1 : _max2; })
+#define min_t(type, x, y) ({						\
+	type __min1 = (x);						\
+	type __min2 = (y);						\
+	__min1 < __min2 ? __min1 : __min2; })
+#define max_t(type, x, y) ({						\
+	type __max1 = (x);						\
+	type __max2 = (y);						\
+	__max1 > __max2 ? __max1 : __max2; })
+#define clamp_t(type, val, lo, hi) min_t(type, max_t(type, val, lo), hi)
+#define abs(x) ({							\
+	typeof(x) __x = (x);						\
+	__x < 0 ? -__x : __x; })
+#define swap(a, b) \
+	do { typeof(a) __tmp = (a); (a) = (b); (b) = __tmp; } while (0)
+
+#define ALIGN(x, a)		(((x) + (a) - 1) & ~((typeof(x))(a) - 1))
+#define DIV_ROUND_UP(n, d)	(((n) + (d) - 1) / (d))
+
+static inline int fls(unsigned int x)
+{
+	return x ? 32 - __builtin_clz(x) : 0;
+}
+
+static inline unsigned long roundup_pow_of_two(unsigned long n)
+{
+	return 1UL << (BITS_PER_LONG - __builtin_clzl(n - 1));
+}
+
+/* 64 bit division, as on a 32 bit target */
+#define do_div(n, base) ({						\
+	u32 __base = (base);						\
+	u32 __rem = (u32)((n) % __base);				\
+	(n) /= __base;							\
+	__rem;								\
+})
+
+static inline u64 div_u64(u64 dividend, u32 divisor)
+{
+	return dividend / divisor;
+}
+
+static inline u64 div64_u64(u64 dividend, u64 divisor)
+{
+	return dividend / divisor;
+}
+
+/* Like the kernel's: the number of chars written into buf, without the
+ * terminating NUL, and never more than size - 1 */
+static inline int scnprintf(char *buf, size_t size, const char *fmt, ...)
+{
+	va_list args;
+	int i;
+
+	if (!size)
+		return 0;
+	va_start(args, fmt);
+	i = vsnprintf(buf, size, fmt, args);
+	va_end(args);
+	if (i < 0)
+		return 0;
+	return (size_t)i < size ? i : (int)(size - 1);
+}
+
+/* printk goes to stderr, and only with -v */
+extern int shim_verbose;
+#define KERN_DEBUG	""
+#define KERN_INFO	""
+#define KERN_WARNING	""
+#define KERN_ERR	""
+#define printk(fmt, ...) \
+	(shim_verbose ? fprintf(stderr, fmt, ##__VA_ARGS__) : 0)
+#define pr_debug(fmt, ...)	0
+#define net_ratelimit()		1
+
+/* Memory ordering; the harness runs the modules from one thread */
+#define smp_mb()		__sync_synchronize()
+#define smp_rmb()		__sync_synchronize()
+#define smp_wmb()		__sync_synchronize()
+#define smp_read_barrier_depends() do { } while (0)
+#define smp_mb__before_clear_bit() smp_mb()
+#define smp_mb__after_clear_bit() smp_mb()
+#define rcu_assign_pointer(p, v) ({ smp_wmb(); (p) = (v); })
+#define rcu_dereference(p)	ACCESS_ONCE(p)
+/* Big endian for the MIPS routers, see qemu-count.sh */
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define cpu_to_be16(x)		((u16)(x))
+#define cpu_to_le16(x)		__builtin_bswap16(x)
+#define le16_to_cpu(x)		__builtin_bswap16(x)
+#else
+#define cpu_to_be16(x)		__builtin_bswap16(x)
+#define cpu_to_le16(x)		((u16)(x))
+#define le16_to_cpu(x)		((u16)(x))
+#endif
+
+/* Atomics */
+typedef struct {
+	int counter;
+} atomic_t;
+
+#define ATOMIC_INIT(i)		{ (i) }
+
+static inline int atomic_read(const atomic_t *v)
+{
+	return ACCESS_ONCE(v->counter);
+}
+
+static inline void atomic_set(atomic_t *v, int i)
+{
+	v->counter = i;
+}
+
+static inline void atomic_add(int i, atomic_t *v)
+{
+	__sync_fetch_and_add(&v->counter, i);
+}
+
+static inline void atomic_sub(int i, atomic_t *v)
+{
+	__sync_fetch_and_sub(&v->counter, i);
+}
+
+static inline int atomic_add_return(int i, atomic_t *v)
+{
+	return __sync_add_and_fetch(&v->counter, i);
+}
+
+#define atomic_inc(v)		atomic_add(1, v)
+#define atomic_dec(v)		atomic_sub(1, v)
+#define atomic_inc_return(v)	atomic_add_return(1, v)
+
+static inline int atomic_xchg(atomic_t *v, int i)
+{
+	return __atomic_exchange_n(&v->counter, i, __ATOMIC_SEQ_CST);
+}
+
+static inline int atomic_cmpxchg(atomic_t *v, int old, int new)
+{
+	return __sync_val_compare_and_swap(&v->counter, old, new);
+}
+
+#define xchg(p, v)		__atomic_exchange_n(p, v, __ATOMIC_SEQ_CST)
+#define cmpxchg(p, o, n)	__sync_val_compare_and_swap(p, o, n)
+
+static inline void set_bit(int nr, volatile unsigned long *addr)
+{
+	__sync_fetch_and_or(addr, 1UL << nr);
+}
+
+static inline void clear_bit(int nr, volatile unsigned long *addr)
+{
+	__sync_fetch_and_and(addr, ~(1UL << nr));
+}
+
+static inline int test_bit(int nr, const volatile unsigned long *addr)
+{
+	return (*addr >> nr) & 1;
+}
+
+static inline int test_and_set_bit(int nr, volatile unsigned long *addr)
+{
+	return !!(__sync_fetch_and_or(addr, 1UL << nr) & (1UL << nr));
+}
+
+static inline int test_and_clear_bit(int nr, volatile unsigned long *addr)
+{
+	return !!(__sync_fetch_and_and(addr, ~(1UL << nr)) & (1UL << nr));
+}
+
+#define test_and_set_bit_lock(nr, addr)	test_and_set_bit(nr, addr)
+#define clear_bit_unlock(nr, addr)	clear_bit(nr, addr)
+
+/* Locks. A uniprocessor kernel, as on the RSPro: taking a lock only
+ * disables softirqs, so the shim only checks for recursion. */
+typedef struct {
+	int locked;
+} spinlock_t;
+
+#define DEFINE_SPINLOCK(x)	spinlock_t x = { 0 }
+
+static inline void spin_lock_init(spinlock_t *lock)
+{
+	lock->locked = 0;
+}
+
+static inline void spin_lock(spinlock_t *lock)
+{
+	WARN_ON(lock->locked);
+	lock->locked = 1;
+	barrier();
+}
+
+static inline int spin_trylock(spinlock_t *lock)
+{
+	if (lock->locked)
+		return 0;
+	lock->locked = 1;
+	barrier();
+	return 1;
+}
+
+static inline void spin_unlock(spinlock_t *lock)
+{
+	barrier();
+	lock->locked = 0;
+}
+
+#define spin_lock_bh(l)			spin_lock(l)
+#define spin_unlock_bh(l)		spin_unlock(l)
+#define spin_lock_irqsave(l, f)		do { (f) = 0; spin_lock(l); } while (0)
+#define spin_unlock_irqrestore(l, f)	do { (void)(f); spin_unlock(l); } while (0)
+
+struct mutex {
+	int locked;
+};
+
+#define DEFINE_MUTEX(x)		struct mutex x = { 0 }
+#define mutex_lock(m)		((m)->locked = 1)
+#define mutex_unlock(m)		((m)->locked = 0)
+
+typedef struct {
+	unsigned sequence;
+} seqcount_t;
+
+static inline void seqcount_init(seqcount_t *s)
+{
+	s->sequence = 0;
+}
+
+static inline unsigned read_seqcount_begin(const seqcount_t *s)
+{
+	unsigned ret;
+
+	while ((ret = ACCESS_ONCE(s->sequence)) & 1)
+		;
+	smp_rmb();
+	return ret;
+}
+
+static inline int read_seqcount_retry(const seqcount_t *s, unsigned start)
+{
+	smp_rmb();
+	return s->sequence != start;
+}
+
+static inline void write_seqcount_begin(seqcount_t *s)
+{
+	s->sequence++;
+	smp_wmb();
+}
+
+static inline void write_seqcount_end(seqcount_t *s)
+{
+	smp_wmb();
+	s->sequence++;
+}
+
+/* Wait queues, only used by the pid event file */
+typedef struct {
+	int waiters;
+} wait_queue_head_t;
+
+struct file;
+typedef struct poll_table_struct {
+	int unused;
+} poll_table;
+
+#define POLLIN			0x0001
+#define POLLRDNORM		0x0040
+#define init_waitqueue_head(q)	((q)->waiters = 0)
+#define wake_up_all(q)		do { (void)(q); } while (0)
+#define poll_wait(f, q, p)	do { (void)(f); (void)(q); (void)(p); } while (0)
+#define wait_event_interruptible(q, cond) ((cond) ? 0 : -ERESTARTSYS)
+
+/* Lists */
+struct list_head {
+	struct list_head *next, *prev;
+};
+
+#define LIST_HEAD_INIT(name)	{ &(name), &(name) }
+#define LIST_HEAD(name)		struct list_head name = LIST_HEAD_INIT(name)
+
+static inline void INIT_LIST_HEAD(struct list_head *list)
+{
+	list->next = list;
+	list->prev = list;
+}
+
+static inline void __list_add(struct list_head *new, struct list_head *prev,
+			      struct list_head *next)
+{
+	next->prev = new;
+	new->next = next;
+	new->prev = prev;
+	prev->next = new;
+}
+
+static inline void list_add(struct list_head *new, struct list_head *head)
+{
+	__list_add(new, head, head->next);
+}
+
+static inline void list_add_tail(struct list_head *new, struct list_head *head)
+{
+	__list_add(new, head->prev, head);
+}
+
+static inline void list_del(struct list_head *entry)
+{
+	entry->next->prev = entry->prev;
+	entry->prev->next = entry->next;
+}
+
+static inline void list_del_init(struct list_head *entry)
+{
+	list_del(entry);
+	INIT_LIST_HEAD(entry);
+}
+
+static inline int list_empty(const struct list_head *head)
+{
+	return head->next == head;
+}
+
+#define list_entry(ptr, type, member) container_of(ptr, type, member)
+#define list_first_entry(ptr, type, member) \
+	list_entry((ptr)->next, type, member)
+#define list_for_each_entry(pos, head, member)				\
+	for (pos = list_entry((head)->next, typeof(*pos), member);	\
+	     &pos->member != (head);					\
+	     pos = list_entry(pos->member.next, typeof(*pos), member))
+#define list_for_each_entry_safe(pos, n, head, member)			\
+	for (pos = list_entry((head)->next, typeof(*pos), member),	\
+		n = list_entry(pos->member.next, typeof(*pos), member);	\
+	     &pos->member != (head);					\
+	     pos = n, n = list_entry(n->member.next, typeof(*n), member))
+
+/* Time. jiffies follows the harness' virtual clock, not the host's. */
+extern unsigned long volatile jiffies;
+
+/* As in the kernel, jiffies wraps five minutes after boot */
+#define INITIAL_JIFFIES ((unsigned long)(unsigned int)(-300 * HZ))
+
+#define time_after(a, b)	((long)((b) - (a)) < 0)
+#define time_before(a, b)	time_after(b, a)
+#define time_after_eq(a, b)	((long)((a) - (b)) >= 0)
+#define time_before_eq(a, b)	time_after_eq(b, a)
+#define time_in_range(a, b, c)	(time_after_eq(a, b) && time_before_eq(a, c))
+
+static inline unsigned long msecs_to_jiffies(const unsigned int m)
+{
+	return (m + (1000 / HZ) - 1) / (1000 / HZ);
+}
+
+static inline unsigned int jiffies_to_msecs(const unsigned long j)
+{
+	return (1000 / HZ) * j;
+}
+
+typedef union {
+	s64 tv64;
+} ktime_t;
+
+ktime_t ktime_get(void);
+
+static inline ktime_t ktime_sub(const ktime_t a, const ktime_t b)
+{
+	ktime_t res;
+
+	res.tv64 = a.tv64 - b.tv64;
+	return res;
+}
+
+static inline s64 ktime_to_ns(const ktime_t kt)
+{
+	return kt.tv64;
+}
+
+static inline s64 ktime_to_us(const ktime_t kt)
+{
+	return kt.tv64 / 1000;
+}
+
+cycles_t get_cycles(void);
+
+/* Randomness, a seeded generator so that runs are reproducible */
+void get_random_bytes(void *buf, int nbytes);
+u32 random32(void);
+
+/* Allocations. kmalloc rounds to the slab size classes and accounts the
+ * result, see shim.c. */
+void *kmalloc(size_t size, gfp_t flags);
+void *kzalloc(size_t size, gfp_t flags);
+void *kcalloc(size_t n, size_t size, gfp_t flags);
+void kfree(const void *ptr);
+size_t ksize(const void *ptr);
+void *vmalloc(unsigned long size);
+void *vzalloc(unsigned long size);
+void vfree(const void *ptr);
+
+struct kmem_cache;
+#define SLAB_HWCACHE_ALIGN	0x00002000UL
+
+struct kmem_cache *kmem_cache_create(const char *name, size_t size,
+				     size_t align, unsigned long flags,
+				     void (*ctor)(void *));
+void kmem_cache_destroy(struct kmem_cache *cachep);
+void *kmem_cache_alloc(struct kmem_cache *cachep, gfp_t flags);
+void *kmem_cache_zalloc(struct kmem_cache *cachep, gfp_t flags);
+void kmem_cache_free(struct kmem_cache *cachep, void *objp);
+unsigned int kmem_cache_size(struct kmem_cache *cachep);
+
+#define alloc_percpu(type)	((type *)kzalloc(sizeof(type), GFP_KERNEL))
+#define free_percpu(ptr)	kfree(ptr)
+#define per_cpu_ptr(ptr, cpu)	((void)(cpu), (ptr))
+#define this_cpu_ptr(ptr)	(ptr)
+#define for_each_possible_cpu(cpu) for ((cpu) = 0; (cpu) < NR_CPUS; (cpu)++)
+#define smp_processor_id()	0
+#define get_cpu()		0
+#define put_cpu()		do { } while (0)
+
+/* Softirq work. Tasklets queue up and run when the harness says so. */
+struct tasklet_struct {
+	struct tasklet_struct *next;
+	unsigned long state;
+	void (*func)(unsigned long);
+	unsigned long data;
+};
+
+void tasklet_init(struct tasklet_struct *t, void (*func)(unsigned long),
+		  unsigned long data);
+void tasklet_schedule(struct tasklet_struct *t);
+void tasklet_kill(struct tasklet_struct *t);
+#define tasklet_unlock_wait(t)	do { (void)(t); } while (0)
+
+/* debugfs, kept in memory so that the harness can read the files back */
+struct module;
+
+struct inode {
+	void *i_private;
+};
+
+struct file {
+	void *private_data;
+	unsigned int f_flags;
+};
+
+struct dentry;
+
+struct file_operations {
+	struct module *owner;
+	loff_t (*llseek)(struct file *, loff_t, int);
+	ssize_t (*read)(struct file *, char __user *, size_t, loff_t *);
+	ssize_t (*write)(struct file *, const char __user *, size_t, loff_t *);
+	unsigned int (*poll)(struct file *, poll_table *);
+	int (*open)(struct inode *, struct file *);
+	int (*release)(struct inode *, struct file *);
+};
+
+loff_t default_llseek(struct file *file, loff_t offset, int whence);
+loff_t no_llseek(struct file *file, loff_t offset, int whence);
+loff_t noop_llseek(struct file *file, loff_t offset, int whence);
+
+static inline int nonseekable_open(struct inode *inode, struct file *filp)
+{
+	return 0;
+}
+
+ssize_t simple_read_from_buffer(void __user *to, size_t count, loff_t *ppos,
+				const void *from, size_t available);
+
+static inline unsigned long copy_to_user(void __user *to, const void *from,
+					 unsigned long n)
+{
+	memcpy(to, from, n);
+	return 0;
+}
+
+static inline unsigned long copy_from_user(void *to, const void __user *from,
+					   unsigned long n)
+{
+	memcpy(to, from, n);
+	return 0;
+}
+
+struct dentry *debugfs_create_dir(const char *name, struct dentry *parent);
+struct dentry *debugfs_create_file(const char *name, mode_t mode,
+				   struct dentry *parent, void *data,
+				   const struct file_operations *fops);
+struct dentry *debugfs_create_u8(const char *name, mode_t mode,
+				 struct dentry *parent, u8 *value);
+struct dentry *debugfs_create_u32(const char *name, mode_t mode,
+				  struct dentry *parent, u32 *value);
+struct dentry *debugfs_create_bool(const char *name, mode_t mode,
+				   struct dentry *parent, u32 *value);
+void debugfs_remove(struct dentry *dentry);
+void debugfs_remove_recursive(struct dentry *dentry);
+
+/* Socket buffers: only the fields the modules read */
+#define ETH_P_PAE	0x888E
+
+struct sk_buff {
+	unsigned char *data;
+	unsigned int len;
+	__be16 protocol;
+	u16 queue_mapping;
+	char cb[48] __attribute__((aligned(8)));
+};
+
+static inline u16 skb_get_queue_mapping(const struct sk_buff *skb)
+{
+	return skb->queue_mapping;
+}
+
+#endif /* __KSHIM_H */
@@ -0,0 +1 @@
+/* pid includes mesh.h for nothing it uses on the rate control path */
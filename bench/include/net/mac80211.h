@@ -0,0 +1,244 @@
+/*
+ * The parts of net/mac80211.h used by the rate control modules, with the
+ * layouts of the compat-wireless 2012-03-01 tree this package builds.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#ifndef __SHIM_NET_MAC80211_H
+#define __SHIM_NET_MAC80211_H
+
+#include <kshim.h>
+#include <linux/ieee80211.h>
+
+enum ieee80211_band {
+	IEEE80211_BAND_2GHZ,
+	IEEE80211_BAND_5GHZ,
+	IEEE80211_NUM_BANDS
+};
+
+enum nl80211_channel_type {
+	NL80211_CHAN_NO_HT,
+	NL80211_CHAN_HT20,
+	NL80211_CHAN_HT40MINUS,
+	NL80211_CHAN_HT40PLUS
+};
+
+enum ieee80211_ac_numbers {
+	IEEE80211_AC_VO		= 0,
+	IEEE80211_AC_VI		= 1,
+	IEEE80211_AC_BE		= 2,
+	IEEE80211_AC_BK		= 3,
+};
+#define IEEE80211_NUM_ACS	4
+
+#define IEEE80211_RATE_SHORT_PREAMBLE	(1 << 0)
+#define IEEE80211_RATE_MANDATORY_A	(1 << 1)
+#define IEEE80211_RATE_MANDATORY_B	(1 << 2)
+#define IEEE80211_RATE_MANDATORY_G	(1 << 3)
+#define IEEE80211_RATE_ERP_G		(1 << 4)
+
+struct ieee80211_rate {
+	u32 flags;
+	u16 bitrate;
+	u16 hw_value, hw_value_short;
+};
+
+struct ieee80211_channel {
+	enum ieee80211_band band;
+	u16 center_freq;
+	u16 hw_value;
+};
+
+struct ieee80211_supported_band {
+	struct ieee80211_channel *channels;
+	struct ieee80211_rate *bitrates;
+	enum ieee80211_band band;
+	int n_channels;
+	int n_bitrates;
+	struct ieee80211_sta_ht_cap ht_cap;
+};
+
+struct wiphy {
+	struct ieee80211_supported_band *bands[IEEE80211_NUM_BANDS];
+	const char *name;
+};
+
+static inline const char *wiphy_name(const struct wiphy *wiphy)
+{
+	return wiphy->name;
+}
+
+struct ieee80211_conf {
+	u32 flags;
+	struct ieee80211_channel *channel;
+	enum nl80211_channel_type channel_type;
+	u8 long_frame_max_tx_count, short_frame_max_tx_count;
+};
+
+struct ieee80211_hw {
+	struct ieee80211_conf conf;
+	struct wiphy *wiphy;
+	const char *rate_control_algorithm;
+	void *priv;
+	u32 flags;
+	u16 queues;
+	u8 max_rates;
+	u8 max_rate_tries;
+};
+
+#define IEEE80211_TX_MAX_RATES	5
+
+#define IEEE80211_TX_RC_USE_RTS_CTS		BIT(0)
+#define IEEE80211_TX_RC_USE_CTS_PROTECT		BIT(1)
+#define IEEE80211_TX_RC_USE_SHORT_PREAMBLE	BIT(2)
+#define IEEE80211_TX_RC_MCS			BIT(3)
+#define IEEE80211_TX_RC_GREEN_FIELD		BIT(4)
+#define IEEE80211_TX_RC_40_MHZ_WIDTH		BIT(5)
+#define IEEE80211_TX_RC_DUP_DATA		BIT(6)
+#define IEEE80211_TX_RC_SHORT_GI		BIT(7)
+
+struct ieee80211_tx_rate {
+	s8 idx;
+	u8 count;
+	u8 flags;
+} __packed;
+
+#define IEEE80211_TX_CTL_REQ_TX_STATUS		BIT(0)
+#define IEEE80211_TX_CTL_ASSIGN_SEQ		BIT(1)
+#define IEEE80211_TX_CTL_NO_ACK			BIT(2)
+#define IEEE80211_TX_CTL_CLEAR_PS_FILT		BIT(3)
+#define IEEE80211_TX_CTL_FIRST_FRAGMENT		BIT(4)
+#define IEEE80211_TX_CTL_SEND_AFTER_DTIM	BIT(5)
+#define IEEE80211_TX_CTL_AMPDU			BIT(6)
+#define IEEE80211_TX_CTL_INJECTED		BIT(7)
+#define IEEE80211_TX_STAT_TX_FILTERED		BIT(8)
+#define IEEE80211_TX_STAT_ACK			BIT(9)
+#define IEEE80211_TX_STAT_AMPDU			BIT(10)
+#define IEEE80211_TX_STAT_AMPDU_NO_BACK		BIT(11)
+#define IEEE80211_TX_CTL_RATE_CTRL_PROBE	BIT(12)
+#define IEEE80211_TX_CTL_LDPC			BIT(22)
+#define IEEE80211_TX_CTL_STBC			(BIT(23) | BIT(24))
+#define IEEE80211_TX_CTL_STBC_SHIFT		23
+
+struct ieee80211_tx_info {
+	u32 flags;
+	u8 band;
+	u8 antenna_sel_tx;
+	u16 ack_frame_id;
+
+	union {
+		struct {
+			struct ieee80211_tx_rate rates[IEEE80211_TX_MAX_RATES];
+			s8 rts_cts_rate_idx;
+			void *vif;
+			void *hw_key;
+		} control;
+		struct {
+			struct ieee80211_tx_rate rates[IEEE80211_TX_MAX_RATES];
+			int ack_signal;
+			u8 ampdu_ack_len;
+			u8 ampdu_len;
+			u8 antenna;
+		} status;
+		void *driver_data[3];
+	};
+};
+
+static inline struct ieee80211_tx_info *IEEE80211_SKB_CB(struct sk_buff *skb)
+{
+	return (struct ieee80211_tx_info *)skb->cb;
+}
+
+struct ieee80211_sta {
+	u32 supp_rates[IEEE80211_NUM_BANDS];
+	u8 addr[ETH_ALEN];
+	u16 aid;
+	struct ieee80211_sta_ht_cap ht_cap;
+	bool wme;
+};
+
+struct ieee80211_bss_conf {
+	bool use_cts_prot;
+	bool use_short_preamble;
+	bool use_short_slot;
+	u32 basic_rates;
+};
+
+struct ieee80211_tx_rate_control {
+	struct ieee80211_hw *hw;
+	struct ieee80211_supported_band *sband;
+	struct ieee80211_bss_conf *bss_conf;
+	struct sk_buff *skb;
+	struct ieee80211_tx_rate reported_rate;
+	bool rts, short_preamble;
+	u8 max_rate_idx;
+	u32 rate_idx_mask;
+	u8 rate_idx_mcs_mask[IEEE80211_HT_MCS_MASK_LEN];
+	bool bss;
+};
+
+struct rate_control_ops {
+	struct module *module;
+	const char *name;
+	void *(*alloc)(struct ieee80211_hw *hw, struct dentry *debugfsdir);
+	void (*free)(void *priv);
+
+	void *(*alloc_sta)(void *priv, struct ieee80211_sta *sta, gfp_t gfp);
+	void (*rate_init)(void *priv, struct ieee80211_supported_band *sband,
+			  struct ieee80211_sta *sta, void *priv_sta);
+	void (*rate_update)(void *priv, struct ieee80211_supported_band *sband,
+			    struct ieee80211_sta *sta, void *priv_sta,
+			    u32 changed,
+			    enum nl80211_channel_type oper_chan_type);
+	void (*free_sta)(void *priv, struct ieee80211_sta *sta,
+			 void *priv_sta);
+
+	void (*tx_status)(void *priv, struct ieee80211_supported_band *sband,
+			  struct ieee80211_sta *sta, void *priv_sta,
+			  struct sk_buff *skb);
+	void (*get_rate)(void *priv, struct ieee80211_sta *sta, void *priv_sta,
+			 struct ieee80211_tx_rate_control *txrc);
+
+	void (*add_sta_debugfs)(void *priv, void *priv_sta,
+				struct dentry *dir);
+	void (*remove_sta_debugfs)(void *priv, void *priv_sta);
+};
+
+int ieee80211_rate_control_register(struct rate_control_ops *ops);
+void ieee80211_rate_control_unregister(struct rate_control_ops *ops);
+
+static inline int rate_supported(struct ieee80211_sta *sta,
+				 enum ieee80211_band band,
+				 int index)
+{
+	return (sta == NULL || sta->supp_rates[band] & BIT(index));
+}
+
+bool rate_control_send_low(struct ieee80211_sta *sta,
+			   void *priv_sta,
+			   struct ieee80211_tx_rate_control *txrc);
+
+static inline s8
+rate_lowest_index(struct ieee80211_supported_band *sband,
+		  struct ieee80211_sta *sta)
+{
+	int i;
+
+	for (i = 0; i < sband->n_bitrates; i++)
+		if (rate_supported(sta, sband->band, i))
+			return i;
+
+	/* warn when we cannot find a rate. */
+	WARN_ON(1);
+
+	/* and return 0 (the lowest index) */
+	return 0;
+}
+
+int ieee80211_start_tx_ba_session(struct ieee80211_sta *sta, u16 tid,
+				  u16 timeout);
+
+#endif
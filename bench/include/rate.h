@@ -0,0 +1,71 @@
+/*
+ * Stand-in for net/mac80211/rate.h and the bits of ieee80211_i.h and
+ * sta_info.h that the rate control modules reach through it.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#ifndef __SHIM_RATE_H
+#define __SHIM_RATE_H
+
+#include <net/mac80211.h>
+
+struct ieee80211_local {
+	struct ieee80211_hw hw;
+};
+
+static inline struct ieee80211_local *hw_to_local(struct ieee80211_hw *hw)
+{
+	return container_of(hw, struct ieee80211_local, hw);
+}
+
+int ieee80211_frame_duration(struct ieee80211_local *local, size_t len,
+			     int rate, int erp, int short_preamble);
+
+struct ewma {
+	unsigned long internal;
+	unsigned long factor;
+	unsigned long weight;
+};
+
+static inline unsigned long ewma_read(const struct ewma *avg)
+{
+	return avg->internal >> avg->factor;
+}
+
+#define STA_TID_NUM 16
+
+struct tid_ampdu_tx;
+
+struct sta_ampdu_mlme {
+	struct tid_ampdu_tx *tid_tx[STA_TID_NUM];
+};
+
+struct sta_info {
+	struct ewma avg_signal;
+	struct sta_ampdu_mlme ampdu_mlme;
+
+	/* keep last! */
+	struct ieee80211_sta sta;
+};
+
+extern int rc80211_pid_init(void);
+extern void rc80211_pid_exit(void);
+extern int rc80211_minstrel_init(void);
+extern void rc80211_minstrel_exit(void);
+extern int rc80211_minstrel_ht_init(void);
+extern void rc80211_minstrel_ht_exit(void);
+extern int rc80211_cogtra_init(void);
+extern void rc80211_cogtra_exit(void);
+extern int rc80211_cogtra_ht_init(void);
+extern void rc80211_cogtra_ht_exit(void);
+extern int rc80211_cora_init(void);
+extern void rc80211_cora_exit(void);
+extern int rc80211_arf_init(void);
+extern void rc80211_arf_exit(void);
+extern int rc80211_aarf_init(void);
+extern void rc80211_aarf_exit(void);
+
+#endif
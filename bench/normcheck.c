@@ -0,0 +1,278 @@
+/*
+ * normcheck - conformance of cogtra_normal_sample with the normal curve
+ *
+ * For each stdev (times 100) the sampler is drawn from millions of times,
+ * centred in a wide interval and truncated at one side and at both sides
+ * the way cogtra uses it next to the lowest and highest rates. The target
+ * is the normal curve N(mean, stdev) rounded to the nearest integer, with
+ * offsets beyond +-COGTRA_NORMAL_MAX_OFFSET folded onto the last ones and
+ * the mass outside [lo, hi] spread in proportion over the values inside.
+ * Its probabilities come from erfc in double precision, not from the
+ * kernel's table.
+ *
+ * Checked against the target: the probability of every value, the mean,
+ * the variance and the mass of both tails beyond 2 and 3 stdevs. Each
+ * measured figure must lie within 5 standard errors of the sampling, plus
+ * what the 15 bit cdf table and the 16 bit random draw can add. Exits with
+ * 1 when anything is off.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <getopt.h>
+#include <math.h>
+#include "shim.h"
+#include "rc80211_random.h"
+#include "rc80211_cogtra_normal.h"
+
+#define NORMCHECK_N		(2 * COGTRA_NORMAL_MAX_OFFSET + 1)
+#define NORMCHECK_Z		5.0
+
+/* Per value probability error allowed for the table: one unit of each of
+ * the two cdf entries around a value, plus the draw's rounding */
+#define NORMCHECK_EPS		(3.0 / COGTRA_NORMAL_SCALE)
+
+struct normcheck_case {
+	const char *name;
+	int mean, lo, hi;
+};
+
+static const struct normcheck_case normcheck_cases[] = {
+	{ "centred",	20,	0,	40 },
+	{ "lowest",	1,	0,	40 },	// one step above lo
+	{ "narrow",	2,	0,	4 },	// both sides cut
+};
+
+struct normcheck_stats {
+	double p[NORMCHECK_N];		// target probability per offset
+	unsigned long count[NORMCHECK_N];
+	int first, last;		// offsets inside [lo, hi]
+};
+
+static unsigned long normcheck_fails;
+static int normcheck_verbose;
+
+static double
+normcheck_phi(double x)
+{
+	return 0.5 * erfc(-x / M_SQRT2);
+}
+
+/* Target probabilities of the offsets for stdev s on [first, last] */
+static void
+normcheck_target(struct normcheck_stats *st, double s)
+{
+	double sum = 0;
+	int o;
+
+	for (o = -COGTRA_NORMAL_MAX_OFFSET; o <= COGTRA_NORMAL_MAX_OFFSET; o++) {
+		double lo = o == -COGTRA_NORMAL_MAX_OFFSET ? 0 :
+			normcheck_phi((o - 0.5) / s);
+		double hi = o == COGTRA_NORMAL_MAX_OFFSET ? 1 :
+			normcheck_phi((o + 0.5) / s);
+		double p = o < st->first || o > st->last ? 0 : hi - lo;
+
+		st->p[o + COGTRA_NORMAL_MAX_OFFSET] = p;
+		sum += p;
+	}
+	for (o = 0; o < NORMCHECK_N; o++)
+		st->p[o] /= sum;
+}
+
+/* Compares a measured figure with its target; sd is the standard
+ * deviation of one sample of the figure and slack the table's share */
+static void
+normcheck_expect(const char *what, int stdev, const struct normcheck_case *c,
+		 double got, double want, double sd, double slack,
+		 unsigned long n)
+{
+	double tol = NORMCHECK_Z * sd / sqrt(n) + slack;
+
+	if (fabs(got - want) <= tol)
+		return;
+	printf("FAIL stdev %d.%02d %-8s %-12s %.6f, expected %.6f +- %.6f\n",
+	       stdev / 100, stdev % 100, c->name, what, got, want, tol);
+	normcheck_fails++;
+}
+
+static void
+normcheck_run(struct rc_rand *rr, int stdev, const struct normcheck_case *c,
+	      unsigned long samples)
+{
+	struct cogtra_normal_cache nc = { .stdev = 0 };
+	struct normcheck_stats st = { .first = 0 };
+	double s = stdev / 100.0, m1 = 0, m2 = 0, m4 = 0;
+	double g1 = 0, g2 = 0, mean, var, mvar, cvar;
+	unsigned long i;
+	int o, k, off;
+
+	st.first = max(c->lo - c->mean, -COGTRA_NORMAL_MAX_OFFSET);
+	st.last = min(c->hi - c->mean, COGTRA_NORMAL_MAX_OFFSET);
+	normcheck_target(&st, s);
+
+	for (i = 0; i < samples; i++) {
+		int v = cogtra_normal_sample(rr, &nc, c->mean, stdev, c->lo,
+					     c->hi);
+
+		off = v - c->mean;
+		if (off < st.first || off > st.last) {
+			printf("FAIL stdev %d.%02d %-8s returned %d outside "
+			       "[%d, %d]\n", stdev / 100, stdev % 100, c->name,
+			       v, c->lo, c->hi);
+			normcheck_fails++;
+			return;
+		}
+		st.count[off + COGTRA_NORMAL_MAX_OFFSET]++;
+	}
+
+	/* Target and measured moments */
+	for (o = st.first; o <= st.last; o++) {
+		double p = st.p[o + COGTRA_NORMAL_MAX_OFFSET];
+		double q = (double)st.count[o + COGTRA_NORMAL_MAX_OFFSET] / samples;
+
+		m1 += o * p;
+		g1 += o * q;
+	}
+	for (o = st.first; o <= st.last; o++) {
+		double p = st.p[o + COGTRA_NORMAL_MAX_OFFSET];
+		double q = (double)st.count[o + COGTRA_NORMAL_MAX_OFFSET] / samples;
+
+		m2 += (o - m1) * (o - m1) * p;
+		m4 += pow(o - m1, 4) * p;
+		g2 += (o - g1) * (o - g1) * q;
+	}
+	mean = g1;
+	var = g2;
+
+	/* Table error moves a cdf entry by up to NORMCHECK_EPS, which moves
+	 * the mean by that much per entry and the second moment by 2|o| + 1
+	 * times as much */
+	mvar = NORMCHECK_EPS * (st.last - st.first);
+	cvar = 0;
+	for (o = st.first; o < st.last; o++)
+		cvar += NORMCHECK_EPS * (2 * abs(o) + 1);
+
+	for (o = st.first; o <= st.last; o++) {
+		double p = st.p[o + COGTRA_NORMAL_MAX_OFFSET];
+		double q = (double)st.count[o + COGTRA_NORMAL_MAX_OFFSET] / samples;
+		char what[16];
+
+		snprintf(what, sizeof(what), "P(%+d)", o);
+		normcheck_expect(what, stdev, c, q, p, sqrt(p * (1 - p)),
+				 NORMCHECK_EPS, samples);
+	}
+	normcheck_expect("mean", stdev, c, mean, m1, sqrt(m2), mvar, samples);
+	normcheck_expect("variance", stdev, c, var, m2,
+			 sqrt(fmax(m4 - m2 * m2, 0)), cvar + 2 * m1 * mvar,
+			 samples);
+
+	/* Mass of each tail beyond 2 and 3 stdevs */
+	for (k = 2; k <= 3; k++) {
+		int edge = (int)ceil(k * s - 0.5);
+		double pl = 0, pr = 0;
+		unsigned long cl = 0, cr = 0;
+		char what[16];
+
+		if (edge < 1 || edge > COGTRA_NORMAL_MAX_OFFSET)
+			continue;
+		for (o = st.first; o <= -edge; o++) {
+			pl += st.p[o + COGTRA_NORMAL_MAX_OFFSET];
+			cl += st.count[o + COGTRA_NORMAL_MAX_OFFSET];
+		}
+		for (o = edge; o <= st.last; o++) {
+			pr += st.p[o + COGTRA_NORMAL_MAX_OFFSET];
+			cr += st.count[o + COGTRA_NORMAL_MAX_OFFSET];
+		}
+		snprintf(what, sizeof(what), "P(<=-%d)", edge);
+		normcheck_expect(what, stdev, c, (double)cl / samples, pl,
+				 sqrt(pl * (1 - pl)), 2 * NORMCHECK_EPS, samples);
+		snprintf(what, sizeof(what), "P(>=%d)", edge);
+		normcheck_expect(what, stdev, c, (double)cr / samples, pr,
+				 sqrt(pr * (1 - pr)), 2 * NORMCHECK_EPS, samples);
+	}
+
+	if (normcheck_verbose || c == &normcheck_cases[0])
+		printf("%5d.%02d %-8s %9.4f %9.4f %9.4f %9.4f %9.4f\n",
+		       stdev / 100, stdev % 100, c->name, mean, m1, sqrt(var),
+		       sqrt(m2), s);
+}
+
+static void
+usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [options]\n"
+		"  -n samples    draws per stdev and case (default 2000000)\n"
+		"  -s stdev      only this stdev (times 100); by default 1 to %d\n"
+		"                in steps of -d\n"
+		"  -d step       stdev step (default 7)\n"
+		"  -S seed       seed of the station's random source, 0 for\n"
+		"                get_random_bytes (default 1)\n"
+		"  -v            print every case, not only the centred one\n",
+		prog, COGTRA_NORMAL_MAX_STDEV);
+}
+
+int
+main(int argc, char **argv)
+{
+	static const u8 addr[6] = { 0x02, 0, 0, 0, 0, 1 };
+	unsigned long samples = 2000000;
+	int stdev = 0, step = 7, c, s;
+	u32 seed = 1;
+	struct rc_rand rr;
+	unsigned int i;
+
+	while ((c = getopt(argc, argv, "n:s:d:S:vh")) != -1) {
+		switch (c) {
+		case 'n':
+			samples = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			stdev = atoi(optarg);
+			break;
+		case 'd':
+			step = atoi(optarg);
+			break;
+		case 'S':
+			seed = strtoul(optarg, NULL, 0);
+			break;
+		case 'v':
+			normcheck_verbose = 1;
+			break;
+		default:
+			usage(argv[0]);
+			return c == 'h' ? 0 : 1;
+		}
+	}
+	if (!samples || step < 1 || stdev < 0 ||
+	    stdev > COGTRA_NORMAL_MAX_STDEV) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	shim_seed(seed);
+	rc_rand_seed(&rr, seed, addr);
+
+	printf("# %lu draws per case, seed %u; offsets are the normal curve "
+	       "rounded to integers,\n# so their stdev is about "
+	       "sqrt(stdev^2 + 1/12) until truncation\n", samples, seed);
+	printf("%8s %-8s %9s %9s %9s %9s %9s\n", "stdev", "case", "offset",
+	       "target", "sd", "target", "curve sd");
+
+	for (s = stdev ? stdev : 1; s <= (stdev ? stdev : COGTRA_NORMAL_MAX_STDEV);
+	     s = s < COGTRA_NORMAL_MAX_STDEV ?
+		 min(s + step, COGTRA_NORMAL_MAX_STDEV) : s + 1) {
+		for (i = 0; i < ARRAY_SIZE(normcheck_cases); i++) {
+			normcheck_run(&rr, s, &normcheck_cases[i], samples);
+		}
+	}
+
+	if (normcheck_fails) {
+		printf("%lu checks failed\n", normcheck_fails);
+		return 1;
+	}
+	printf("all checks passed\n");
+	return 0;
+}
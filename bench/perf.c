@@ -0,0 +1,59 @@
+/*
+ * Hardware event counters for the benchmarks, through perf_event_open.
+ * Built without the kernel stand-ins in include/, whose linux/types.h
+ * would clash with the real uapi headers.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "perf.h"
+
+/*
+ * Cache misses of this thread in user space, which perf_event_paranoid 2
+ * still allows. Returns -1 without a PMU or permission.
+ */
+int
+bench_perf_open(void)
+{
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.config = PERF_COUNT_HW_CACHE_MISSES;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	return syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+void
+bench_perf_start(int fd)
+{
+	ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+	ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+}
+
+unsigned long long
+bench_perf_stop(int fd)
+{
+	unsigned long long val;
+
+	ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+	if (read(fd, &val, sizeof(val)) != sizeof(val))
+		return 0;
+	return val;
+}
+
+void
+bench_perf_close(int fd)
+{
+	close(fd);
+}
@@ -0,0 +1,17 @@
+/*
+ * Hardware event counters for the benchmarks, see perf.c.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#ifndef __BENCH_PERF_H
+#define __BENCH_PERF_H
+
+int bench_perf_open(void);
+void bench_perf_start(int fd);
+unsigned long long bench_perf_stop(int fd);
+void bench_perf_close(int fd);
+
+#endif
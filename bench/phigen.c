@@ -0,0 +1,39 @@
+/*
+ * phigen - print the standard normal cdf table of rc80211_cogtra_normal.c
+ *
+ * The entries are Phi (i / PHI_RES) in units of 1 / COGTRA_NORMAL_SCALE,
+ * rounded to the nearest unit, from erfc in double precision. make check
+ * compares the output with the committed table; after changing the
+ * resolution, paste the output over the table.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <math.h>
+#include <stdio.h>
+
+/* Same as COGTRA_NORMAL_PHI_RES, COGTRA_NORMAL_PHI_MAX and
+ * COGTRA_NORMAL_SCALE */
+#define PHI_RES		64
+#define PHI_MAX		5
+#define PHI_SCALE	(1 << 15)
+
+int
+main(void)
+{
+	int i, n = PHI_MAX * PHI_RES + 1;
+
+	printf("static const u16 cogtra_normal_phi[COGTRA_NORMAL_PHI_MAX * "
+	       "COGTRA_NORMAL_PHI_RES + 1] = {\n");
+	for (i = 0; i < n; i++) {
+		double x = (double)i / PHI_RES;
+		long v = lround(PHI_SCALE * 0.5 * erfc(-x / sqrt(2)));
+
+		printf("%s%ld%s", i % 10 ? " " : "\t", v,
+		       i == n - 1 ? "\n" : i % 10 == 9 ? ",\n" : ",");
+	}
+	printf("};\n");
+	return 0;
+}
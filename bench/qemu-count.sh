@@ -0,0 +1,94 @@
+#!/bin/sh
+#
+# Instructions per callback on the router's CPU, from the MIPS build of
+# rcbench (make mips) run under qemu-user with the insn counting plugin.
+#
+# qemu only counts whole runs, so each callback is told apart by running
+# rcbench again with more of that work per frame and taking differences:
+#
+#   frame       -n 2N against -n N (get_rate + retry chain + tx_status)
+#   get_rate    one more get_rate per frame (-G 1)
+#   xmit        one more retry chain emulation per frame (-X 1), the
+#               harness' own share of a frame
+#   tx_status   frame - get_rate - xmit
+#   upd_stats   extra per frame when every frame crosses the statistics
+#               interval in time (-u); "-" for algorithms that count the
+#               interval in packets (cogtra, cogtra_ht), where tx_status
+#               carries it instead
+#   rate_init   -i 2I against -i I
+#
+# usage: qemu-count.sh [-n frames] [-i inits] [-a alg,alg] [rcbench options]
+#
+#   QEMU         qemu-user binary (default qemu-mips)
+#   QEMU_PLUGIN  path to libinsn.so from qemu's tests/plugin
+#   RCBENCH      MIPS rcbench (default mips-linux-gnu/rcbench)
+#
+# Not run for real yet: it was only tried against a stub qemu, and the
+# MIPS build it needs only against make -n.
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License version 2 as
+# published by the Free Software Foundation.
+#
+
+QEMU=${QEMU:-qemu-mips}
+RCBENCH=${RCBENCH:-$(dirname "$0")/mips-linux-gnu/rcbench}
+N=20000
+I=2000
+ALGS="cogtra cogtra_ht cora arf aarf minstrel minstrel_ht pid"
+
+while getopts "n:i:a:" opt; do
+	case $opt in
+	n) N=$OPTARG ;;
+	i) I=$OPTARG ;;
+	a) ALGS=$(echo "$OPTARG" | tr , ' ') ;;
+	*) sed -n '/^# usage/,/^$/p' "$0" >&2; exit 1 ;;
+	esac
+done
+shift $((OPTIND - 1))
+
+if [ -z "$QEMU_PLUGIN" ] || [ ! -f "$QEMU_PLUGIN" ]; then
+	echo "set QEMU_PLUGIN to qemu's libinsn.so" >&2
+	exit 1
+fi
+if [ ! -x "$RCBENCH" ]; then
+	echo "$RCBENCH not found, run make mips first" >&2
+	exit 1
+fi
+
+# Guest instructions of one rcbench run
+count()
+{
+	"$QEMU" -plugin "$QEMU_PLUGIN" -d plugin "$RCBENCH" "$@" 2>&1 \
+		>/dev/null | awk '/insns:/ { n = $NF } END { print n + 0 }'
+}
+
+printf "# %s, %d frames, %d rate_init, instructions per call\n" \
+	"$($QEMU -version | head -n 1)" "$N" "$I"
+printf "%-12s %10s %10s %10s %10s %10s %10s\n" algorithm frame get_rate \
+	tx_status upd_stats rate_init xmit
+
+for alg in $ALGS; do
+	base=$(count -a "$alg" -n "$N" -i "$I" "$@")
+	frames2=$(count -a "$alg" -n $((2 * N)) -i "$I" "$@")
+	getrate=$(count -a "$alg" -n "$N" -i "$I" -G 1 "$@")
+	xmit=$(count -a "$alg" -n "$N" -i "$I" -X 1 "$@")
+	inits2=$(count -a "$alg" -n "$N" -i $((2 * I)) "$@")
+	upd=$(count -a "$alg" -n "$N" -i "$I" -u 1000 "$@")
+
+	awk -v alg="$alg" -v n="$N" -v i="$I" -v base="$base" \
+	    -v frames2="$frames2" -v getrate="$getrate" -v xmit="$xmit" \
+	    -v inits2="$inits2" -v upd="$upd" 'BEGIN {
+		frame = (frames2 - base) / n
+		g = (getrate - base) / n
+		x = (xmit - base) / n
+		u = (upd - base) / n
+		printf "%-12s %10.0f %10.0f %10.0f ", alg, frame, g,
+			frame - g - x
+		if (alg ~ /^cogtra/ || u < 1)
+			printf "%10s ", "-"
+		else
+			printf "%10.0f ", u
+		printf "%10.0f %10.0f\n", (inits2 - base) / i, x
+	}'
+done
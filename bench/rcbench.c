@@ -0,0 +1,428 @@
+/*
+ * rcbench - per-call cost of the rate control modules on the host
+ *
+ * Every registered algorithm gets a fresh phy and a set of stations, then
+ * a stream of data frames goes through get_rate, the emulated ath9k
+ * retry chain and tx_status, all through the module's rate_control_ops.
+ * Each call is timed on its own; tasklets the modules schedule run after
+ * the call that queued them and are timed separately.
+ *
+ * -G, -X and -u add untimed work to every frame, so that instruction
+ * counts of whole runs (qemu-count.sh) can be told apart per callback.
+ *
+ * -x replaces the channel with adversarial but legal status reports, for
+ * the worst case of each call rather than its average: every frame uses
+ * all four stages with the most tries the hardware allows, every fourth
+ * one ends on a rate the station does not support (rix_to_ndx() gives -1),
+ * aggregates report 64 subframes, and a second of virtual time passes per
+ * frame so that every statistics interval expires on every frame. On a
+ * 40 MHz phy, every 256th frame switches the channel between HT40 and HT20
+ * through rate_update, so that the stations are set up again under traffic.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <getopt.h>
+#include <linux/slab.h>
+#include "bench.h"
+
+struct rcbench_opts {
+	const char *algs;
+	unsigned long frames;
+	int stations;
+	int inits;
+	int extra_get_rate;		// untimed get_rate calls per frame
+	int extra_xmit;			// untimed retry chain emulations per frame
+	u64 extra_us;			// virtual time added per frame
+	int stress;			// adversarial status reports, see above
+	double snr;
+	u64 seed;
+	struct bench_phy_cfg cfg;
+	const char *dump[8];
+	int n_dump;
+};
+
+struct rcbench_result {
+	struct bench_lat get_rate;
+	struct bench_lat tx_status;
+	struct bench_lat rate_init;
+	struct bench_lat rate_update;
+	struct bench_lat tasklet;
+	unsigned long acked;
+	unsigned long attempts;
+	unsigned long invalid;
+	u64 airtime;
+};
+
+/* Stress mode: 4 x 38 tries cross the 150 attempts of cogtra's update
+ * interval on every frame, the other algorithms count time */
+#define RCBENCH_STRESS_TRIES	38
+#define RCBENCH_STRESS_AMPDU	64
+#define RCBENCH_STRESS_US	1000000
+#define RCBENCH_STRESS_UPDATE	256
+
+/* Stations of the stress mode lack the lowest b/g rate and, with more
+ * than one stream, the MCS of the last one; the phy has both */
+static void
+rcbench_stress_sta(struct bench_phy *phy, struct bench_sta *sta)
+{
+	struct ieee80211_sta *s = &sta->si.sta;
+
+	s->supp_rates[IEEE80211_BAND_2GHZ] &= ~BIT(0);
+	if (s->ht_cap.ht_supported && phy->cfg.streams > 1)
+		s->ht_cap.mcs.rx_mask[phy->cfg.streams - 1] = 0;
+}
+
+/* The status the hardware could report in the worst case for the rates
+ * get_rate chose: every stage tried to the limit, acked on the very last
+ * try of odd frames */
+static void
+rcbench_stress_status(struct bench_phy *phy, struct bench_frame *f,
+		      unsigned long i)
+{
+	struct ieee80211_tx_info *info = bench_frame_info(f);
+	struct ieee80211_tx_rate *r = info->status.rates;
+	int j;
+
+	for (j = 0; j < IEEE80211_TX_MAX_RATES; j++) {
+		if (j && r[j].idx < 0)
+			r[j] = r[j - 1];
+		if (r[j].idx < 0)
+			r[j].idx = 0;
+		r[j].count = phy->local.hw.max_rate_tries;
+	}
+
+	/* A rate the station has not got, as after a rate_update that dropped
+	 * it while the frame was queued */
+	if (i % 4 == 3) {
+		r = &info->status.rates[IEEE80211_TX_MAX_RATES - 1];
+		if (!(r->flags & IEEE80211_TX_RC_MCS))
+			r->idx = 0;
+		else if (phy->cfg.streams > 1)
+			r->idx = (phy->cfg.streams - 1) * MCS_GROUP_RATES;
+	}
+
+	if (i & 1)
+		info->flags |= IEEE80211_TX_STAT_ACK;
+	if (!(info->flags & IEEE80211_TX_CTL_AMPDU))
+		return;
+	info->flags |= IEEE80211_TX_STAT_AMPDU;
+	info->status.ampdu_len = RCBENCH_STRESS_AMPDU;
+	info->status.ampdu_ack_len = i & 1 ? RCBENCH_STRESS_AMPDU : 0;
+}
+
+static void
+rcbench_dump(struct bench_phy *phy, struct bench_sta *sta, const char *name)
+{
+	static char buf[1 << 20];
+	struct dentry *d;
+	ssize_t len;
+
+	d = shim_debugfs_lookup(sta->dir, name);
+	if (!d)
+		d = shim_debugfs_lookup(phy->rc_dir, name);
+	if (!d) {
+		printf("%s: no debugfs file %s\n", phy->ops->name, name);
+		return;
+	}
+	len = shim_debugfs_read(d, buf, sizeof(buf));
+	if (len < 0) {
+		printf("%s: reading %s failed: %zd\n", phy->ops->name, name, len);
+		return;
+	}
+	printf("---- %s %s\n%s", phy->ops->name, name, buf);
+}
+
+static int
+rcbench_run(struct rate_control_ops *ops, const struct rcbench_opts *o,
+	    const struct bench_chan *chan, struct rcbench_result *res)
+{
+	struct bench_phy phy;
+	struct bench_sta *stas;
+	struct bench_frame f, scratch;
+	struct bench_tx tx;
+	unsigned long i;
+	u64 t0, t1;
+	int j, tid, err;
+
+	stas = calloc(o->stations, sizeof(*stas));
+	if (!stas)
+		return -ENOMEM;
+
+	shim_seed(o->seed);
+	bench_seed(o->seed);
+	bench_now_us = 0;
+	bench_advance(0);
+
+	err = bench_phy_init(&phy, &o->cfg, 0);
+	if (o->stress)
+		phy.local.hw.max_rate_tries = RCBENCH_STRESS_TRIES;
+	if (!err)
+		err = bench_phy_start(&phy, ops);
+	if (err)
+		goto out;
+
+	for (j = 0; j < o->stations; j++) {
+		bench_sta_init(&phy, &stas[j], j, 1);
+		if (o->stress)
+			rcbench_stress_sta(&phy, &stas[j]);
+		err = bench_sta_add(&phy, &stas[j], GFP_ATOMIC);
+		if (err)
+			goto out_sta;
+	}
+
+	for (j = 0; j < o->inits; j++) {
+		t0 = shim_cycles();
+		ops->rate_init(phy.priv, &phy.sband, &stas[0].si.sta,
+			       stas[0].priv_sta);
+		t1 = shim_cycles();
+		bench_lat_add(&res->rate_init, t0, t1);
+	}
+
+	for (i = 0; i < o->frames; i++) {
+		struct bench_sta *sta = &stas[i % o->stations];
+
+		bench_frame_init(&phy, sta, &f, IEEE80211_AC_BE);
+		bench_frame_reset(&f);
+
+		/* mac80211 aggregates once a block ack session is up */
+		tid = *ieee80211_get_qos_ctl((struct ieee80211_hdr *)f.data) & 7;
+		if (o->stress && sta->si.ampdu_mlme.tid_tx[tid])
+			bench_frame_info(&f)->flags |= IEEE80211_TX_CTL_AMPDU;
+
+		t0 = shim_cycles();
+		bench_get_rate(&phy, sta, &f);
+		t1 = shim_cycles();
+		bench_lat_add(&res->get_rate, t0, t1);
+
+		for (j = 0; j < o->extra_get_rate; j++) {
+			bench_frame_init(&phy, sta, &scratch, IEEE80211_AC_BE);
+			bench_frame_reset(&scratch);
+			bench_get_rate(&phy, sta, &scratch);
+		}
+		for (j = 0; j < o->extra_xmit; j++) {
+			scratch = f;
+			bench_xmit(&phy, chan, &scratch, 1, &tx);
+		}
+
+		if (o->stress && o->cfg.ht40 && ops->rate_update &&
+		    i % RCBENCH_STRESS_UPDATE == RCBENCH_STRESS_UPDATE - 1) {
+			t0 = shim_cycles();
+			ops->rate_update(phy.priv, &phy.sband, &sta->si.sta,
+					 sta->priv_sta, 0,
+					 i / RCBENCH_STRESS_UPDATE & 1 ?
+					 NL80211_CHAN_HT40PLUS : NL80211_CHAN_HT20);
+			t1 = shim_cycles();
+			bench_lat_add(&res->rate_update, t0, t1);
+		}
+
+		if (o->stress) {
+			rcbench_stress_status(&phy, &f, i);
+			bench_advance(RCBENCH_STRESS_US + o->extra_us);
+		} else {
+			bench_xmit(&phy, chan, &f, 1, &tx);
+			res->acked += tx.acked;
+			res->attempts += tx.attempts;
+			res->invalid += tx.invalid;
+			res->airtime += tx.airtime;
+			bench_advance(tx.airtime + o->extra_us);
+		}
+
+		t0 = shim_cycles();
+		bench_tx_status(&phy, sta, &f);
+		t1 = shim_cycles();
+		bench_lat_add(&res->tx_status, t0, t1);
+
+		while (shim_tasklets_pending()) {
+			t0 = shim_cycles();
+			shim_run_tasklets();
+			t1 = shim_cycles();
+			bench_lat_add(&res->tasklet, t0, t1);
+		}
+	}
+
+	for (j = 0; j < o->n_dump; j++)
+		rcbench_dump(&phy, &stas[0], o->dump[j]);
+
+out_sta:
+	for (j = 0; j < o->stations; j++)
+		bench_sta_remove(&phy, &stas[j]);
+	bench_phy_stop(&phy);
+out:
+	bench_phy_free(&phy);
+	free(stas);
+	return err;
+}
+
+static void
+rcbench_report(const char *name, const struct rcbench_result *res,
+	       unsigned long frames, int stress)
+{
+	bench_lat_print(stdout, name, "get_rate", &res->get_rate);
+	bench_lat_print(stdout, name, "tx_status", &res->tx_status);
+	bench_lat_print(stdout, name, "rate_init", &res->rate_init);
+	if (res->rate_update.calls)
+		bench_lat_print(stdout, name, "rate_update", &res->rate_update);
+	if (res->tasklet.calls)
+		bench_lat_print(stdout, name, "tasklet", &res->tasklet);
+	if (!frames || stress)
+		return;
+	printf("%-12s delivered %.1f%%, %.2f attempts/frame, %.1f Mbit/s on air",
+	       name, 100.0 * res->acked / frames,
+	       (double)res->attempts / frames,
+	       res->airtime ? 8.0 * BENCH_FRAME_PAYLOAD * res->acked /
+			      res->airtime : 0.0);
+	if (res->invalid)
+		printf(", %lu attempts on invalid rates", res->invalid);
+	printf("\n");
+}
+
+static void
+usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [options]\n"
+		"  -a alg[,alg]  algorithms to run (default: all)\n"
+		"  -n frames     frames per algorithm (default 200000, 0 for none)\n"
+		"  -s stations   associated stations, served in turn (default 1)\n"
+		"  -i count      rate_init calls to time (default 10000)\n"
+		"  -G count      extra untimed get_rate calls per frame\n"
+		"  -X count      extra untimed retry chain emulations per frame\n"
+		"  -u ms         extra virtual time per frame, so that the\n"
+		"                statistics update runs on every frame\n"
+		"  -x            stress: worst case status reports instead of\n"
+		"                the channel (see the top of rcbench.c)\n"
+		"  -q snr        channel SNR in dB (default 18)\n"
+		"  -m streams    HT spatial streams (default 2)\n"
+		"  -w            40 MHz channel\n"
+		"  -g            short guard interval\n"
+		"  -l            legacy (non-HT) phy and stations\n"
+		"  -S seed       seed for the channel and the modules (default 1)\n"
+		"  -d file       print a debugfs file of the first station\n"
+		"  -v            show the modules' printk output\n",
+		prog);
+}
+
+int
+main(int argc, char **argv)
+{
+	struct rcbench_opts o = {
+		.frames = 200000,
+		.stations = 1,
+		.inits = 10000,
+		.snr = 18.0,
+		.seed = 1,
+		.cfg = { .ht = 1, .streams = 2 },
+	};
+	struct rcbench_result *res;
+	struct rate_control_ops *ops;
+	struct bench_chan chan;
+	int c;
+
+	while ((c = getopt(argc, argv, "a:n:s:i:G:X:u:xq:m:wglS:d:vh")) != -1) {
+		switch (c) {
+		case 'a':
+			o.algs = optarg;
+			break;
+		case 'n':
+			o.frames = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			o.stations = atoi(optarg);
+			break;
+		case 'i':
+			o.inits = atoi(optarg);
+			break;
+		case 'G':
+			o.extra_get_rate = atoi(optarg);
+			break;
+		case 'X':
+			o.extra_xmit = atoi(optarg);
+			break;
+		case 'u':
+			o.extra_us = (u64)(atof(optarg) * 1000);
+			break;
+		case 'x':
+			o.stress = 1;
+			break;
+		case 'q':
+			o.snr = atof(optarg);
+			break;
+		case 'm':
+			o.cfg.streams = atoi(optarg);
+			break;
+		case 'w':
+			o.cfg.ht40 = 1;
+			break;
+		case 'g':
+			o.cfg.sgi = 1;
+			break;
+		case 'l':
+			o.cfg.ht = 0;
+			break;
+		case 'S':
+			o.seed = strtoull(optarg, NULL, 0);
+			break;
+		case 'd':
+			if (o.n_dump < (int)ARRAY_SIZE(o.dump))
+				o.dump[o.n_dump++] = optarg;
+			break;
+		case 'v':
+			shim_verbose = 1;
+			break;
+		default:
+			usage(argv[0]);
+			return c == 'h' ? 0 : 1;
+		}
+	}
+	if (o.stations < 1 || o.extra_get_rate < 0 || o.extra_xmit < 0) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	bench_clock_init();
+	bench_chan_snr(&chan, o.snr);
+	bench_init_all();
+
+	printf("# %lu frames, %d station(s), ", o.frames, o.stations);
+	if (o.stress)
+		printf("stress status reports, ");
+	else
+		printf("SNR %.1f dB, ", o.snr);
+	printf("%s, seed %llu",
+	       !o.cfg.ht ? "legacy" : o.cfg.ht40 ? "HT40" : "HT20",
+	       (unsigned long long)o.seed);
+	if (o.cfg.ht)
+		printf(", %d stream(s)%s", o.cfg.streams, o.cfg.sgi ? " SGI" : "");
+	if (SHIM_HAVE_CYCLES)
+		printf(", %.3f GHz counter", 1.0 / bench_ns_per_cycle);
+	printf("\n");
+
+	res = malloc(sizeof(*res));
+	if (!res)
+		return 1;
+
+	bench_lat_header(stdout);
+
+	for (ops = shim_rate_control_next(NULL); ops;
+	     ops = shim_rate_control_next(ops)) {
+		if (!bench_selected(o.algs, ops->name))
+			continue;
+
+		memset(res, 0, sizeof(*res));
+		if (rcbench_run(ops, &o, &chan, res)) {
+			printf("%s: setup failed\n", ops->name);
+			continue;
+		}
+		rcbench_report(ops->name, res, o.frames, o.stress);
+	}
+
+	bench_exit_all();
+	free(res);
+
+	if (shim_warnings)
+		printf("# %lu kernel warnings\n", shim_warnings);
+	return 0;
+}
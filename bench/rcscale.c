@@ -0,0 +1,285 @@
+/*
+ * rcscale - how the rate control modules scale with the number of stations
+ *
+ * For each algorithm and each station count (powers of two up to -N), a
+ * fresh phy gets that many associated stations, then every station is
+ * served in turn through get_rate, the emulated ath9k retry chain and
+ * tx_status. Reported per station count: slab memory taken by the module
+ * (the shim's accounting, and the module's own sta_memory when it has one),
+ * CPU time per packet in get_rate + tx_status, and cache misses per packet
+ * when the kernel lets us count them.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <getopt.h>
+#include <linux/slab.h>
+#include "bench.h"
+#include "perf.h"
+
+struct rcscale_opts {
+	const char *algs;
+	int max_stations;
+	int frames;			// per station
+	double snr;
+	u64 seed;
+	struct bench_phy_cfg cfg;
+};
+
+struct rcscale_result {
+	size_t mem;			// slab bytes held by the module for the stations
+	long sta_mem;			// the module's sta_memory, -1 if it has none
+	struct bench_lat pkt;		// get_rate + tx_status per packet
+	u64 misses;
+	int have_misses;
+	unsigned long tasklets;
+};
+
+static long
+rcscale_sta_mem(struct bench_phy *phy)
+{
+	struct dentry *d;
+	char buf[32];
+
+	d = shim_debugfs_lookup(phy->rc_dir, "sta_memory");
+	if (!d || shim_debugfs_read(d, buf, sizeof(buf)) <= 0)
+		return -1;
+	return strtol(buf, NULL, 0);
+}
+
+static int
+rcscale_run(struct rate_control_ops *ops, const struct rcscale_opts *o,
+	    const struct bench_chan *chan, int n_sta, int perf_fd,
+	    struct rcscale_result *res)
+{
+	struct bench_phy phy;
+	struct bench_sta *stas;
+	struct bench_frame f;
+	struct bench_tx tx;
+	unsigned long i, frames;
+	size_t mem;
+	u64 t0, t1, t2, t3;
+	int j, err;
+
+	stas = calloc(n_sta, sizeof(*stas));
+	if (!stas)
+		return -ENOMEM;
+
+	shim_seed(o->seed);
+	bench_seed(o->seed);
+	bench_now_us = 0;
+	bench_advance(0);
+
+	err = bench_phy_init(&phy, &o->cfg, 0);
+	if (!err)
+		err = bench_phy_start(&phy, ops);
+	if (err)
+		goto out;
+
+	mem = shim_mem.bytes;
+	for (j = 0; j < n_sta; j++) {
+		bench_sta_init(&phy, &stas[j], j, 1);
+		err = bench_sta_add(&phy, &stas[j], GFP_ATOMIC);
+		if (err)
+			goto out_sta;
+	}
+	res->mem = shim_mem.bytes - mem;
+	res->sta_mem = rcscale_sta_mem(&phy);
+
+	/* One round to get every station past its first frames */
+	frames = (unsigned long)n_sta * o->frames;
+	for (i = 0; i < frames + n_sta; i++) {
+		struct bench_sta *sta = &stas[i % n_sta];
+
+		if (i == (unsigned long)n_sta && perf_fd >= 0)
+			bench_perf_start(perf_fd);
+
+		bench_frame_init(&phy, sta, &f, IEEE80211_AC_BE);
+		bench_frame_reset(&f);
+
+		t0 = shim_cycles();
+		bench_get_rate(&phy, sta, &f);
+		t1 = shim_cycles();
+
+		bench_xmit(&phy, chan, &f, 1, &tx);
+		bench_advance(tx.airtime);
+
+		t2 = shim_cycles();
+		bench_tx_status(&phy, sta, &f);
+		t3 = shim_cycles();
+
+		if (i >= (unsigned long)n_sta)
+			bench_lat_add(&res->pkt, t0, t0 + (t1 - t0) + (t3 - t2));
+
+		while (shim_tasklets_pending()) {
+			shim_run_tasklets();
+			res->tasklets++;
+		}
+	}
+
+	if (perf_fd >= 0) {
+		res->misses = bench_perf_stop(perf_fd);
+		res->have_misses = 1;
+	}
+
+out_sta:
+	for (j = 0; j < n_sta; j++)
+		bench_sta_remove(&phy, &stas[j]);
+	bench_phy_stop(&phy);
+out:
+	bench_phy_free(&phy);
+	free(stas);
+	return err;
+}
+
+static void
+rcscale_report(const char *name, int n_sta, const struct rcscale_result *res,
+	       unsigned long frames)
+{
+	double mean = res->pkt.calls ? (double)res->pkt.sum / res->pkt.calls : 0;
+
+	printf("%-12s %6d %10zu %8zu ", name, n_sta, res->mem, res->mem / n_sta);
+	if (res->sta_mem >= 0)
+		printf("%10ld ", res->sta_mem);
+	else
+		printf("%10s ", "-");
+	printf("%9.1f %9.0f %9.0f ", mean * bench_ns_per_cycle,
+	       bench_lat_pct(&res->pkt, 0.999) * bench_ns_per_cycle,
+	       res->pkt.max * bench_ns_per_cycle);
+	if (res->have_misses)
+		printf("%10.2f", (double)res->misses / frames);
+	else
+		printf("%10s", "n/a");
+	printf("\n");
+}
+
+static void
+usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [options]\n"
+		"  -a alg[,alg]  algorithms to run (default: all)\n"
+		"  -N stations   run 1, 2, 4... up to this many stations\n"
+		"                (default 2048)\n"
+		"  -n frames     measured frames per station (default 100)\n"
+		"  -q snr        channel SNR in dB (default 18)\n"
+		"  -m streams    HT spatial streams (default 2)\n"
+		"  -w            40 MHz channel\n"
+		"  -g            short guard interval\n"
+		"  -l            legacy (non-HT) phy and stations\n"
+		"  -S seed       seed for the channel and the modules (default 1)\n"
+		"  -v            show the modules' printk output\n",
+		prog);
+}
+
+int
+main(int argc, char **argv)
+{
+	struct rcscale_opts o = {
+		.max_stations = 2048,
+		.frames = 100,
+		.snr = 18.0,
+		.seed = 1,
+		.cfg = { .ht = 1, .streams = 2 },
+	};
+	struct rcscale_result *res;
+	struct rate_control_ops *ops;
+	struct bench_chan chan;
+	int c, n, perf_fd;
+
+	while ((c = getopt(argc, argv, "a:N:n:q:m:wglS:vh")) != -1) {
+		switch (c) {
+		case 'a':
+			o.algs = optarg;
+			break;
+		case 'N':
+			o.max_stations = atoi(optarg);
+			break;
+		case 'n':
+			o.frames = atoi(optarg);
+			break;
+		case 'q':
+			o.snr = atof(optarg);
+			break;
+		case 'm':
+			o.cfg.streams = atoi(optarg);
+			break;
+		case 'w':
+			o.cfg.ht40 = 1;
+			break;
+		case 'g':
+			o.cfg.sgi = 1;
+			break;
+		case 'l':
+			o.cfg.ht = 0;
+			break;
+		case 'S':
+			o.seed = strtoull(optarg, NULL, 0);
+			break;
+		case 'v':
+			shim_verbose = 1;
+			break;
+		default:
+			usage(argv[0]);
+			return c == 'h' ? 0 : 1;
+		}
+	}
+	if (o.max_stations < 1 || o.frames < 1) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	bench_clock_init();
+	bench_chan_snr(&chan, o.snr);
+	bench_init_all();
+
+	/* Counts the whole loop, so the harness' per-packet work (the same
+	 * for any number of stations) is in there too */
+	perf_fd = bench_perf_open();
+
+	printf("# up to %d stations, %d frames per station, SNR %.1f dB, %s, "
+	       "seed %llu", o.max_stations, o.frames, o.snr,
+	       !o.cfg.ht ? "legacy" : o.cfg.ht40 ? "HT40" : "HT20",
+	       (unsigned long long)o.seed);
+	if (o.cfg.ht)
+		printf(", %d stream(s)%s", o.cfg.streams, o.cfg.sgi ? " SGI" : "");
+	printf("\n# ns/pkt is get_rate + tx_status; misses/pkt %s\n",
+	       perf_fd >= 0 ? "counts the whole loop, harness included" :
+	       "needs perf_event_open (see perf_event_paranoid)");
+
+	res = malloc(sizeof(*res));
+	if (!res)
+		return 1;
+
+	printf("%-12s %6s %10s %8s %10s %9s %9s %9s %10s\n",
+	       "algorithm", "sta", "slab B", "B/sta", "sta_memory",
+	       "ns/pkt", "p99.9 ns", "max ns", "misses/pkt");
+
+	for (ops = shim_rate_control_next(NULL); ops;
+	     ops = shim_rate_control_next(ops)) {
+		if (!bench_selected(o.algs, ops->name))
+			continue;
+
+		for (n = 1; n <= o.max_stations; n <<= 1) {
+			memset(res, 0, sizeof(*res));
+			if (rcscale_run(ops, &o, &chan, n, perf_fd, res)) {
+				printf("%s: setup failed with %d stations\n",
+				       ops->name, n);
+				break;
+			}
+			rcscale_report(ops->name, n, res,
+				       (unsigned long)n * o.frames);
+		}
+	}
+
+	bench_exit_all();
+	free(res);
+	if (perf_fd >= 0)
+		bench_perf_close(perf_fd);
+
+	if (shim_warnings)
+		printf("# %lu kernel warnings\n", shim_warnings);
+	return 0;
+}
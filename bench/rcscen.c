@@ -0,0 +1,367 @@
+/*
+ * rcscen - synthetic channel scenarios for rcsim
+ *
+ * Writes a channel trace (see struct bench_trace in bench.h) built from an
+ * SNR model: a mean SNR, optionally falling off as the station walks away,
+ * with Rayleigh or Rician fading at a given Doppler spread. Two kinds of
+ * interference can be laid on top: a microwave oven pulling the SNR down
+ * for part of every mains cycle, and bursts of a hidden terminal whose
+ * frames collide with ours. SNR maps onto every legacy rate and every
+ * minstrel_mcs_groups entry with bench_chan_snr(). Collisions depend on
+ * how long each rate keeps the medium busy.
+ *
+ *   ./rcscen -p walk | ./rcsim -f -
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <getopt.h>
+#include <math.h>
+#include "bench.h"
+
+/* Sinusoids per quadrature of the fading generator */
+#define RCSCEN_FADING_PATHS	16
+
+struct rcscen_opts {
+	u64 duration_us;
+	u64 step_us;
+	double snr;			// dB, mean or at the start of a walk
+
+	double k;			// Rician K factor (linear), 0 Rayleigh, < 0 off
+	double doppler;			// Hz
+
+	double speed;			// m/s away from the AP, 0 static
+	double path_loss;		// path loss exponent
+	double distance;		// m at the start
+
+	double mains;			// Hz of the microwave oven, 0 off
+	double oven_ms;			// radiating part of each cycle
+	double oven_snr;		// dB the SNR falls to meanwhile
+
+	double bursts;			// hidden terminal bursts per second, 0 off
+	double burst_ms;		// mean burst length
+	double hidden_us;		// air time of each hidden frame
+	double gap_us;			// mean idle time between them
+
+	u64 seed;
+};
+
+struct rcscen_preset {
+	const char *name;
+	const char *help;
+	struct rcscen_opts o;
+};
+
+#define RCSCEN_BASE \
+	.duration_us = 10000000, .step_us = 2000, .snr = 25, .k = -1, \
+	.doppler = 10, \
+	.path_loss = 3, .distance = 5, .oven_ms = 10, .oven_snr = 5, \
+	.burst_ms = 300, .hidden_us = 1500, .gap_us = 1000, .seed = 1
+
+static const struct rcscen_preset rcscen_presets[] = {
+	{ "static", "fixed SNR",
+	  { RCSCEN_BASE } },
+	{ "rayleigh", "Rayleigh fading, 10 Hz Doppler (walking pace at 2.4 GHz)",
+	  { RCSCEN_BASE, .k = 0 } },
+	{ "rician", "Rician fading, K = 6, 10 Hz Doppler",
+	  { RCSCEN_BASE, .k = 6 } },
+	{ "walk", "walking away from 5 m at 1.4 m/s for 30 s, Rician fading",
+	  { RCSCEN_BASE, .duration_us = 30000000, .snr = 35, .speed = 1.4,
+	    .k = 6, .doppler = 11 } },
+	{ "microwave", "50 Hz oven down to 5 dB half of the time, slow fading",
+	  { RCSCEN_BASE, .step_us = 1000, .mains = 50, .k = 10, .doppler = 2 } },
+	{ "hidden", "one 300 ms hidden terminal burst per second",
+	  { RCSCEN_BASE, .bursts = 1 } },
+};
+
+/* Zheng and Xiao sum of sinusoids, one Rayleigh process per quadrature */
+struct rcscen_fading {
+	double alpha[RCSCEN_FADING_PATHS];
+	double phi[2][RCSCEN_FADING_PATHS];
+	double los_phase;
+};
+
+static void
+rcscen_fading_init(struct rcscen_fading *fd)
+{
+	double theta = 2 * M_PI * bench_rand_double() - M_PI;
+	int n;
+
+	for (n = 0; n < RCSCEN_FADING_PATHS; n++) {
+		fd->alpha[n] = (2 * M_PI * (n + 1) - M_PI + theta) /
+			       (4 * RCSCEN_FADING_PATHS);
+		fd->phi[0][n] = 2 * M_PI * bench_rand_double() - M_PI;
+		fd->phi[1][n] = 2 * M_PI * bench_rand_double() - M_PI;
+	}
+	fd->los_phase = 2 * M_PI * bench_rand_double();
+}
+
+/* Power gain |h|^2 at time t, 1 on average */
+static double
+rcscen_fading_gain(const struct rcscen_fading *fd, const struct rcscen_opts *o,
+		   double t)
+{
+	double w = 2 * M_PI * o->doppler * t;
+	double i = 0, q = 0, los;
+	int n;
+
+	for (n = 0; n < RCSCEN_FADING_PATHS; n++) {
+		i += cos(w * cos(fd->alpha[n]) + fd->phi[0][n]);
+		q += cos(w * sin(fd->alpha[n]) + fd->phi[1][n]);
+	}
+	i /= sqrt(RCSCEN_FADING_PATHS);
+	q /= sqrt(RCSCEN_FADING_PATHS);
+
+	/* The line of sight component arrives at a 45 degree angle */
+	los = sqrt(2 * o->k);
+	i += los * cos(w * M_SQRT1_2 + fd->los_phase);
+	q += los * sin(w * M_SQRT1_2 + fd->los_phase);
+
+	return (i * i + q * q) / (2 * (o->k + 1));
+}
+
+static double
+rcscen_rand_exp(double mean)
+{
+	return -mean * log(1.0 - bench_rand_double());
+}
+
+/*
+ * The hidden terminal sends Poisson arrivals of frames while a burst lasts.
+ * An attempt survives if none of them starts in the window where the two
+ * overlap, from one hidden frame before ours to the end of ours.
+ */
+static void
+rcscen_hidden(struct bench_phy *phy, struct bench_chan *chan,
+	      const struct rcscen_opts *o)
+{
+	struct ieee80211_tx_rate rate = { .count = 1 };
+	double mean = o->hidden_us + o->gap_us;
+	const struct mcs_group *g;
+	int i, j;
+
+	for (i = 0; i < BENCH_N_LEGACY; i++) {
+		rate.idx = i;
+		rate.flags = 0;
+		chan->legacy[i] *= exp(-(o->hidden_us +
+			bench_rate_airtime(phy, &rate, BENCH_FRAME_LEN)) / mean);
+	}
+
+	for (i = 0; i < BENCH_N_GROUPS; i++) {
+		g = &minstrel_mcs_groups[i];
+		for (j = 0; j < MCS_GROUP_RATES; j++) {
+			rate.idx = (g->streams - 1) * MCS_GROUP_RATES + j;
+			rate.flags = IEEE80211_TX_RC_MCS | g->flags;
+			chan->mcs[i][j] *= exp(-(o->hidden_us +
+				bench_rate_airtime(phy, &rate, BENCH_FRAME_LEN)) / mean);
+		}
+	}
+}
+
+static void
+rcscen_header(FILE *out, const char *preset, const struct rcscen_opts *o)
+{
+	fprintf(out, "# rcscen %s: %.1f s in %.1f ms steps, SNR %.1f dB, seed %llu\n",
+		preset ? preset : "custom", o->duration_us / 1e6, o->step_us / 1e3,
+		o->snr, (unsigned long long)o->seed);
+	if (o->k >= 0)
+		fprintf(out, "# %s fading, K %.1f, Doppler %.1f Hz\n",
+			o->k ? "Rician" : "Rayleigh", o->k, o->doppler);
+	if (o->speed)
+		fprintf(out, "# walking away from %.1f m at %.2f m/s, exponent %.1f\n",
+			o->distance, o->speed, o->path_loss);
+	if (o->mains)
+		fprintf(out, "# microwave oven at %.0f Hz, %.1f ms per cycle down to %.1f dB\n",
+			o->mains, o->oven_ms, o->oven_snr);
+	if (o->bursts)
+		fprintf(out, "# hidden terminal: %.2f bursts/s of %.0f ms, %.0f us frames, %.0f us gaps\n",
+			o->bursts, o->burst_ms, o->hidden_us, o->gap_us);
+}
+
+static void
+usage(const char *prog)
+{
+	unsigned int i;
+
+	fprintf(stderr,
+		"usage: %s [-p preset] [options]\n"
+		"  -p preset     start from a preset, other options override it\n"
+		"  -o file       output (default: standard output)\n"
+		"  -d ms         length of the trace (default 10000)\n"
+		"  -r ms         time step (default 2)\n"
+		"  -q snr        mean SNR in dB, or at the start of a walk (default 25)\n"
+		"  -K k          Rician K factor (linear); 0 is Rayleigh (default: no fading)\n"
+		"  -D hz         Doppler spread (default 10)\n"
+		"  -W m/s        walk away from the AP at this speed\n"
+		"  -P n          path loss exponent for -W (default 3)\n"
+		"  -R m          distance at the start of the walk (default 5)\n"
+		"  -M hz         microwave oven mains frequency (50 or 60)\n"
+		"  -O ms         oven radiating time per mains cycle (default 10)\n"
+		"  -L snr        SNR while the oven radiates (default 5)\n"
+		"  -H n          hidden terminal bursts per second\n"
+		"  -B ms         mean burst length (default 300)\n"
+		"  -T us         air time of each hidden terminal frame (default 1500)\n"
+		"  -G us         mean gap between hidden terminal frames (default 1000)\n"
+		"  -S seed       random seed (default 1)\n"
+		"presets:\n", prog);
+	for (i = 0; i < ARRAY_SIZE(rcscen_presets); i++)
+		fprintf(stderr, "  %-12s  %s\n", rcscen_presets[i].name,
+			rcscen_presets[i].help);
+}
+
+int
+main(int argc, char **argv)
+{
+	struct rcscen_opts o = rcscen_presets[0].o;
+	struct bench_phy_cfg cfg = { .ht = 1, .streams = MINSTREL_MAX_STREAMS,
+				     .ht40 = 1, .sgi = 1 };
+	struct bench_chan chan, last;
+	struct rcscen_fading fd;
+	struct bench_phy phy;
+	const char *preset = NULL;
+	FILE *out = stdout;
+	double t, snr, d, burst_end = -1, next_burst;
+	unsigned int i;
+	u64 us;
+	int c, first = 1;
+
+	/* The preset comes first, whatever its place on the command line */
+	while ((c = getopt(argc, argv, "p:o:d:r:q:K:D:W:P:R:M:O:L:H:B:T:G:S:h")) != -1) {
+		if (c != 'p')
+			continue;
+		for (i = 0; i < ARRAY_SIZE(rcscen_presets); i++)
+			if (!strcmp(optarg, rcscen_presets[i].name))
+				break;
+		if (i == ARRAY_SIZE(rcscen_presets)) {
+			fprintf(stderr, "unknown preset %s\n", optarg);
+			usage(argv[0]);
+			return 1;
+		}
+		o = rcscen_presets[i].o;
+		preset = rcscen_presets[i].name;
+	}
+
+	optind = 1;
+	while ((c = getopt(argc, argv, "p:o:d:r:q:K:D:W:P:R:M:O:L:H:B:T:G:S:h")) != -1) {
+		switch (c) {
+		case 'p':
+			break;
+		case 'o':
+			out = fopen(optarg, "w");
+			if (!out) {
+				perror(optarg);
+				return 1;
+			}
+			break;
+		case 'd':
+			o.duration_us = strtod(optarg, NULL) * 1000;
+			break;
+		case 'r':
+			o.step_us = strtod(optarg, NULL) * 1000;
+			break;
+		case 'q':
+			o.snr = atof(optarg);
+			break;
+		case 'K':
+			o.k = atof(optarg);
+			break;
+		case 'D':
+			o.doppler = atof(optarg);
+			break;
+		case 'W':
+			o.speed = atof(optarg);
+			break;
+		case 'P':
+			o.path_loss = atof(optarg);
+			break;
+		case 'R':
+			o.distance = atof(optarg);
+			break;
+		case 'M':
+			o.mains = atof(optarg);
+			break;
+		case 'O':
+			o.oven_ms = atof(optarg);
+			break;
+		case 'L':
+			o.oven_snr = atof(optarg);
+			break;
+		case 'H':
+			o.bursts = atof(optarg);
+			break;
+		case 'B':
+			o.burst_ms = atof(optarg);
+			break;
+		case 'T':
+			o.hidden_us = atof(optarg);
+			break;
+		case 'G':
+			o.gap_us = atof(optarg);
+			break;
+		case 'S':
+			o.seed = strtoull(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+			return c == 'h' ? 0 : 1;
+		}
+	}
+	if (!o.step_us || o.distance <= 0 || (o.k >= 0 && o.doppler <= 0) ||
+	    (o.bursts && (o.burst_ms <= 0 || o.hidden_us + o.gap_us <= 0))) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	/* A phy that can send every rate, for the air times */
+	if (bench_phy_init(&phy, &cfg, 0))
+		return 1;
+
+	bench_seed(o.seed);
+	memset(&fd, 0, sizeof(fd));
+	if (o.k >= 0)
+		rcscen_fading_init(&fd);
+	next_burst = o.bursts ? rcscen_rand_exp(1.0 / o.bursts) : -1;
+
+	rcscen_header(out, preset, &o);
+
+	for (us = 0; us < o.duration_us; us += o.step_us) {
+		t = us / 1e6;
+
+		snr = o.snr;
+		if (o.speed) {
+			d = o.distance + o.speed * t;
+			snr -= 10 * o.path_loss * log10(d / o.distance);
+		}
+		if (o.k >= 0)
+			snr += 10 * log10(max(rcscen_fading_gain(&fd, &o, t), 1e-6));
+		if (o.mains && fmod(t * 1000, 1000 / o.mains) < o.oven_ms)
+			snr = min(snr, o.oven_snr);
+
+		bench_chan_snr(&chan, snr);
+
+		if (o.bursts) {
+			while (next_burst >= 0 && next_burst <= t) {
+				burst_end = next_burst + rcscen_rand_exp(o.burst_ms / 1000);
+				next_burst += rcscen_rand_exp(1.0 / o.bursts);
+			}
+			if (t < burst_end)
+				rcscen_hidden(&phy, &chan, &o);
+		}
+
+		/* Samples only start where the channel changes */
+		if (!first && !memcmp(&chan, &last, sizeof(chan)))
+			continue;
+		bench_trace_write(out, us, &chan);
+		last = chan;
+		first = 0;
+	}
+
+	fprintf(out, "end %llu\n", (unsigned long long)(o.duration_us / 1000));
+
+	bench_phy_free(&phy);
+	if (out != stdout)
+		fclose(out);
+	return 0;
+}
@@ -0,0 +1,455 @@
+/*
+ * rcsim - replay a channel trace through every rate control module
+ *
+ * A saturated sender keeps the stations busy for the length of the trace.
+ * Each frame goes through the module's get_rate, the emulated ath9k retry
+ * chain on the channel in effect when it is sent, and tx_status, and the
+ * virtual clock advances by the air time it took. Every algorithm sees the
+ * same trace and the same channel random stream, so the runs differ only by
+ * the rates the modules pick.
+ *
+ * The yardstick is an oracle that knows the channel and always sends at the
+ * airtime-optimal rate. Over the same air time as the algorithm it would
+ * have delivered the oracle goodput; regret is the share of it lost. The
+ * oracle picks among every rate the phy supports for algorithms that send
+ * MCS rates, and among the legacy ones for the others. Time is also cut
+ * in windows of -I ms, for two more figures:
+ *  - convergence: after the oracle rate changes, the time until a window
+ *    reaches 90% of the oracle goodput;
+ *  - exploration: the share of frames whose first rate is not the one that
+ *    delivered most frames in the previous window.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <getopt.h>
+#include "bench.h"
+
+struct rcsim_opts {
+	const char *algs;
+	const char *trace;
+	u64 duration_us;
+	int stations;
+	int ampdu;
+	int rates;
+	u64 window_us;
+	double snr;
+	u64 seed;
+	struct bench_phy_cfg cfg;
+};
+
+/* Oracle comparison over one window; [0] all rates, [1] legacy only */
+struct rcsim_window {
+	double bits;			// delivered
+	double oracle[2];		// oracle bits over the same air time
+	unsigned long tx;		// get_rate calls
+	unsigned long explore;
+	u8 change[2];			// the oracle rate changed in this window
+};
+
+#define RCSIM_CONVERGED		90	// % of the oracle goodput
+
+struct rcsim_result {
+	unsigned long tx;		// get_rate calls
+	unsigned long frames;		// A-MPDU subframes count one each
+	unsigned long acked;
+	unsigned long attempts;
+	unsigned long invalid;
+	u64 airtime;
+	u64 elapsed;
+	u64 rate_airtime[BENCH_N_RATES];
+	unsigned long rate_attempts[BENCH_N_RATES];
+	int mcs;			// sent any MCS rate
+	struct rcsim_window *win;
+	int n_win;
+};
+
+static const struct bench_chan *
+rcsim_chan(struct bench_trace *tr, const struct bench_chan *fixed)
+{
+	return tr ? bench_trace_at(tr, bench_now_us) : fixed;
+}
+
+/* First rate the driver will try, as a rate key */
+static int
+rcsim_first_key(struct bench_phy *phy, struct bench_frame *f)
+{
+	struct ieee80211_tx_rate *ar = bench_frame_info(f)->control.rates;
+	int i;
+
+	for (i = 0; i < phy->local.hw.max_rates; i++)
+		if (ar[i].idx >= 0 && ar[i].count)
+			return bench_rate_key(phy, &ar[i]);
+	return -1;
+}
+
+static int
+rcsim_argmax(const unsigned long *v, int n)
+{
+	int i, best = -1;
+
+	for (i = 0; i < n; i++)
+		if (v[i] && (best < 0 || v[i] > v[best]))
+			best = i;
+	return best;
+}
+
+static int
+rcsim_run(struct rate_control_ops *ops, const struct rcsim_opts *o,
+	  struct bench_trace *tr, const struct bench_chan *fixed,
+	  struct rcsim_result *res)
+{
+	struct ieee80211_tx_info *info;
+	struct ieee80211_tx_rate *ar;
+	struct bench_phy phy;
+	struct bench_sta *stas, *sta;
+	struct bench_frame f;
+	struct bench_tx tx;
+	const struct bench_chan *chan;
+	unsigned long delivered[BENCH_N_RATES] = { 0 };
+	unsigned long i, gen = 0;
+	double oracle[2] = { 0, 0 };
+	int oracle_key[2] = { -1, -1 };
+	int j, v, w, cur_w = 0, exploit = -1, first, key, tid, err;
+
+	stas = calloc(o->stations, sizeof(*stas));
+	if (!stas)
+		return -ENOMEM;
+
+	shim_seed(o->seed);
+	bench_seed(o->seed);
+	bench_now_us = 0;
+	bench_advance(0);
+	if (tr) {
+		err = bench_trace_rewind(tr);
+		if (err)
+			goto out;
+	}
+
+	err = bench_phy_init(&phy, &o->cfg, 0);
+	if (!err)
+		err = bench_phy_start(&phy, ops);
+	if (err)
+		goto out;
+
+	for (j = 0; j < o->stations; j++) {
+		bench_sta_init(&phy, &stas[j], j, 1);
+		err = bench_sta_add(&phy, &stas[j], GFP_ATOMIC);
+		if (err)
+			goto out_sta;
+	}
+
+	for (i = 0; bench_now_us < o->duration_us; i++) {
+		sta = &stas[i % o->stations];
+
+		/* The oracle only changes with the channel */
+		chan = rcsim_chan(tr, fixed);
+		w = min_t(int, bench_now_us / o->window_us, res->n_win - 1);
+		if (!i || (tr && tr->gen != gen)) {
+			gen = tr ? tr->gen : 0;
+			for (v = 0; v < 2; v++) {
+				oracle[v] = bench_oracle(&phy, chan, o->ampdu, v, &key);
+				if (key != oracle_key[v])
+					res->win[w].change[v] = 1;
+				oracle_key[v] = key;
+			}
+		}
+
+		/* What the previous window exploited */
+		if (w != cur_w) {
+			exploit = rcsim_argmax(delivered, BENCH_N_RATES);
+			memset(delivered, 0, sizeof(delivered));
+			cur_w = w;
+		}
+
+		bench_frame_init(&phy, sta, &f, IEEE80211_AC_BE);
+		bench_frame_reset(&f);
+		info = bench_frame_info(&f);
+
+		/* mac80211 aggregates once a block ack session is up */
+		tid = *ieee80211_get_qos_ctl((struct ieee80211_hdr *)f.data) & 7;
+		if (o->ampdu > 1 && sta->si.ampdu_mlme.tid_tx[tid])
+			info->flags |= IEEE80211_TX_CTL_AMPDU;
+
+		bench_get_rate(&phy, sta, &f);
+		first = rcsim_first_key(&phy, &f);
+		bench_xmit(&phy, chan, &f, o->ampdu, &tx);
+
+		res->frames += info->flags & IEEE80211_TX_CTL_AMPDU ? o->ampdu : 1;
+		res->acked += tx.acked;
+		res->attempts += tx.attempts;
+		res->invalid += tx.invalid;
+		res->airtime += tx.airtime;
+		res->tx++;
+
+		res->win[w].tx++;
+		if (exploit >= 0 && first != exploit)
+			res->win[w].explore++;
+		res->win[w].bits += 8.0 * BENCH_FRAME_PAYLOAD * tx.acked;
+		for (v = 0; v < 2; v++)
+			res->win[w].oracle[v] += oracle[v] * tx.airtime;
+
+		/* The status keeps idx and flags of the series it reports */
+		ar = info->status.rates;
+		for (j = 0; j <= tx.last; j++) {
+			key = bench_rate_key(&phy, &ar[j]);
+			if (key < 0)
+				continue;
+			res->rate_airtime[key] += tx.series_airtime[j];
+			res->rate_attempts[key] += tx.series_attempts[j];
+			if (key >= BENCH_N_LEGACY)
+				res->mcs = 1;
+		}
+		key = bench_rate_key(&phy, &ar[tx.last]);
+		if (key >= 0)
+			delivered[key] += tx.acked;
+
+		bench_advance(tx.airtime);
+		bench_tx_status(&phy, sta, &f);
+		while (shim_tasklets_pending())
+			shim_run_tasklets();
+	}
+	res->elapsed = bench_now_us;
+
+out_sta:
+	for (j = 0; j < o->stations; j++)
+		bench_sta_remove(&phy, &stas[j]);
+	bench_phy_stop(&phy);
+out:
+	bench_phy_free(&phy);
+	free(stas);
+	return err;
+}
+
+static void
+rcsim_report(const char *name, const struct rcsim_result *res, u64 window_us)
+{
+	double frames = res->frames ? res->frames : 1;
+	double bits = 0, oracle = 0, conv_sum = 0;
+	unsigned long explore = 0, tx = 0;
+	int v = !res->mcs, w, start = -1, conv = 0, conv_max = 0, missed = 0;
+	const struct rcsim_window *win;
+
+	for (w = 0; w < res->n_win; w++) {
+		win = &res->win[w];
+		bits += win->bits;
+		oracle += win->oracle[v];
+		explore += win->explore;
+		tx += win->tx;
+
+		/* A change before the previous one converged restarts the clock */
+		if (win->change[v]) {
+			if (start >= 0)
+				missed++;
+			start = w;
+		}
+		if (start >= 0 && win->tx &&
+		    100 * win->bits >= RCSIM_CONVERGED * win->oracle[v]) {
+			conv_sum += w + 1 - start;
+			conv_max = max(conv_max, w + 1 - start);
+			conv++;
+			start = -1;
+		}
+	}
+	if (start >= 0)
+		missed++;
+
+	printf("%-12s %7.2f %7.2f %7.2f %7.2f %7.2f %7.2f %8lu %7.1f %7.1f %5d %7.2f\n",
+	       name,
+	       res->elapsed ? bits / res->elapsed : 0.0,
+	       res->elapsed ? oracle / res->elapsed : 0.0,
+	       oracle ? 100.0 * (1.0 - bits / oracle) : 0.0,
+	       100.0 * (res->frames - res->acked) / frames,
+	       res->attempts / frames,
+	       ((double)res->attempts - res->frames) / frames,
+	       res->invalid,
+	       conv ? conv_sum * window_us / conv / 1000 : 0.0,
+	       conv_max * window_us / 1000.0, missed,
+	       tx ? 100.0 * explore / tx : 0.0);
+}
+
+/* Share of the air time per rate, largest first, down to 1% */
+static void
+rcsim_report_rates(const char *name, const struct rcsim_result *res)
+{
+	int done[BENCH_N_RATES] = { 0 };
+	char buf[32];
+	int i, best;
+
+	printf("%-12s", name);
+	for (;;) {
+		best = -1;
+		for (i = 0; i < BENCH_N_RATES; i++)
+			if (!done[i] && (best < 0 ||
+			    res->rate_airtime[i] > res->rate_airtime[best]))
+				best = i;
+		if (best < 0 || !res->airtime ||
+		    100 * res->rate_airtime[best] < res->airtime)
+			break;
+		done[best] = 1;
+		printf(" %s %.1f%% (%lu)",
+		       bench_rate_name(best, buf, sizeof(buf)),
+		       100.0 * res->rate_airtime[best] / res->airtime,
+		       res->rate_attempts[best]);
+	}
+	printf("\n");
+}
+
+static void
+usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [options]\n"
+		"  -f trace      channel trace, - for standard input (default: fixed SNR)\n"
+		"  -t ms         simulated time (default: trace length, or 10 s)\n"
+		"  -q snr        SNR in dB without a trace (default 18)\n"
+		"  -a alg[,alg]  algorithms to run (default: all)\n"
+		"  -s stations   saturated stations, served in turn (default 1)\n"
+		"  -A n          A-MPDU subframes once a BA session is up (default 1)\n"
+		"  -m streams    HT spatial streams (default 2)\n"
+		"  -w            40 MHz channel\n"
+		"  -g            short guard interval\n"
+		"  -l            legacy (non-HT) phy and stations\n"
+		"  -S seed       seed for the channel and the modules (default 1)\n"
+		"  -I ms         oracle comparison window (default 100)\n"
+		"  -r            show the air time share of each rate\n"
+		"  -v            show the modules' printk output\n",
+		prog);
+}
+
+int
+main(int argc, char **argv)
+{
+	struct rcsim_opts o = {
+		.stations = 1,
+		.ampdu = 1,
+		.snr = 18.0,
+		.seed = 1,
+		.window_us = 100000,
+		.cfg = { .ht = 1, .streams = 2 },
+	};
+	struct rcsim_result *res;
+	struct rate_control_ops *ops;
+	struct bench_trace trace, *tr = NULL;
+	struct bench_chan fixed;
+	int c, err;
+
+	while ((c = getopt(argc, argv, "f:t:q:a:s:A:m:wglS:I:rvh")) != -1) {
+		switch (c) {
+		case 'f':
+			o.trace = optarg;
+			break;
+		case 't':
+			o.duration_us = strtoull(optarg, NULL, 0) * 1000;
+			break;
+		case 'q':
+			o.snr = atof(optarg);
+			break;
+		case 'a':
+			o.algs = optarg;
+			break;
+		case 's':
+			o.stations = atoi(optarg);
+			break;
+		case 'A':
+			o.ampdu = atoi(optarg);
+			break;
+		case 'm':
+			o.cfg.streams = atoi(optarg);
+			break;
+		case 'w':
+			o.cfg.ht40 = 1;
+			break;
+		case 'g':
+			o.cfg.sgi = 1;
+			break;
+		case 'l':
+			o.cfg.ht = 0;
+			break;
+		case 'S':
+			o.seed = strtoull(optarg, NULL, 0);
+			break;
+		case 'I':
+			o.window_us = strtoull(optarg, NULL, 0) * 1000;
+			break;
+		case 'r':
+			o.rates = 1;
+			break;
+		case 'v':
+			shim_verbose = 1;
+			break;
+		default:
+			usage(argv[0]);
+			return c == 'h' ? 0 : 1;
+		}
+	}
+	if (o.stations < 1 || o.ampdu < 1 || o.ampdu > 64 || !o.window_us) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (o.trace) {
+		err = bench_trace_open(&trace, o.trace);
+		if (err) {
+			fprintf(stderr, "%s: %s\n", o.trace, strerror(-err));
+			return 1;
+		}
+		tr = &trace;
+		if (!o.duration_us)
+			o.duration_us = tr->end_us;
+	} else {
+		bench_chan_snr(&fixed, o.snr);
+		if (!o.duration_us)
+			o.duration_us = 10000000;
+	}
+
+	bench_init_all();
+
+	printf("# %s, %.1f s, %d station(s), %s", o.trace ? o.trace : "fixed SNR",
+	       o.duration_us / 1e6, o.stations,
+	       !o.cfg.ht ? "legacy" : o.cfg.ht40 ? "HT40" : "HT20");
+	if (o.cfg.ht)
+		printf(", %d stream(s)%s", o.cfg.streams, o.cfg.sgi ? " SGI" : "");
+	if (o.ampdu > 1)
+		printf(", A-MPDU %d", o.ampdu);
+	printf(", seed %llu\n", (unsigned long long)o.seed);
+	printf("%-12s %7s %7s %7s %7s %7s %7s %8s %7s %7s %5s %7s\n", "algorithm",
+	       "Mbit/s", "oracle", "regret%", "loss%", "att/fr", "ret/fr",
+	       "invalid", "conv ms", "max ms", "unconv", "explr%");
+
+	res = calloc(1, sizeof(*res));
+	if (!res)
+		return 1;
+	res->n_win = o.duration_us / o.window_us + 1;
+	res->win = calloc(res->n_win, sizeof(*res->win));
+	if (!res->win)
+		return 1;
+
+	for (ops = shim_rate_control_next(NULL); ops;
+	     ops = shim_rate_control_next(ops)) {
+		if (!bench_selected(o.algs, ops->name))
+			continue;
+
+		memset(res, 0, offsetof(struct rcsim_result, win));
+		memset(res->win, 0, res->n_win * sizeof(*res->win));
+		if (rcsim_run(ops, &o, tr, &fixed, res)) {
+			printf("%s: setup failed\n", ops->name);
+			continue;
+		}
+		rcsim_report(ops->name, res, o.window_us);
+		if (o.rates)
+			rcsim_report_rates(ops->name, res);
+	}
+
+	bench_exit_all();
+	free(res->win);
+	free(res);
+	if (tr)
+		bench_trace_close(tr);
+
+	if (shim_warnings)
+		printf("# %lu kernel warnings\n", shim_warnings);
+	return 0;
+}
@@ -0,0 +1,403 @@
+/*
+ * rcstorm - association storms: hundreds of stations joining and leaving
+ * within a second, as on a stadium or lecture hall AP
+ *
+ * Each round, every station associates at a random time in the window and
+ * leaves after an exponentially distributed stay (stations still there at
+ * the end leave with it). Between events, associated stations get a few
+ * data frames, so stations leave with real state behind them. Association
+ * is alloc_sta with GFP_ATOMIC, the per-station debugfs files and
+ * rate_init, as mac80211 does it; each of alloc_sta, rate_init and
+ * free_sta is timed on its own. Allocations that cannot sleep are counted
+ * per page order, and -O/-P make the high-order ones fail the way they do
+ * on a fragmented router.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <getopt.h>
+#include <math.h>
+#include <linux/slab.h>
+#include "bench.h"
+
+struct rcstorm_opts {
+	const char *algs;
+	int stations;
+	int rounds;
+	double window_ms;
+	double stay_ms;			// mean stay of a station
+	int frames;			// data frames after each event
+	int kernel;			// GFP_KERNEL instead of GFP_ATOMIC
+	int fail_order;			// shim_fail_order during the storms
+	double fail_prob;
+	double snr;
+	u64 seed;
+	struct bench_phy_cfg cfg;
+};
+
+struct rcstorm_result {
+	struct bench_lat alloc_sta;
+	struct bench_lat rate_init;
+	struct bench_lat free_sta;
+	unsigned long assoc;
+	unsigned long failed;
+	int max_assoc;			// most stations associated at once
+	size_t peak;			// most slab bytes held at once
+	unsigned long atomic[SHIM_MAX_ORDER + 1];
+	unsigned long atomic_failed[SHIM_MAX_ORDER + 1];
+};
+
+struct rcstorm_event {
+	u64 us;
+	int sta;
+	int join;
+};
+
+static int
+rcstorm_event_cmp(const void *a, const void *b)
+{
+	const struct rcstorm_event *ea = a, *eb = b;
+
+	if (ea->us != eb->us)
+		return ea->us < eb->us ? -1 : 1;
+	/* A station leaving at the end of the window goes after the joins */
+	return ea->join > eb->join ? -1 : ea->join < eb->join;
+}
+
+/* One association storm: n_sta joins and as many leaves, in time order */
+static void
+rcstorm_events(const struct rcstorm_opts *o, struct rcstorm_event *ev)
+{
+	u64 window = (u64)(o->window_ms * 1000);
+	u64 join, stay;
+	int i;
+
+	for (i = 0; i < o->stations; i++) {
+		join = (u64)(bench_rand_double() * window);
+		stay = (u64)(-log(1.0 - bench_rand_double()) * o->stay_ms * 1000);
+		ev[2 * i].us = join;
+		ev[2 * i].sta = i;
+		ev[2 * i].join = 1;
+		ev[2 * i + 1].us = min_t(u64, join + stay, window);
+		ev[2 * i + 1].sta = i;
+		ev[2 * i + 1].join = 0;
+	}
+	qsort(ev, 2 * o->stations, sizeof(*ev), rcstorm_event_cmp);
+}
+
+static int
+rcstorm_join(struct bench_phy *phy, struct bench_sta *sta, gfp_t gfp,
+	     struct rcstorm_result *res)
+{
+	struct ieee80211_sta *s = &sta->si.sta;
+	char name[18];
+	u64 t0, t1;
+
+	t0 = shim_cycles();
+	sta->priv_sta = phy->ops->alloc_sta(phy->priv, s, gfp);
+	t1 = shim_cycles();
+	bench_lat_add(&res->alloc_sta, t0, t1);
+	if (!sta->priv_sta)
+		return -ENOMEM;
+
+	snprintf(name, sizeof(name), "%02x:%02x:%02x:%02x:%02x:%02x",
+		 s->addr[0], s->addr[1], s->addr[2],
+		 s->addr[3], s->addr[4], s->addr[5]);
+	sta->dir = debugfs_create_dir(name, phy->sta_dir);
+	if (phy->ops->add_sta_debugfs)
+		phy->ops->add_sta_debugfs(phy->priv, sta->priv_sta, sta->dir);
+
+	t0 = shim_cycles();
+	phy->ops->rate_init(phy->priv, &phy->sband, s, sta->priv_sta);
+	t1 = shim_cycles();
+	bench_lat_add(&res->rate_init, t0, t1);
+	return 0;
+}
+
+static void
+rcstorm_leave(struct bench_phy *phy, struct bench_sta *sta,
+	      struct rcstorm_result *res)
+{
+	u64 t0, t1;
+
+	if (phy->ops->remove_sta_debugfs)
+		phy->ops->remove_sta_debugfs(phy->priv, sta->priv_sta);
+	debugfs_remove_recursive(sta->dir);
+	sta->dir = NULL;
+
+	t0 = shim_cycles();
+	phy->ops->free_sta(phy->priv, &sta->si.sta, sta->priv_sta);
+	t1 = shim_cycles();
+	bench_lat_add(&res->free_sta, t0, t1);
+	sta->priv_sta = NULL;
+}
+
+static int
+rcstorm_run(struct rate_control_ops *ops, const struct rcstorm_opts *o,
+	    const struct bench_chan *chan, struct rcstorm_result *res)
+{
+	struct bench_phy phy;
+	struct bench_sta *stas;
+	struct rcstorm_event *ev;
+	struct bench_frame f;
+	struct bench_tx tx;
+	gfp_t gfp = o->kernel ? GFP_KERNEL : GFP_ATOMIC;
+	struct shim_mem_stats mem;
+	int *assoc, n_assoc = 0;
+	int r, i, j, err = -ENOMEM;
+	size_t base;
+
+	stas = calloc(o->stations, sizeof(*stas));
+	ev = calloc(2 * o->stations, sizeof(*ev));
+	assoc = calloc(o->stations, sizeof(*assoc));
+	if (!stas || !ev || !assoc)
+		goto out_free;
+
+	shim_seed(o->seed);
+	bench_seed(o->seed);
+	bench_now_us = 0;
+	bench_advance(0);
+
+	err = bench_phy_init(&phy, &o->cfg, 0);
+	if (!err)
+		err = bench_phy_start(&phy, ops);
+	if (err)
+		goto out;
+
+	/* Only the stations see the failures, the phy is already set up */
+	mem = shim_mem;
+	base = shim_mem.bytes;
+	shim_fail_order = o->fail_order;
+	shim_fail_prob = o->fail_prob;
+
+	for (r = 0; r < o->rounds; r++) {
+		u64 start = bench_now_us;
+
+		rcstorm_events(o, ev);
+		for (i = 0; i < 2 * o->stations; i++) {
+			struct bench_sta *sta = &stas[ev[i].sta];
+
+			if (start + ev[i].us > bench_now_us)
+				bench_advance(start + ev[i].us - bench_now_us);
+
+			if (ev[i].join) {
+				bench_sta_init(&phy, sta, ev[i].sta, 1);
+				res->assoc++;
+				if (rcstorm_join(&phy, sta, gfp, res)) {
+					res->failed++;
+					continue;
+				}
+				assoc[n_assoc++] = ev[i].sta;
+				if (n_assoc > res->max_assoc)
+					res->max_assoc = n_assoc;
+				if (shim_mem.bytes - base > res->peak)
+					res->peak = shim_mem.bytes - base;
+			} else if (sta->priv_sta) {
+				rcstorm_leave(&phy, sta, res);
+				for (j = 0; assoc[j] != ev[i].sta; j++)
+					;
+				assoc[j] = assoc[--n_assoc];
+			}
+
+			/* Some traffic to whoever is associated now */
+			for (j = 0; n_assoc && j < o->frames; j++) {
+				sta = &stas[assoc[(int)(bench_rand_double() * n_assoc)]];
+				bench_frame_init(&phy, sta, &f, IEEE80211_AC_BE);
+				bench_frame_reset(&f);
+				bench_get_rate(&phy, sta, &f);
+				bench_xmit(&phy, chan, &f, 1, &tx);
+				bench_advance(tx.airtime);
+				bench_tx_status(&phy, sta, &f);
+				while (shim_tasklets_pending())
+					shim_run_tasklets();
+			}
+		}
+	}
+
+	shim_fail_order = SHIM_MAX_ORDER + 1;
+	for (i = 0; i <= SHIM_MAX_ORDER; i++) {
+		res->atomic[i] = shim_mem.atomic[i] - mem.atomic[i];
+		res->atomic_failed[i] = shim_mem.atomic_failed[i] -
+					mem.atomic_failed[i];
+	}
+
+	bench_phy_stop(&phy);
+out:
+	bench_phy_free(&phy);
+out_free:
+	free(assoc);
+	free(ev);
+	free(stas);
+	return err;
+}
+
+static void
+rcstorm_report(const char *name, const struct rcstorm_result *res)
+{
+	int i;
+
+	bench_lat_print(stdout, name, "alloc_sta", &res->alloc_sta);
+	bench_lat_print(stdout, name, "rate_init", &res->rate_init);
+	bench_lat_print(stdout, name, "free_sta", &res->free_sta);
+	printf("%-12s %lu associations, %lu failed (%.2f%%), up to %d at once "
+	       "in %zu KiB\n", name, res->assoc, res->failed,
+	       res->assoc ? 100.0 * res->failed / res->assoc : 0.0,
+	       res->max_assoc, res->peak / 1024);
+	printf("%-12s atomic allocations by page order:", name);
+	for (i = 0; i <= SHIM_MAX_ORDER; i++) {
+		if (!res->atomic[i] && !res->atomic_failed[i])
+			continue;
+		printf(" %d: %lu", i, res->atomic[i]);
+		if (res->atomic_failed[i])
+			printf(" (%lu failed)", res->atomic_failed[i]);
+	}
+	printf("\n");
+}
+
+static void
+usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [options]\n"
+		"  -a alg[,alg]  algorithms to run (default: all)\n"
+		"  -n stations   stations joining in each round (default 500)\n"
+		"  -R rounds     storms to run (default 20)\n"
+		"  -T ms         length of a storm (default 1000)\n"
+		"  -D ms         mean stay of a station (default 300)\n"
+		"  -f frames     data frames after each join or leave (default 4)\n"
+		"  -k            allocate with GFP_KERNEL instead of GFP_ATOMIC\n"
+		"  -O order      fail atomic allocations of this page order and up\n"
+		"  -P prob       ... with this probability (default 1)\n"
+		"  -q snr        channel SNR in dB (default 18)\n"
+		"  -m streams    HT spatial streams (default 2)\n"
+		"  -w            40 MHz channel\n"
+		"  -g            short guard interval\n"
+		"  -l            legacy (non-HT) phy and stations\n"
+		"  -S seed       seed for the storm and the modules (default 1)\n"
+		"  -v            show the modules' printk output\n",
+		prog);
+}
+
+int
+main(int argc, char **argv)
+{
+	struct rcstorm_opts o = {
+		.stations = 500,
+		.rounds = 20,
+		.window_ms = 1000,
+		.stay_ms = 300,
+		.frames = 4,
+		.fail_order = SHIM_MAX_ORDER + 1,
+		.fail_prob = 1.0,
+		.snr = 18.0,
+		.seed = 1,
+		.cfg = { .ht = 1, .streams = 2 },
+	};
+	struct rcstorm_result *res;
+	struct rate_control_ops *ops;
+	struct bench_chan chan;
+	int c;
+
+	while ((c = getopt(argc, argv, "a:n:R:T:D:f:kO:P:q:m:wglS:vh")) != -1) {
+		switch (c) {
+		case 'a':
+			o.algs = optarg;
+			break;
+		case 'n':
+			o.stations = atoi(optarg);
+			break;
+		case 'R':
+			o.rounds = atoi(optarg);
+			break;
+		case 'T':
+			o.window_ms = atof(optarg);
+			break;
+		case 'D':
+			o.stay_ms = atof(optarg);
+			break;
+		case 'f':
+			o.frames = atoi(optarg);
+			break;
+		case 'k':
+			o.kernel = 1;
+			break;
+		case 'O':
+			o.fail_order = atoi(optarg);
+			break;
+		case 'P':
+			o.fail_prob = atof(optarg);
+			break;
+		case 'q':
+			o.snr = atof(optarg);
+			break;
+		case 'm':
+			o.cfg.streams = atoi(optarg);
+			break;
+		case 'w':
+			o.cfg.ht40 = 1;
+			break;
+		case 'g':
+			o.cfg.sgi = 1;
+			break;
+		case 'l':
+			o.cfg.ht = 0;
+			break;
+		case 'S':
+			o.seed = strtoull(optarg, NULL, 0);
+			break;
+		case 'v':
+			shim_verbose = 1;
+			break;
+		default:
+			usage(argv[0]);
+			return c == 'h' ? 0 : 1;
+		}
+	}
+	if (o.stations < 1 || o.rounds < 1 || o.window_ms <= 0 ||
+	    o.stay_ms <= 0 || o.frames < 0) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	bench_clock_init();
+	bench_chan_snr(&chan, o.snr);
+	bench_init_all();
+
+	printf("# %d rounds of %d stations in %.0f ms, mean stay %.0f ms, %s",
+	       o.rounds, o.stations, o.window_ms, o.stay_ms,
+	       o.kernel ? "GFP_KERNEL" : "GFP_ATOMIC");
+	if (o.fail_order <= SHIM_MAX_ORDER)
+		printf(", order >= %d fails with p %.2f", o.fail_order,
+		       o.fail_prob);
+	printf(", %s, seed %llu\n",
+	       !o.cfg.ht ? "legacy" : o.cfg.ht40 ? "HT40" : "HT20",
+	       (unsigned long long)o.seed);
+
+	res = malloc(sizeof(*res));
+	if (!res)
+		return 1;
+
+	bench_lat_header(stdout);
+
+	for (ops = shim_rate_control_next(NULL); ops;
+	     ops = shim_rate_control_next(ops)) {
+		if (!bench_selected(o.algs, ops->name))
+			continue;
+
+		memset(res, 0, sizeof(*res));
+		if (rcstorm_run(ops, &o, &chan, res)) {
+			printf("%s: setup failed\n", ops->name);
+			continue;
+		}
+		rcstorm_report(ops->name, res);
+	}
+
+	bench_exit_all();
+	free(res);
+
+	if (shim_warnings)
+		printf("# %lu kernel warnings\n", shim_warnings);
+	return 0;
+}
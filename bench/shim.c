@@ -0,0 +1,765 @@
+/*
+ * Userspace runtime behind include/kshim.h and the mac80211 stand-ins.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <time.h>
+#include <linux/types.h>
+#include <linux/slab.h>
+#include <linux/debugfs.h>
+#include <net/mac80211.h>
+#include "rate.h"
+#include "shim.h"
+
+unsigned long volatile jiffies;
+int shim_verbose;
+unsigned long shim_warnings;
+
+void
+shim_warn(const char *file, int line)
+{
+	if (shim_warnings++ < 10)
+		fprintf(stderr, "WARNING: at %s:%d\n", file, line);
+}
+
+/* Time */
+
+ktime_t
+ktime_get(void)
+{
+	struct timespec ts;
+	ktime_t kt;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	kt.tv64 = (s64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+	return kt;
+}
+
+cycles_t
+get_cycles(void)
+{
+	return (cycles_t)shim_cycles();
+}
+
+/* Randomness: xorshift64*, seeded by the harness */
+
+static u64 shim_rand_state = 0x9e3779b97f4a7c15ULL;
+static u64 shim_fail_state = 0x4f8a7bd4b4e2d816ULL;
+
+void
+shim_seed(u64 seed)
+{
+	shim_rand_state = seed ? seed : 0x9e3779b97f4a7c15ULL;
+	shim_fail_state = shim_rand_state ^ 0xd1b54a32d192ed03ULL;
+}
+
+u64
+shim_rand64(void)
+{
+	u64 x = shim_rand_state;
+
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	shim_rand_state = x;
+	return x * 0x2545f4914f6cdd1dULL;
+}
+
+void
+get_random_bytes(void *buf, int nbytes)
+{
+	u8 *p = buf;
+	u64 r;
+
+	while (nbytes >= 8) {
+		r = shim_rand64();
+		memcpy(p, &r, 8);
+		p += 8;
+		nbytes -= 8;
+	}
+	if (nbytes > 0) {
+		r = shim_rand64();
+		memcpy(p, &r, nbytes);
+	}
+}
+
+u32
+random32(void)
+{
+	return shim_rand64() >> 32;
+}
+
+/*
+ * Allocations. kmalloc hands out the SLAB size classes of a 32 byte
+ * cache line kernel, so ksize() and the accounting see what the router
+ * would actually reserve. Each block carries a small header with its
+ * class size.
+ */
+
+struct shim_mem_stats shim_mem;
+
+int shim_fail_order = SHIM_MAX_ORDER + 1;
+double shim_fail_prob = 1.0;
+
+/* Kept apart from shim_rand64(), so injecting failures does not change
+ * what the modules draw */
+static int
+shim_fail_injected(void)
+{
+	u64 x = shim_fail_state;
+
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	shim_fail_state = x;
+	return (x * 0x2545f4914f6cdd1dULL >> 11) * (1.0 / (1ULL << 53)) <
+	       shim_fail_prob;
+}
+
+struct shim_block {
+	size_t size;
+	size_t pad;
+};
+
+#define KMALLOC_MAX_SIZE	(4UL << 20)
+
+static size_t
+kmalloc_class(size_t size)
+{
+	size_t c;
+
+	if (size <= 32)
+		return 32;
+	if (size <= 64)
+		return 64;
+	if (size <= 96)
+		return 96;
+	if (size <= 128)
+		return 128;
+	if (size <= 192)
+		return 192;
+	for (c = 256; c < size; c <<= 1)
+		;
+	return c;
+}
+
+static int
+page_order(size_t size)
+{
+	int order = 0;
+
+	while ((PAGE_SIZE << order) < size)
+		order++;
+	return order;
+}
+
+static void *
+shim_alloc(size_t size, size_t charge, gfp_t flags)
+{
+	struct shim_block *b;
+	int order = page_order(charge);
+	int atomic = !(flags & __GFP_WAIT);
+
+	if (order > SHIM_MAX_ORDER)
+		order = SHIM_MAX_ORDER;
+
+	if (size > KMALLOC_MAX_SIZE ||
+	    (atomic && order >= shim_fail_order && shim_fail_injected())) {
+		shim_mem.failed++;
+		if (atomic)
+			shim_mem.atomic_failed[order]++;
+		return NULL;
+	}
+
+	b = malloc(sizeof(*b) + size);
+	if (!b) {
+		shim_mem.failed++;
+		return NULL;
+	}
+	b->size = charge;
+
+	shim_mem.allocs++;
+	shim_mem.bytes += charge;
+	if (shim_mem.bytes > shim_mem.peak)
+		shim_mem.peak = shim_mem.bytes;
+	shim_mem.order[order]++;
+	if (atomic)
+		shim_mem.atomic[order]++;
+	return b + 1;
+}
+
+static void
+shim_free(const void *ptr)
+{
+	struct shim_block *b;
+
+	if (!ptr)
+		return;
+	b = (struct shim_block *)ptr - 1;
+	shim_mem.frees++;
+	shim_mem.bytes -= b->size;
+	free(b);
+}
+
+void *
+kmalloc(size_t size, gfp_t flags)
+{
+	return shim_alloc(size, kmalloc_class(size), flags);
+}
+
+void *
+kzalloc(size_t size, gfp_t flags)
+{
+	void *p = kmalloc(size, flags);
+
+	if (p)
+		memset(p, 0, size);
+	return p;
+}
+
+void *
+kcalloc(size_t n, size_t size, gfp_t flags)
+{
+	if (size && n > (size_t)-1 / size)
+		return NULL;
+	return kzalloc(n * size, flags);
+}
+
+void
+kfree(const void *ptr)
+{
+	shim_free(ptr);
+}
+
+size_t
+ksize(const void *ptr)
+{
+	if (!ptr)
+		return 0;
+	return ((const struct shim_block *)ptr - 1)->size;
+}
+
+void *
+vmalloc(unsigned long size)
+{
+	return shim_alloc(size, ALIGN(size, PAGE_SIZE), GFP_KERNEL);
+}
+
+void *
+vzalloc(unsigned long size)
+{
+	void *p = vmalloc(size);
+
+	if (p)
+		memset(p, 0, size);
+	return p;
+}
+
+void
+vfree(const void *ptr)
+{
+	shim_free(ptr);
+}
+
+struct kmem_cache {
+	const char *name;
+	size_t size;
+	void (*ctor)(void *);
+};
+
+struct kmem_cache *
+kmem_cache_create(const char *name, size_t size, size_t align,
+		  unsigned long flags, void (*ctor)(void *))
+{
+	struct kmem_cache *c = calloc(1, sizeof(*c));
+
+	if (!c)
+		return NULL;
+	if (flags & SLAB_HWCACHE_ALIGN)
+		align = max_t(size_t, align, L1_CACHE_BYTES);
+	if (align < sizeof(void *))
+		align = sizeof(void *);
+	c->name = name;
+	c->size = ALIGN(size, align);
+	c->ctor = ctor;
+	return c;
+}
+
+void
+kmem_cache_destroy(struct kmem_cache *cachep)
+{
+	free(cachep);
+}
+
+void *
+kmem_cache_alloc(struct kmem_cache *cachep, gfp_t flags)
+{
+	void *p = shim_alloc(cachep->size, cachep->size, flags);
+
+	if (p && cachep->ctor)
+		cachep->ctor(p);
+	return p;
+}
+
+void *
+kmem_cache_zalloc(struct kmem_cache *cachep, gfp_t flags)
+{
+	void *p = shim_alloc(cachep->size, cachep->size, flags);
+
+	if (p)
+		memset(p, 0, cachep->size);
+	return p;
+}
+
+void
+kmem_cache_free(struct kmem_cache *cachep, void *objp)
+{
+	shim_free(objp);
+}
+
+unsigned int
+kmem_cache_size(struct kmem_cache *cachep)
+{
+	return cachep->size;
+}
+
+/* Tasklets run from shim_run_tasklets(), in the order they were queued */
+
+#define TASKLET_STATE_SCHED	0
+
+static struct tasklet_struct *tasklet_head;
+static struct tasklet_struct **tasklet_tail = &tasklet_head;
+
+void
+tasklet_init(struct tasklet_struct *t, void (*func)(unsigned long),
+	     unsigned long data)
+{
+	t->next = NULL;
+	t->state = 0;
+	t->func = func;
+	t->data = data;
+}
+
+void
+tasklet_schedule(struct tasklet_struct *t)
+{
+	if (test_and_set_bit(TASKLET_STATE_SCHED, &t->state))
+		return;
+	t->next = NULL;
+	*tasklet_tail = t;
+	tasklet_tail = &t->next;
+}
+
+void
+tasklet_kill(struct tasklet_struct *t)
+{
+	struct tasklet_struct **pp;
+
+	if (!test_and_clear_bit(TASKLET_STATE_SCHED, &t->state))
+		return;
+	for (pp = &tasklet_head; *pp; pp = &(*pp)->next) {
+		if (*pp != t)
+			continue;
+		*pp = t->next;
+		if (!*pp)
+			tasklet_tail = pp;
+		break;
+	}
+}
+
+int
+shim_tasklets_pending(void)
+{
+	return tasklet_head != NULL;
+}
+
+int
+shim_run_tasklets(void)
+{
+	struct tasklet_struct *t;
+	int n = 0;
+
+	while ((t = tasklet_head) != NULL) {
+		tasklet_head = t->next;
+		if (!tasklet_head)
+			tasklet_tail = &tasklet_head;
+		clear_bit(TASKLET_STATE_SCHED, &t->state);
+		t->func(t->data);
+		n++;
+	}
+	return n;
+}
+
+/* debugfs: a tree of nodes the harness can look up and read */
+
+enum {
+	SHIM_DENTRY_DIR,
+	SHIM_DENTRY_FILE,
+	SHIM_DENTRY_U8,
+	SHIM_DENTRY_U32,
+};
+
+struct dentry {
+	struct list_head list;
+	struct list_head children;
+	struct dentry *parent;
+	char name[48];
+	int type;
+	void *data;
+	const struct file_operations *fops;
+};
+
+static struct dentry shim_debugfs_root = {
+	.list = LIST_HEAD_INIT(shim_debugfs_root.list),
+	.children = LIST_HEAD_INIT(shim_debugfs_root.children),
+	.type = SHIM_DENTRY_DIR,
+};
+
+static struct dentry *
+shim_debugfs_create(const char *name, struct dentry *parent, int type,
+		    void *data, const struct file_operations *fops)
+{
+	struct dentry *d = calloc(1, sizeof(*d));
+
+	if (!d)
+		return NULL;
+	if (!parent)
+		parent = &shim_debugfs_root;
+	snprintf(d->name, sizeof(d->name), "%s", name);
+	INIT_LIST_HEAD(&d->children);
+	d->parent = parent;
+	d->type = type;
+	d->data = data;
+	d->fops = fops;
+	list_add_tail(&d->list, &parent->children);
+	return d;
+}
+
+struct dentry *
+debugfs_create_dir(const char *name, struct dentry *parent)
+{
+	return shim_debugfs_create(name, parent, SHIM_DENTRY_DIR, NULL, NULL);
+}
+
+struct dentry *
+debugfs_create_file(const char *name, mode_t mode, struct dentry *parent,
+		    void *data, const struct file_operations *fops)
+{
+	return shim_debugfs_create(name, parent, SHIM_DENTRY_FILE, data, fops);
+}
+
+struct dentry *
+debugfs_create_u8(const char *name, mode_t mode, struct dentry *parent,
+		  u8 *value)
+{
+	return shim_debugfs_create(name, parent, SHIM_DENTRY_U8, value, NULL);
+}
+
+struct dentry *
+debugfs_create_u32(const char *name, mode_t mode, struct dentry *parent,
+		   u32 *value)
+{
+	return shim_debugfs_create(name, parent, SHIM_DENTRY_U32, value, NULL);
+}
+
+struct dentry *
+debugfs_create_bool(const char *name, mode_t mode, struct dentry *parent,
+		    u32 *value)
+{
+	return debugfs_create_u32(name, mode, parent, value);
+}
+
+void
+debugfs_remove(struct dentry *dentry)
+{
+	if (!dentry || dentry == &shim_debugfs_root)
+		return;
+	if (WARN_ON(!list_empty(&dentry->children)))
+		return;
+	list_del(&dentry->list);
+	free(dentry);
+}
+
+void
+debugfs_remove_recursive(struct dentry *dentry)
+{
+	struct dentry *d, *tmp;
+
+	if (!dentry)
+		return;
+	list_for_each_entry_safe(d, tmp, &dentry->children, list)
+		debugfs_remove_recursive(d);
+	debugfs_remove(dentry);
+}
+
+struct dentry *
+shim_debugfs_lookup(struct dentry *parent, const char *name)
+{
+	struct dentry *d;
+
+	if (!parent)
+		parent = &shim_debugfs_root;
+	list_for_each_entry(d, &parent->children, list)
+		if (!strcmp(d->name, name))
+			return d;
+	return NULL;
+}
+
+int
+shim_debugfs_set(struct dentry *dentry, u32 val)
+{
+	switch (dentry->type) {
+	case SHIM_DENTRY_U8:
+		*(u8 *)dentry->data = val;
+		return 0;
+	case SHIM_DENTRY_U32:
+		*(u32 *)dentry->data = val;
+		return 0;
+	}
+	return -EINVAL;
+}
+
+/* Read a whole file the way cat(1) would; returns the length or -errno */
+ssize_t
+shim_debugfs_read(struct dentry *dentry, char *buf, size_t size)
+{
+	struct inode inode = { .i_private = dentry->data };
+	struct file file = { .f_flags = O_NONBLOCK };
+	size_t len = 0;
+	loff_t pos = 0;
+	ssize_t ret;
+
+	if (dentry->type == SHIM_DENTRY_U8 || dentry->type == SHIM_DENTRY_U32) {
+		u32 val = dentry->type == SHIM_DENTRY_U8 ?
+			*(u8 *)dentry->data : *(u32 *)dentry->data;
+
+		return snprintf(buf, size, "%u\n", val);
+	}
+	if (dentry->type != SHIM_DENTRY_FILE || !size)
+		return -EINVAL;
+
+	if (dentry->fops->open) {
+		ret = dentry->fops->open(&inode, &file);
+		if (ret)
+			return ret;
+	}
+	while (len < size - 1) {
+		ret = dentry->fops->read(&file, buf + len, size - 1 - len, &pos);
+		if (ret <= 0)
+			break;
+		len += ret;
+	}
+	buf[len] = 0;
+	if (dentry->fops->release)
+		dentry->fops->release(&inode, &file);
+	return len;
+}
+
+ssize_t
+simple_read_from_buffer(void __user *to, size_t count, loff_t *ppos,
+			const void *from, size_t available)
+{
+	loff_t pos = *ppos;
+
+	if (pos < 0)
+		return -EINVAL;
+	if (pos >= available || !count)
+		return 0;
+	if (count > available - pos)
+		count = available - pos;
+	memcpy(to, (const char *)from + pos, count);
+	*ppos = pos + count;
+	return count;
+}
+
+loff_t
+default_llseek(struct file *file, loff_t offset, int whence)
+{
+	return -EINVAL;
+}
+
+loff_t
+no_llseek(struct file *file, loff_t offset, int whence)
+{
+	return -ESPIPE;
+}
+
+loff_t
+noop_llseek(struct file *file, loff_t offset, int whence)
+{
+	return 0;
+}
+
+/* mac80211 */
+
+static LIST_HEAD(shim_rate_ctrl_algs);
+
+struct shim_rate_ctrl_alg {
+	struct list_head list;
+	struct rate_control_ops *ops;
+};
+
+int
+ieee80211_rate_control_register(struct rate_control_ops *ops)
+{
+	struct shim_rate_ctrl_alg *alg;
+
+	list_for_each_entry(alg, &shim_rate_ctrl_algs, list)
+		if (!strcmp(alg->ops->name, ops->name))
+			return -EALREADY;
+
+	alg = calloc(1, sizeof(*alg));
+	if (!alg)
+		return -ENOMEM;
+	alg->ops = ops;
+	list_add_tail(&alg->list, &shim_rate_ctrl_algs);
+	return 0;
+}
+
+void
+ieee80211_rate_control_unregister(struct rate_control_ops *ops)
+{
+	struct shim_rate_ctrl_alg *alg;
+
+	list_for_each_entry(alg, &shim_rate_ctrl_algs, list) {
+		if (alg->ops != ops)
+			continue;
+		list_del(&alg->list);
+		free(alg);
+		return;
+	}
+}
+
+struct rate_control_ops *
+shim_rate_control_lookup(const char *name)
+{
+	struct shim_rate_ctrl_alg *alg;
+
+	list_for_each_entry(alg, &shim_rate_ctrl_algs, list)
+		if (!strcmp(alg->ops->name, name))
+			return alg->ops;
+	return NULL;
+}
+
+struct rate_control_ops *
+shim_rate_control_next(struct rate_control_ops *prev)
+{
+	struct shim_rate_ctrl_alg *alg;
+	bool found = !prev;
+
+	list_for_each_entry(alg, &shim_rate_ctrl_algs, list) {
+		if (found)
+			return alg->ops;
+		if (alg->ops == prev)
+			found = true;
+	}
+	return NULL;
+}
+
+/* As in net/mac80211/util.c */
+int
+ieee80211_frame_duration(struct ieee80211_local *local, size_t len,
+			 int rate, int erp, int short_preamble)
+{
+	int dur;
+
+	/* calculate duration (in microseconds, rounded up to next higher
+	 * integer if it includes a fractional microsecond) to send frame of
+	 * len bytes (does not include FCS) at the given rate. Duration will
+	 * also include SIFS.
+	 *
+	 * rate is in 100 kbps, so divident is multiplied by 10 in the
+	 * DIV_ROUND_UP() operations.
+	 */
+
+	if (local->hw.conf.channel->band == IEEE80211_BAND_5GHZ || erp) {
+		/*
+		 * OFDM:
+		 *
+		 * N_DBPS = DATARATE x 4
+		 * N_SYM = Ceiling((16+8xLENGTH+6) / N_DBPS)
+		 *	(16 = SIGNAL time, 6 = tail bits)
+		 * TXTIME = T_PREAMBLE + T_SIGNAL + T_SYM x N_SYM + Signal Ext
+		 *
+		 * T_SYM = 4 usec
+		 * 802.11a - 17.5.2: aSIFSTime = 16 usec
+		 * 802.11g - 19.8.4: aSIFSTime = 10 usec +
+		 *	signal ext = 6 usec
+		 */
+		dur = 16; /* SIFS + signal ext */
+		dur += 16; /* 17.3.2.3: T_PREAMBLE = 16 usec */
+		dur += 4; /* 17.3.2.3: T_SIGNAL = 4 usec */
+		dur += 4 * DIV_ROUND_UP((16 + 8 * (len + 4) + 6) * 10,
+					4 * rate); /* T_SYM x N_SYM */
+	} else {
+		/*
+		 * 802.11b or 802.11g with 802.11b compatibility:
+		 * 18.3.4: TXTIME = PreambleLength + PLCPHeaderTime +
+		 * Ceiling(((LENGTH+PBCC)x8)/DATARATE). PBCC=0.
+		 *
+		 * 802.11 (DS): 15.3.3, 802.11b: 18.3.4
+		 * aSIFSTime = 10 usec
+		 * aPreambleLength = 144 usec or 72 usec with short preamble
+		 * aPLCPHeaderLength = 48 usec or 24 usec with short preamble
+		 */
+		dur = 10; /* aSIFSTime = 10 usec */
+		dur += short_preamble ? (72 + 24) : (144 + 48);
+
+		dur += DIV_ROUND_UP(8 * (len + 4) * 10, rate);
+	}
+
+	return dur;
+}
+
+/* As in net/mac80211/rate.c */
+static inline bool
+rc_no_data_or_no_ack(struct ieee80211_tx_rate_control *txrc)
+{
+	struct sk_buff *skb = txrc->skb;
+	struct ieee80211_hdr *hdr = (struct ieee80211_hdr *)skb->data;
+	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(skb);
+	__le16 fc;
+
+	fc = hdr->frame_control;
+
+	return (info->flags & IEEE80211_TX_CTL_NO_ACK) || !ieee80211_is_data(fc);
+}
+
+bool
+rate_control_send_low(struct ieee80211_sta *sta, void *priv_sta,
+		      struct ieee80211_tx_rate_control *txrc)
+{
+	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(txrc->skb);
+	struct ieee80211_supported_band *sband = txrc->sband;
+
+	if (!sta || !priv_sta || rc_no_data_or_no_ack(txrc)) {
+		info->control.rates[0].idx = rate_lowest_index(sband, sta);
+		info->control.rates[0].count =
+			(info->flags & IEEE80211_TX_CTL_NO_ACK) ?
+			1 : txrc->hw->max_rate_tries;
+		return true;
+	}
+	return false;
+}
+
+unsigned long shim_ba_sessions;
+
+int
+ieee80211_start_tx_ba_session(struct ieee80211_sta *pubsta, u16 tid,
+			      u16 timeout)
+{
+	struct sta_info *sta = container_of(pubsta, struct sta_info, sta);
+
+	if (tid >= STA_TID_NUM)
+		return -EINVAL;
+	if (sta->ampdu_mlme.tid_tx[tid])
+		return -EAGAIN;
+
+	/* Any non-NULL value marks the session as up */
+	sta->ampdu_mlme.tid_tx[tid] = (struct tid_ampdu_tx *)sta;
+	shim_ba_sessions++;
+	return 0;
+}
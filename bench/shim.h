@@ -0,0 +1,93 @@
+/*
+ * Harness side of the kernel shim: the knobs and counters the benchmark
+ * drivers use that the modules themselves never see.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#ifndef __BENCH_SHIM_H
+#define __BENCH_SHIM_H
+
+#include <kshim.h>
+
+#if defined(__i386__) || defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+#include <time.h>
+
+struct rate_control_ops;
+
+extern unsigned long shim_warnings;
+extern unsigned long shim_ba_sessions;
+
+/* Allocation accounting, in bytes of slab actually reserved */
+#define SHIM_MAX_ORDER	10
+
+struct shim_mem_stats {
+	unsigned long allocs;
+	unsigned long frees;
+	unsigned long failed;
+	size_t bytes;
+	size_t peak;
+	unsigned long order[SHIM_MAX_ORDER + 1];	// allocations per page order
+	unsigned long atomic[SHIM_MAX_ORDER + 1];	// same, without __GFP_WAIT
+	unsigned long atomic_failed[SHIM_MAX_ORDER + 1];
+};
+
+extern struct shim_mem_stats shim_mem;
+
+/*
+ * Allocation failure injection: allocations that cannot sleep and span
+ * at least shim_fail_order pages (as a page order) fail with probability
+ * shim_fail_prob, the way high-order GFP_ATOMIC requests do on a busy,
+ * fragmented router. Off while shim_fail_order is above SHIM_MAX_ORDER.
+ */
+extern int shim_fail_order;
+extern double shim_fail_prob;
+
+void shim_seed(u64 seed);
+u64 shim_rand64(void);
+
+int shim_tasklets_pending(void);
+int shim_run_tasklets(void);
+
+struct dentry *shim_debugfs_lookup(struct dentry *parent, const char *name);
+int shim_debugfs_set(struct dentry *dentry, u32 val);
+ssize_t shim_debugfs_read(struct dentry *dentry, char *buf, size_t size);
+
+struct rate_control_ops *shim_rate_control_lookup(const char *name);
+struct rate_control_ops *shim_rate_control_next(struct rate_control_ops *prev);
+
+/*
+ * Cycle counter for the per-call timings: the TSC on x86, the virtual
+ * counter on arm64, and the monotonic clock in ns elsewhere.
+ */
+static inline u64
+shim_cycles(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+	_mm_lfence();
+	return __rdtsc();
+#elif defined(__aarch64__)
+	u64 val;
+
+	__asm__ __volatile__("isb; mrs %0, cntvct_el0" : "=r" (val));
+	return val;
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+/* Nonzero when shim_cycles() counts something other than nanoseconds */
+#if defined(__i386__) || defined(__x86_64__) || defined(__aarch64__)
+#define SHIM_HAVE_CYCLES	1
+#else
+#define SHIM_HAVE_CYCLES	0
+#endif
+
+#endif
@@ -0,0 +1,221 @@
+/*
+ * Channel traces for the simulations, see struct bench_trace in bench.h.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include "bench.h"
+
+static int
+bench_trace_error(struct bench_trace *tr, const char *msg)
+{
+	fprintf(stderr, "%s:%d: %s\n", tr->name, tr->line, msg);
+	return -EINVAL;
+}
+
+/* Read up to n probabilities, each in [0, 1] */
+static int
+bench_trace_probs(struct bench_trace *tr, char *p, double *to, int n)
+{
+	char *end;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		to[i] = strtod(p, &end);
+		if (end == p)
+			return bench_trace_error(tr, "missing probability");
+		if (to[i] < 0 || to[i] > 1)
+			return bench_trace_error(tr, "probability out of [0, 1]");
+		p = end;
+	}
+	return 0;
+}
+
+/*
+ * Apply the lines of one sample to tr->next, up to the next "@" line,
+ * whose time is left in *at. Returns 1 at the end of the file.
+ */
+static int
+bench_trace_read(struct bench_trace *tr, u64 *at)
+{
+	char line[1024], *p, *end;
+	double v;
+	long g;
+	int err;
+
+	while (fgets(line, sizeof(line), tr->f)) {
+		tr->line++;
+		for (p = line; isspace(*p); p++)
+			;
+		if (!*p || *p == '#')
+			continue;
+
+		if (*p == '@') {
+			v = strtod(p + 1, &end);
+			if (end == p + 1 || v < 0)
+				return bench_trace_error(tr, "bad sample time");
+			*at = (u64)(v * 1000 + 0.5);
+			return 0;
+		}
+
+		if (!strncmp(p, "end", 3) && isspace(p[3])) {
+			v = strtod(p + 3, &end);
+			if (end == p + 3 || v < 0)
+				return bench_trace_error(tr, "bad end time");
+			tr->end_us = (u64)(v * 1000 + 0.5);
+		} else if (!strncmp(p, "snr", 3) && isspace(p[3])) {
+			v = strtod(p + 3, &end);
+			if (end == p + 3)
+				return bench_trace_error(tr, "missing SNR");
+			bench_chan_snr(&tr->next, v);
+		} else if (!strncmp(p, "legacy", 6) && isspace(p[6])) {
+			err = bench_trace_probs(tr, p + 6, tr->next.legacy,
+						BENCH_N_LEGACY);
+			if (err)
+				return err;
+		} else if (!strncmp(p, "mcs", 3) && isspace(p[3])) {
+			g = strtol(p + 3, &end, 0);
+			if (end == p + 3 || g < 0 || g >= BENCH_N_GROUPS)
+				return bench_trace_error(tr, "bad MCS group");
+			err = bench_trace_probs(tr, end, tr->next.mcs[g],
+						MCS_GROUP_RATES);
+			if (err)
+				return err;
+		} else {
+			return bench_trace_error(tr, "unknown directive");
+		}
+	}
+
+	return 1;
+}
+
+/* Load the sample after the one in effect into tr->next */
+static int
+bench_trace_load(struct bench_trace *tr)
+{
+	u64 at;
+	int ret;
+
+	tr->have_next = 0;
+	if (!tr->pending)
+		return 0;
+
+	tr->next = tr->cur;
+	tr->next_us = tr->pending_us;
+	ret = bench_trace_read(tr, &at);
+	if (ret < 0)
+		return ret;
+	if (!ret && at < tr->next_us)
+		return bench_trace_error(tr, "sample times go backwards");
+
+	tr->pending = !ret;
+	tr->pending_us = at;
+	tr->have_next = 1;
+	return 0;
+}
+
+int
+bench_trace_rewind(struct bench_trace *tr)
+{
+	u64 at;
+	int ret;
+
+	rewind(tr->f);
+	tr->line = 0;
+	tr->gen = 0;
+
+	/* Lines before the first "@" describe the channel from time 0 */
+	memset(&tr->next, 0, sizeof(tr->next));
+	ret = bench_trace_read(tr, &at);
+	if (ret < 0)
+		return ret;
+	tr->cur = tr->next;
+	tr->pending = !ret;
+	tr->pending_us = at;
+	return bench_trace_load(tr);
+}
+
+int
+bench_trace_open(struct bench_trace *tr, const char *name)
+{
+	char buf[4096];
+	u64 last = 0;
+	size_t len;
+	int err;
+
+	memset(tr, 0, sizeof(*tr));
+	tr->name = name;
+
+	/* Standard input gets copied, each algorithm replays the trace */
+	if (!strcmp(name, "-")) {
+		tr->f = tmpfile();
+		if (!tr->f)
+			return -errno;
+		while ((len = fread(buf, 1, sizeof(buf), stdin)) > 0)
+			fwrite(buf, 1, len, tr->f);
+	} else {
+		tr->f = fopen(name, "r");
+		if (!tr->f)
+			return -errno;
+	}
+
+	/* Find the last sample for the default length of a run */
+	err = bench_trace_rewind(tr);
+	while (!err && tr->have_next) {
+		last = tr->next_us;
+		tr->cur = tr->next;
+		err = bench_trace_load(tr);
+	}
+	if (!err)
+		err = bench_trace_rewind(tr);
+	if (err) {
+		fclose(tr->f);
+		return err;
+	}
+
+	if (!tr->end_us)
+		tr->end_us = last + 1000000;
+	return 0;
+}
+
+/* Channel in effect at time us, which never goes back between calls */
+const struct bench_chan *
+bench_trace_at(struct bench_trace *tr, u64 us)
+{
+	while (tr->have_next && tr->next_us <= us) {
+		tr->cur = tr->next;
+		tr->gen++;
+		bench_trace_load(tr);
+	}
+	return &tr->cur;
+}
+
+void
+bench_trace_close(struct bench_trace *tr)
+{
+	fclose(tr->f);
+}
+
+/* One complete sample, in the format bench_trace_open() reads */
+void
+bench_trace_write(FILE *out, u64 us, const struct bench_chan *chan)
+{
+	int i, j;
+
+	fprintf(out, "@ %llu.%03u\nlegacy", (unsigned long long)(us / 1000),
+		(unsigned int)(us % 1000));
+	for (i = 0; i < BENCH_N_LEGACY; i++)
+		fprintf(out, " %.4f", chan->legacy[i]);
+	fprintf(out, "\n");
+
+	for (i = 0; i < BENCH_N_GROUPS; i++) {
+		fprintf(out, "mcs %d", i);
+		for (j = 0; j < MCS_GROUP_RATES; j++)
+			fprintf(out, " %.4f", chan->mcs[i][j]);
+		fprintf(out, "\n");
+	}
+}
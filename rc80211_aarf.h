@@ -18,7 +18,8 @@
 #define AARF_TIMER_K			2
 #define AARF_SUCCESS_K			2
 
-#define AARF_DEBUGFS_HIST_SIZE	10000U
+/* Buffer space for each rc_history line */
+#define AARF_HIST_LINE_LEN	128
 
 #define AARF_LOG_SUCCESS	1
 #define AARF_LOG_FAILURE	2
@@ -56,10 +57,12 @@ struct aarf_sta_info {
 
 	/* Rate pointer for each station (created in aarf_alloc_sta) */
 	struct aarf_rate *r;
+	s8 rix_ndx[IEEE80211_MAX_SUPP_RATES];	// r index for each mac80211 rate index (-1 if unsupported)
+
+	struct rc_prof prof;			// per-call time accounting
 
 #ifdef CONFIG_MAC80211_DEBUGFS
-	struct aarf_hist_info *hi;		// history table (for the first AARF_DEBUGFS_HIST_SIZE rate adaptations)
-	unsigned int dbg_idx;			// history table index
+	struct rc_hist hist;			// history ring (most recent rate adaptations)
 	struct dentry *dbg_stats;		// debug rc_stats file pointer
 	struct dentry *dbg_hist;		// debug rc_history file pointer
 #endif
@@ -71,6 +74,8 @@ struct aarf_sta_info {
 struct aarf_priv {
 	struct ieee80211_hw *hw; 		// hardware properties
 	unsigned int max_retry;		  	// default max number o retries before frame discard
+
+	struct rc_phy_stats phy_stats;	// station setup accounting for this phy
 };
 
 
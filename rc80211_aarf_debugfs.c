@@ -57,6 +57,9 @@
 #include <linux/ieee80211.h>
 #include <linux/slab.h>
 #include <net/mac80211.h>
+#include "rc80211_prof.h"
+#include "rc80211_phy.h"
+#include "rc80211_hist.h"
 #include "rc80211_aarf.h"
 
 int
@@ -105,6 +108,8 @@ aarf_stats_open (struct inode *inode, struct file *file)
 			ci->timeout_k
 	);
 
+	p += rc_prof_scnprintf (p, cs->buf + 4096 - p, &ci->prof);
+
 	cs->len = p - cs->buf;
 	return 0;
 }
@@ -115,12 +120,15 @@ aarf_hist_open (struct inode *inode, struct file *file)
 {
 	struct aarf_sta_info *ci = inode->i_private;
 	struct aarf_debugfs_info *ch;
-	unsigned int i;
+	unsigned int i, first, last;
 	char *p;
 
-	ch = kmalloc (sizeof (*ch) 
-			    + sizeof (struct aarf_hist_info) * AARF_DEBUGFS_HIST_SIZE 
-				+ 1024, GFP_KERNEL);
+	/* Recording starts with the first open */
+	if (rc_hist_alloc (&ci->hist, sizeof (struct aarf_hist_info)))
+		return -ENOMEM;
+
+	ch = kmalloc (sizeof (*ch) + AARF_HIST_LINE_LEN *
+			(ci->hist.ring->mask + 1) + 1024, GFP_KERNEL);
 	if (!ch)
 		return -ENOMEM;
 
@@ -130,12 +138,15 @@ aarf_hist_open (struct inode *inode, struct file *file)
 	/* Table header */
 	p += sprintf (p, "Adaptive Auto Rate Fallback (AARF)\n");
 	p += sprintf (p, "History Information Table\n"); 
-	p += sprintf (p, "Rate adaptations: %u (max of %u)\n\n", ci->dbg_idx, AARF_DEBUGFS_HIST_SIZE);
+	last = ci->hist.idx;
+	first = rc_hist_first (&ci->hist, last);
+	p += sprintf (p, "Rate adaptations: %u (%u kept, ring of %u)\n\n", last,
+			last > first ? last - first : 0, ci->hist.ring->mask + 1);
 	p += sprintf (p, "Idx | Start time |  Event  | Rate -> Rate | Timer | Succ | Fail | Recover | succ_ths | timeout \n");
 
 	/* Table lines */
-	for (i = 0; i < ci->dbg_idx && i < AARF_DEBUGFS_HIST_SIZE; i++) {
-		struct aarf_hist_info	*t = &ci->hi[i];
+	for (i = first; i < last; i++) {
+		struct aarf_hist_info	*t = rc_hist_entry (&ci->hist, i, sizeof (*t));
 
 		p += sprintf (p, "%3u | %10d | %s | %2u%s%s%2u%s | %5d | %4d | %4d | %s | %8d | %7d \n", 
 				i,
@@ -152,9 +163,6 @@ aarf_hist_open (struct inode *inode, struct file *file)
 			);
 	}
 
-	if (i == AARF_DEBUGFS_HIST_SIZE)
-		p += sprintf (p, "\n   *** Table Full... ***\n");
-
 	ch->len = p - ch->buf;
 	return 0;
 }
@@ -48,17 +48,18 @@
 #include <linux/slab.h>
 #include <net/mac80211.h>
 #include "rate.h"
+#include "rc80211_prof.h"
+#include "rc80211_phy.h"
+#include "rc80211_hist.h"
 #include "rc80211_arf.h"
 
 /* Converting mac80211 rate index into local array index */
 static inline int
 rix_to_ndx (struct arf_sta_info *ci, int rix)
 {
-	int i;
-	for (i = ci->n_rates - 1; i >= 0; i--)
-		if (ci->r[i].rix == rix)
-			break;
-	return i;
+	if ((unsigned int) rix >= IEEE80211_MAX_SUPP_RATES)
+		return -1;
+	return ci->rix_ndx[rix];
 }
 
 
@@ -89,11 +90,12 @@ static void arf_sync (struct arf_sta_info *ci, int rate_ndx)
 
 static void arf_log (struct arf_sta_info *ci, int event, int rate, int last)
 {
+#ifdef CONFIG_MAC80211_DEBUGFS
+	struct arf_hist_info *ht;
 	unsigned long diff; 
 	
-	if (ci->dbg_idx < ARF_DEBUGFS_HIST_SIZE) {
-		struct arf_hist_info *ht = &ci->hi[ci->dbg_idx];
-		
+	ht = rc_hist_entry (&ci->hist, ci->hist.idx, sizeof (*ht));
+	if (ht) {
 		diff = (long)jiffies - (long)ci->first_time;
 		ht->start_ms = (int)(diff * 1000 / HZ);	
 		ht->rate = ci->r[rate].bitrate;
@@ -105,8 +107,9 @@ static void arf_log (struct arf_sta_info *ci, int event, int rate, int last)
 		ht->recovery = ci->recovery;
 		ht->success_thrs = ci->success_thrs;
 		ht->timeout = ci->timeout;
-		ci->dbg_idx++;	
 	}
+	ci->hist.idx++;
+#endif
 }
 
 static void arf_att_success (struct arf_sta_info *ci, int rate)
@@ -171,7 +174,7 @@ static void arf_att_failure (struct arf_sta_info *ci, int rate)
 /* arf_tx_status is called just after frame tx and it is used to update
  * statistics information for the used rate */
 static void
-arf_tx_status (void *priv, struct ieee80211_supported_band *sband, 
+__arf_tx_status (void *priv, struct ieee80211_supported_band *sband, 
 		struct ieee80211_sta *sta, void *priv_sta, struct sk_buff *skb)
 {
 	struct arf_sta_info *ci = priv_sta;
@@ -198,7 +201,8 @@ arf_tx_status (void *priv, struct ieee80211_supported_band *sband,
 		/* ... at first attempt. */
 		if (ar[0].count == 1 && ar[1].idx < 0) {
 	   	   	ndx = rix_to_ndx (ci, ar[i].idx);
-			arf_att_success (ci, ndx);
+			if (ndx >= 0)
+				arf_att_success (ci, ndx);
 			return;
 		}
 
@@ -239,11 +243,22 @@ arf_tx_status (void *priv, struct ieee80211_supported_band *sband,
 	}
 }
 
+static void
+arf_tx_status (void *priv, struct ieee80211_supported_band *sband, 
+		struct ieee80211_sta *sta, void *priv_sta, struct sk_buff *skb)
+{
+	struct arf_sta_info *ci = priv_sta;
+	ktime_t start = rc_prof_start ();
+
+	__arf_tx_status (priv, sband, sta, priv_sta, skb);
+	rc_prof_end (&ci->prof, RC_PROF_TX_STATUS, start);
+}
+
 
 /* arf_get_rate is called just before each frame tx and sets the appropriate
  * data rate to be used */
 static void
-arf_get_rate (void *priv, struct ieee80211_sta *sta, void *priv_sta,
+__arf_get_rate (void *priv, struct ieee80211_sta *sta, void *priv_sta,
 		struct ieee80211_tx_rate_control *txrc)
 {
 	struct sk_buff *skb = txrc->skb;
@@ -281,14 +296,28 @@ arf_get_rate (void *priv, struct ieee80211_sta *sta, void *priv_sta,
 	 * this code will demand adjustments. */
 }
 
+static void
+arf_get_rate (void *priv, struct ieee80211_sta *sta, void *priv_sta,
+		struct ieee80211_tx_rate_control *txrc)
+{
+	struct arf_sta_info *ci = priv_sta;
+	ktime_t start = rc_prof_start ();
+
+	__arf_get_rate (priv, sta, priv_sta, txrc);
+	rc_prof_end (&ci->prof, RC_PROF_GET_RATE, start);
+}
+
 
 /* arf_rate_init is called after arf_alloc_sta to check and populate
  * information for supported rates */
 static void
-arf_rate_init (void *priv, struct ieee80211_supported_band *sband,
+__arf_rate_init (void *priv, struct ieee80211_supported_band *sband,
 		struct ieee80211_sta *sta, void *priv_sta)
 {
 	struct arf_sta_info *ci = priv_sta;
+#ifdef CONFIG_MAC80211_DEBUGFS
+	struct arf_priv *cp = priv;
+#endif
 	unsigned int i, n = 0;
 
 	/* Populating information for each supported rate */
@@ -308,21 +337,41 @@ arf_rate_init (void *priv, struct ieee80211_supported_band *sband,
 	/* Sort rates based on bitrate */
 	sort_bitrates (ci, n);
 
+	/* Reverse map from mac80211 rate index to local array index */
+	memset (ci->rix_ndx, -1, sizeof (ci->rix_ndx));
+	for (i = 0; i < n; i++)
+		ci->rix_ndx[ci->r[i].rix] = i;
+
 	/* Mark unsupported rates with rix = -1 */
 	for (i = n; i < sband->n_bitrates; i++) {
 		struct arf_rate *cr = &ci->r[i];
 		cr->rix = -1;
 	}
 
-	ci->dbg_idx = 0;	
+#ifdef CONFIG_MAC80211_DEBUGFS
+	rc_hist_reset (&ci->hist, cp->phy_stats.hist_size);
+#endif
 	ci->n_rates = n;
 	ci->first_time = jiffies;
 }
 
+static void
+arf_rate_init (void *priv, struct ieee80211_supported_band *sband,
+		struct ieee80211_sta *sta, void *priv_sta)
+{
+	struct arf_sta_info *ci = priv_sta;
+	struct arf_priv *cp = priv;
+	ktime_t start = rc_prof_start ();
+
+	__arf_rate_init (priv, sband, sta, priv_sta);
+	rc_prof_end (&ci->prof, RC_PROF_RATE_INIT, start);
+	rc_prof_end (&cp->phy_stats.prof, RC_PROF_RATE_INIT, start);
+}
+
 
 /* arf_alloc_sta is called every time a new station joins the networks */
 static void *
-arf_alloc_sta (void *priv, struct ieee80211_sta *sta, gfp_t gfp)
+__arf_alloc_sta (void *priv, struct ieee80211_sta *sta, gfp_t gfp)
 {
 	struct ieee80211_supported_band *sband;
 	struct arf_sta_info *ci;
@@ -349,15 +398,7 @@ arf_alloc_sta (void *priv, struct ieee80211_sta *sta, gfp_t gfp)
 		return NULL;
 	}
 
-#ifdef CONFIG_MAC80211_DEBUGFS
-	/* If in debugfs mode, memory allocation for history table */
-   	ci->hi = kzalloc (sizeof (struct arf_hist_info) * ARF_DEBUGFS_HIST_SIZE, gfp);
-	if (!ci->hi) {
-		kfree (ci->r);
-		kfree (ci);
-		return NULL;
-	}
-#endif
+	rc_phy_sta_alloc (&cp->phy_stats, ksize (ci) + ksize (ci->r));
 
 	ci->current_rate_ndx = 0;
 	ci->success = 0;
@@ -375,20 +416,47 @@ arf_alloc_sta (void *priv, struct ieee80211_sta *sta, gfp_t gfp)
 	return ci;
 }
 
+static void *
+arf_alloc_sta (void *priv, struct ieee80211_sta *sta, gfp_t gfp)
+{
+	struct arf_priv *cp = priv;
+	ktime_t start = rc_prof_start ();
+	void *priv_sta;
+
+	priv_sta = __arf_alloc_sta (priv, sta, gfp);
+	if (!priv_sta)
+		cp->phy_stats.alloc_fail++;
+	rc_prof_end (&cp->phy_stats.prof, RC_PROF_ALLOC_STA, start);
+	return priv_sta;
+}
+
 
 /* arf_free_sta used to release memory when a station leaves the network */
 static void
-arf_free_sta (void *priv, struct ieee80211_sta *sta, void *priv_sta)
+__arf_free_sta (void *priv, struct ieee80211_sta *sta, void *priv_sta)
 {
 	struct arf_sta_info *ci = priv_sta;
+	struct arf_priv *cp = priv;
 
+	rc_phy_sta_free (&cp->phy_stats, ksize (ci) + ksize (ci->r));
 #ifdef CONFIG_MAC80211_DEBUGFS
-	kfree (ci->hi);
+	rc_hist_free (&ci->hist);
 #endif
+
 	kfree (ci->r);
 	kfree (ci);
 }
 
+static void
+arf_free_sta (void *priv, struct ieee80211_sta *sta, void *priv_sta)
+{
+	struct arf_priv *cp = priv;
+	ktime_t start = rc_prof_start ();
+
+	__arf_free_sta (priv, sta, priv_sta);
+	rc_prof_end (&cp->phy_stats.prof, RC_PROF_FREE_STA, start);
+}
+
 
 /* arf_alloc called once before turning on the wireless interface */
 static void *
@@ -406,6 +474,10 @@ arf_alloc (struct ieee80211_hw *hw, struct dentry *debugfsdir)
 	else
 		cp->max_retry = 7;
 
+#ifdef CONFIG_MAC80211_DEBUGFS
+	rc_phy_add_debugfs (&cp->phy_stats, debugfsdir, NULL, RC_HIST_SIZE);
+#endif
+
 	cp->hw = hw;
 	return cp;
 }
@@ -415,6 +487,11 @@ arf_alloc (struct ieee80211_hw *hw, struct dentry *debugfsdir)
 static void
 arf_free (void *priv)
 {
+#ifdef CONFIG_MAC80211_DEBUGFS
+	struct arf_priv *cp = priv;
+
+	rc_phy_remove_debugfs (&cp->phy_stats);
+#endif
 	kfree (priv);
 }
 
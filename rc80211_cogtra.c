@@ -44,155 +44,72 @@
 #include <linux/types.h>
 #include <linux/skbuff.h>
 #include <linux/debugfs.h>
+#include <linux/interrupt.h>
 #include <linux/random.h>
 #include <linux/ieee80211.h>
 #include <linux/slab.h>
 #include <net/mac80211.h>
 #include "rate.h"
+#include "rc80211_prof.h"
+#include "rc80211_phy.h"
+#include "rc80211_random.h"
+#include "rc80211_hist.h"
+#include "rc80211_cogtra_normal.h"
 #include "rc80211_cogtra.h"
 
+/* Exploration policy for each access category. Voice keeps a narrow normal
+ * curve around the most reliable rate and short mrr stages, to bound jitter.
+ * The other ones explore as cogtra always did */
+static const struct cogtra_ac_policy cogtra_ac_policy[COGTRA_NUM_ACS] = {
+#ifdef COGTRA_USE_PER_AC
+	[IEEE80211_AC_VO] = { COGTRA_VO_STDEV, COGTRA_VO_STDEV, true, 1 },
+	[IEEE80211_AC_VI] = { COGTRA_MIN_STDEV, COGTRA_MAX_STDEV, false, 2 },
+	[IEEE80211_AC_BE] = { COGTRA_MIN_STDEV, COGTRA_MAX_STDEV, false, 2 },
+	[IEEE80211_AC_BK] = { COGTRA_MIN_STDEV, COGTRA_MAX_STDEV, false, 2 },
+#else
+	{ COGTRA_MIN_STDEV, COGTRA_MAX_STDEV, false, 2 },
+#endif
+};
+
 /* COGTRA Agressivness Self-Adjustment (ASA) */
 static inline int
 cogtra_asa (unsigned int last_mean, unsigned int curr_mean, u32 last_thp, 
-		u32 curr_thp, unsigned int stdev)
+		u32 curr_thp, unsigned int stdev, const struct cogtra_ac_policy *cap)
 {
 	/* Check for more than ASA_DELTA thp variation */
 	s32 delta = (s32)(last_thp / COGTRA_ASA_DELTA);
 	s32 diff = (s32)(curr_thp - last_thp);
 
 	if (abs (diff) > delta)
-		return min (stdev + 10, (unsigned int) COGTRA_MAX_STDEV);
+		return min (stdev + COGTRA_ASA_STEP, cap->max_stdev);
 	else
-		return max (stdev - 10, (unsigned int) COGTRA_MIN_STDEV);
+		return max (stdev - COGTRA_ASA_STEP, cap->min_stdev);
 } 
 
-/* COGTRA Normal random number generator. 
- * stdev parameter has to be stedv * 100 (to avoid FP operations) */
-static int
-rc80211_cogtra_normal_generator (int mean, int stdev_times100)
+/* Exploration state for the access category of a frame */
+static inline struct cogtra_ac *
+cogtra_ac_of (struct cogtra_priv *cp, struct cogtra_sta_info *ci,
+		struct sk_buff *skb)
 {
-	u32 rand = 0;
-	int value = 0;
-	int round_fac = 0;
-	unsigned int i = 0;
-
-	/* Convolution method to generate random normal numbers
-	 * Refer to "Raj Jain", "The art of computer systems performance analysis",
-	 * 1 edition, page 494.
-	 *
-	 * In LaTeX Syntax:
-	 * \mathcal{N}(\mu, \sigma) = \mu + \sigma
-	 * \dfrac{(\sum_{i=1}^{n}{\mathcal{U}_{i}}) -
-	 * \frac{n}{2}}{\sqrt{\frac{n}{12}}}
-	 *
-	 * Since we are using twelve integer uniform numbers of one byte (n in
-	 * [0,255]) instead of uniform numbers from 0 to 1, this code returns a
-	 * variable from a normal curve with mean of ((12 * 255)-12)/2 = 1524 and
-	 * stdev of 256 (1 byte) */
-	for (i = 0; i < 12; i++) {
-		get_random_bytes(&rand, 4);
-		value += (int)(rand & 0x000000FF);
-	}
-
-	/* Calculating a rouding factor used to avoid problems during integer
-	 * rounding. The following values were obtained from simulations. I'm still
-	 * not sure about this, but is working well... */
-	switch (stdev_times100) {
-	case 20:
-		round_fac = 40;
-		break;
-	case 25:
-		round_fac = 45;
-		break;
-	case 30:
-		round_fac = 50;
-		break;
-	case 35:
-		round_fac = 55;
-		break;
-	case 40:
-		round_fac = 57;
-		break;
-	case 45:
-		round_fac = 60;
-		break;
-	case 50:
-		round_fac = 63;
-		break;
-	case 55: case 60:
-		round_fac = 66;
-		break;
-	case 65: case 70:
-		round_fac = 68;
-		break;
-	case 75:
-		round_fac = 70;
-		break;
-	case 80:
-		round_fac = 72;
-		break;
-	case 85: case 90:
-		round_fac = 73;
-		break;
-	case 95:
-		round_fac = 74;
-		break;
-	case 100: case 105:
-		round_fac = 75;
-		break;
-	case 110: case 115:
-		round_fac = 76;
-		break;
-	case 120:
-		round_fac = 77;
-		break;
-	case 125:
-		round_fac = 78;
-		break;
-	case 130: case 135:
-		round_fac = 79;
-		break;
-	case 140: case 145:
-		round_fac = 80;
-		break;
-	case 150: case 155:
-		round_fac = 81;
-		break;
-	case 160: case 165: case 170:
-		round_fac = 82;
-		break;
-	case 175: case 180: case 185:
-		round_fac = 83;
-		break;
-	case 190: case 195:
-		round_fac = 84;
-		break;
-	case 200:
-		round_fac = 85;
-		break;
-	default:
-		if (stdev_times100 < 25)
-			round_fac = 40;
-		else
-			round_fac = 87;	
-	}
-
-	/* Converting the above normal random variable to the appropriate curve
-	 * from parameter mean and stdev (considering stdev_times100 = stdev * 100)
-	 * return mean + ((value - 1524) * stdev) / 256)) */
-	return (int)(mean + ((value - 1524) * stdev_times100)/(round_fac * 256));
+#ifdef COGTRA_USE_PER_AC
+	u16 ac = skb_get_queue_mapping (skb);
+
+	/* mac80211 only maps queues to access categories with 4 or more */
+	if (cp->hw->queues < COGTRA_NUM_ACS || ac >= COGTRA_NUM_ACS)
+		ac = COGTRA_AC_DATA;
+	return &ci->ac[ac];
+#else
+	return &ci->ac[0];
+#endif
 }
 
-
 /* Converting mac80211 rate index into local array index */
 static inline int
 rix_to_ndx (struct cogtra_sta_info *ci, int rix)
 {
-	int i;
-	for (i = ci->n_rates - 1; i >= 0; i--)
-		if (ci->r[i].rix == rix)
-			break;
-	return i;
+	if ((unsigned int) rix >= IEEE80211_MAX_SUPP_RATES)
+		return -1;
+	return ci->rix_ndx[rix];
 }
 
 
@@ -219,34 +136,42 @@ sort_bitrates (struct cogtra_sta_info *ci, int n_rates)
 /* cogtra_mrr_populate fill in the multirate retry chain in acordance with random
  * and best data rates*/
 static void
-cogtra_mrr_populate (struct cogtra_sta_info *ci)
+cogtra_mrr_populate (struct cogtra_sta_info *ci, struct cogtra_ac *ca,
+		const struct cogtra_ac_policy *cap)
 {
-	struct chain_table *ct = ci->t;
-	memset (ct, 0, 4 * sizeof (*ct));
+	/* Fill the chain not in use */
+	struct chain_table *ct = ca->t == ca->chain ?
+			ca->chain + COGTRA_MRR_STAGES : ca->chain;
+	memset (ct, 0, COGTRA_MRR_STAGES * sizeof (*ct));
 	
 	/* Random COGTRA rate */
 	ct[0].type = 0;	
-	ct[0].rix = ci->r[ci->random_rate_ndx].rix;
-	ct[0].bitrate = ci->r[ci->random_rate_ndx].bitrate;
-	ct[0].count = 2U;
+	ct[0].rix = ci->r[ca->random_rate_ndx].rix;
+	ct[0].bitrate = ci->r[ca->random_rate_ndx].bitrate;
+	ct[0].count = cap->count;
 
 	/* Best throughput */ 
 	ct[1].type = 1;	
 	ct[1].rix = ci->r[ci->max_tp_rate_ndx].rix;
 	ct[1].bitrate = ci->r[ci->max_tp_rate_ndx].bitrate;
-	ct[1].count = 2U;
+	ct[1].count = cap->count;
 
 	/* Best probability */
 	ct[2].type = 2;
 	ct[2].rix = ci->r[ci->max_prob_rate_ndx].rix;
 	ct[2].bitrate = ci->r[ci->max_prob_rate_ndx].bitrate;
-	ct[2].count = 2U; 
+	ct[2].count = cap->count; 
 
 	/* Lowest rate */
 	ct[3].type = 3;
 	ct[3].rix = ci->lowest_rix;
 	ct[3].bitrate = ci->r[0].bitrate;
-	ct[3].count = 2U;
+	ct[3].count = cap->count;
+
+	/* Publish the whole chain at once: get_rate on other cpus uses either the
+	 * previous chain or this one, never a mix of both */
+	smp_wmb ();
+	ca->t = ct;
 }
 
 
@@ -257,34 +182,46 @@ static void
 cogtra_update_stats (struct cogtra_priv *cp, struct cogtra_sta_info *ci, 
 		struct ieee80211_sta *sta)
 {
-	u32 usecs;
-	u32 max_tp = 0, max_prob = 0;
-	unsigned int i, max_tp_ndx, max_prob_ndx;
-	unsigned int old_stdev, old_mean;
-	u32 old_thp, new_thp;
+	u32 usecs, attempts, success;
+	u64 airtime;
+	u32 max_tp = 0, max_prob = 0, max_prob_tp = 0;
+	unsigned int i, a, max_tp_ndx, max_prob_ndx;
+	unsigned int old_mean;
+	u32 old_thp[COGTRA_NUM_ACS], new_thp;
+	struct cogtra_ac *data = &ci->ac[COGTRA_AC_DATA];
 	int random = 0;
 	unsigned long j, diff = 0;
+	unsigned int frames;
+	ktime_t start;
+#ifdef CONFIG_MAC80211_DEBUGFS
+	struct cogtra_hist_info *ht;
+#endif
 
+	/* Readers of the published stats retry while this update runs */
+	write_seqcount_begin (&ci->seq);
 	ci->up_stats_counter++;
+	frames = atomic_xchg (&ci->cycle_frames, 0);
 
-	old_stdev = ci->cur_stdev;
 	old_mean = ci->max_tp_rate_ndx;
-	old_thp = ci->r[ci->random_rate_ndx].avg_tp;
+	for (a = 0; a < COGTRA_NUM_ACS; a++)
+		old_thp[a] = ci->r[ci->ac[a].random_rate_ndx].avg_tp;
 
 	/* For each supported rate... */
 	for (i = 0; i < ci->n_rates; i++) {
 		struct cogtra_rate *cr = &ci->r[i]; 
 
+		cogtra_rate_hot_fold (&ci->h[i], &attempts, &success);
+
 		/* To avoid rounding issues, probabilities scale from 0 (0%)
 		 * to 1800 (100%) */
-		if (cr->attempts) {
+		if (attempts) {
 			
 			usecs = cr->perfect_tx_time;
 			if (!usecs)
 				usecs = 1000000;
 
 			/* Update thp and prob for last interval */
-			cr->cur_prob = (cr->success * 1800) / cr->attempts;
+			cr->cur_prob = (success * 1800) / attempts;
 			cr->cur_tp = cr->cur_prob * (1000000 / usecs);
 
 			/* Update average thp and prob with EWMA */
@@ -295,81 +232,112 @@ cogtra_update_stats (struct cogtra_priv *cp, struct cogtra_sta_info *ci,
 					(cr->avg_tp * cp->ewma_level)) / 100 : cr->cur_tp;
 
 			/* Update success and attempt counters */
-			cr->succ_hist += cr->success;
-			cr->att_hist += cr->attempts;
+			cr->succ_hist += success;
+			cr->att_hist += attempts;
+
+			/* Accounting tx time spent on this rate */
+			airtime = (u64) attempts * cr->perfect_tx_time;
+			cr->airtime += airtime;
+			ci->tc.airtime += airtime;
 		}
 
 		/* Update success and attempt counters */
-		cr->last_success = cr->success;
-		cr->last_attempts = cr->attempts;
-		cr->success = 0;
-		cr->attempts = 0;
+		cr->last_success = success;
+		cr->last_attempts = attempts;
 	}
 
-	new_thp = ci->r[ci->random_rate_ndx].avg_tp;
-
-	/* Look for the rate with highest throughput and probability */
+	/* Look for the rate with highest throughput and probability; keep the
+	 * previous ones when no rate delivered anything yet. Rates go up in
+	 * bitrate, so ties in probability end on the faster rate; above
+	 * COGTRA_GOOD_PROB the one with highest throughput wins (minstrel) */
+	max_tp_ndx = ci->max_tp_rate_ndx;
+	max_prob_ndx = ci->max_prob_rate_ndx;
 	for (i = 0; i < ci->n_rates; i++) {
 		struct cogtra_rate *cr = &ci->r[i];
 		if (max_tp < cr->avg_tp) {
 			max_tp_ndx = i;
 			max_tp = cr->avg_tp;
 		}
-		if (max_prob < cr->avg_prob) {
+		if (!cr->avg_prob)
+			continue;
+		if (cr->avg_prob >= COGTRA_GOOD_PROB) {
+			if (max_prob < COGTRA_GOOD_PROB || max_prob_tp <= cr->avg_tp) {
+				max_prob_ndx = i;
+				max_prob = cr->avg_prob;
+				max_prob_tp = cr->avg_tp;
+			}
+		} else if (max_prob <= cr->avg_prob) {
 			max_prob_ndx = i;
 			max_prob = cr->avg_prob;
+			max_prob_tp = cr->avg_tp;
 		}
 	}
 	ci->max_tp_rate_ndx = max_tp_ndx;
 	ci->max_prob_rate_ndx = max_prob_ndx;
-	ci->update_counter = 0UL;
+	atomic_set (&ci->update_counter, 0);
 
 #ifdef CONFIG_MAC80211_DEBUGFS
 	/* History table information (remaining) for the past cycle: duration, avgsignal and MRR usage */
-	if (ci->dbg_idx < COGTRA_DEBUGFS_HIST_SIZE) {
-		// struct chain_table *ct = ci->t;
-		struct cogtra_hist_info *ht = &ci->hi[ci->dbg_idx];
+	j = jiffies;
+	diff = (long)j - (long)ci->last_time;
+	ci->last_time = j;
+
+	ht = rc_hist_entry (&ci->hist, ci->hist.idx, sizeof (*ht));
+	if (ht) {
+		struct chain_table *ct = data->t;
 		struct sta_info *si = container_of (sta, struct sta_info, sta);
 		struct ewma *avg = &si->avg_signal;
 
-		j = jiffies;
-		diff = (long)j - (long)ci->last_time;
 		ht->duration_ms = (int)(diff * 1000 / HZ);
-		ci->last_time = j;
 	
 		ht->avg_signal = (int)ewma_read (avg);
 		
-		// FIXME: parece nao estar funcionando... deixei de lado por enquanto
-		// ht->rand_pct = (int)((100*ct[0].suc) / ci->update_interval); 
-		// ht->best_pct = (int)((100*ct[1].suc) / ci->update_interval); 
-		// ht->prob_pct = (int)((100*ct[2].suc) / ci->update_interval); 
-		// ht->lowr_pct = (int)((100*ct[3].suc) / ci->update_interval); 
-		
-		ci->dbg_idx++;
+		/* MRR usage: the chain table is cleared at each cycle, so ct[i].suc
+		 * holds the frames delivered by stage i during this cycle. Shares are
+		 * relative to frames, not to update_interval (which counts attempts). */
+		if (frames) {
+			ht->rand_pct = (int)((100 * ct[0].suc) / frames);
+			ht->best_pct = (int)((100 * ct[1].suc) / frames);
+			ht->prob_pct = (int)((100 * ct[2].suc) / frames);
+			ht->lowr_pct = (int)((100 * ct[3].suc) / frames);
+		}
 	}
+	ci->hist.idx++;
 #endif
 
+	/* New random rate and mrr chain for each access category */
+	for (a = 0; a < COGTRA_NUM_ACS; a++) {
+		struct cogtra_ac *ca = &ci->ac[a];
+		const struct cogtra_ac_policy *cap = &cogtra_ac_policy[a];
+
 #ifdef COGTRA_USE_ASA
-	/* Adjusting stdev with CogTRA AAA */
-	ci->cur_stdev = cogtra_asa (old_mean, ci->max_tp_rate_ndx,
-			old_thp, new_thp, old_stdev);
+		/* Adjusting stdev with CogTRA AAA */
+		new_thp = ci->r[ca->random_rate_ndx].avg_tp;
+		ca->cur_stdev = cogtra_asa (old_mean, ci->max_tp_rate_ndx,
+				old_thp[a], new_thp, ca->cur_stdev, cap);
 #endif
 
-	/* Get a new random rate for next interval (using a normal distribution) */
-	random = rc80211_cogtra_normal_generator ((int)ci->max_tp_rate_ndx,
-			(int)ci->cur_stdev);
-	ci->random_rate_ndx = (unsigned int)(max (0, min (random,
-					(int)((int)(ci->n_rates) - 1))));
-	ci->r[ci->random_rate_ndx].times_called++;
+		/* Get a new random rate for next interval (using a normal distribution) */
+		start = rc_prof_start ();
+		random = cogtra_normal_sample (&ci->rand, &ca->nc, cap->robust ?
+				(int)ci->max_prob_rate_ndx : (int)ci->max_tp_rate_ndx,
+				(int)ca->cur_stdev, 0, (int)ci->n_rates - 1);
+		rc_prof_end (&ci->prof, RC_PROF_NORMAL, start);
+		ca->random_rate_ndx = (unsigned int)random;
 
-	cogtra_mrr_populate (ci);
+		cogtra_mrr_populate (ci, ca, cap);
+	}
+
+	/* #used counts updates, so only the data AC random rate (the one in
+	 * rc_history) is counted */
+	ci->r[data->random_rate_ndx].times_called++;
 
 #ifdef COGTRA_USE_ISA
 	/* Adjust update_interval dependending on the random rate */
 	/* RANDOM < BEST || RANDOM.PROB < 10% */
-	if ((ci->r[ci->random_rate_ndx].perfect_tx_time >
+	if ((ci->r[data->random_rate_ndx].perfect_tx_time >
 				ci->r[ci->max_tp_rate_ndx].perfect_tx_time) ||
-			(ci->r[ci->random_rate_ndx].avg_prob < 180)) 
+			(ci->r[data->random_rate_ndx].avg_prob < 180)) 
 		ci->update_interval = COGTRA_RECOVERY_INTERVAL;
 	else
 		ci->update_interval = COGTRA_UPDATE_INTERVAL;
@@ -377,32 +345,68 @@ cogtra_update_stats (struct cogtra_priv *cp, struct cogtra_sta_info *ci,
 
 #ifdef CONFIG_MAC80211_DEBUGFS
 	/* History table information for the next cycle*/
-	if (ci->dbg_idx < COGTRA_DEBUGFS_HIST_SIZE) {
-		struct cogtra_hist_info *ht = &ci->hi[ci->dbg_idx];
-
+	ht = rc_hist_entry (&ci->hist, ci->hist.idx, sizeof (*ht));
+	if (ht) {
 		diff = (long)j - (long)ci->first_time;
 		ht->start_ms = (int)(diff * 1000 / HZ);
 			
-		ht->rand_rate = ci->r[ci->random_rate_ndx].bitrate;
+		ht->rand_rate = ci->r[data->random_rate_ndx].bitrate;
 		ht->best_rate = ci->r[ci->max_tp_rate_ndx].bitrate;
-		ht->prob_rate = ci->r[ci->max_tp_rate_ndx].bitrate;
-		ht->cur_stdev = ci->cur_stdev;
+		ht->prob_rate = ci->r[ci->max_prob_rate_ndx].bitrate;
+		ht->cur_stdev = data->cur_stdev;
 		ht->pkt_interval = ci->update_interval;
 	}
 #endif
+
+	write_seqcount_end (&ci->seq);
+}
+
+
+/* cogtra_sta_snapshot copies what update_stats publishes for a station (rate
+ * stats, selected rates and mrr chain), all from the same update. It never
+ * holds update_stats back: the copy is just taken again when an update ran
+ * meanwhile. The caller releases it with kfree */
+struct cogtra_sta_snapshot *
+cogtra_sta_snapshot (struct cogtra_sta_info *ci, gfp_t gfp)
+{
+	struct cogtra_sta_snapshot *cs;
+	unsigned int n = ci->n_rates;	// only changes at rate_init
+	unsigned int a, seq;
+
+	cs = kmalloc (sizeof (*cs) + n * sizeof (*cs->r), gfp);
+	if (!cs)
+		return NULL;
+
+	do {
+		seq = read_seqcount_begin (&ci->seq);
+		cs->gen = ci->up_stats_counter;
+		cs->max_tp_rate_ndx = ci->max_tp_rate_ndx;
+		cs->max_prob_rate_ndx = ci->max_prob_rate_ndx;
+		cs->update_interval = ci->update_interval;
+		for (a = 0; a < COGTRA_NUM_ACS; a++) {
+			cs->random_rate_ndx[a] = ci->ac[a].random_rate_ndx;
+			cs->cur_stdev[a] = ci->ac[a].cur_stdev;
+		}
+		memcpy (cs->t, ci->ac[COGTRA_AC_DATA].t, sizeof (cs->t));
+		memcpy (cs->r, ci->r, n * sizeof (*cs->r));
+	} while (read_seqcount_retry (&ci->seq, seq));
+	cs->n_rates = n;
+
+	return cs;
 }
 
 
 /* cogtra_tx_status is called just after frame tx and it is used to update
  * statistics information for the used rate */
 static void
-cogtra_tx_status (void *priv, struct ieee80211_supported_band *sband, 
+__cogtra_tx_status (void *priv, struct ieee80211_supported_band *sband, 
 		struct ieee80211_sta *sta, void *priv_sta, struct sk_buff *skb)
 {
 	struct cogtra_sta_info *ci = priv_sta;
 	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(skb);
 	struct ieee80211_tx_rate *ar = info->status.rates;
-	struct chain_table *ct = ci->t;
+	struct cogtra_ac *ca = cogtra_ac_of (priv, ci, skb);
+	struct chain_table *ct = ca->t;
 	int i, ndx;
 	int success;
  
@@ -422,25 +426,137 @@ cogtra_tx_status (void *priv, struct ieee80211_supported_band *sband,
 			continue;
 	
 		/* Increasing attempts counter */
-		ci->r[ndx].attempts += ar[i].count;
-		ci->update_counter += ar[i].count;
+		atomic_add (ar[i].count, &ci->h[ndx].attempts);
+		atomic_add (ar[i].count, &ci->update_counter);
 		ct[i].att += ar[i].count;
+		ci->tc.attempts += ar[i].count;
+
+		/* Exploration: the first stage holds the random rate */
+		if ((i == 0) && (ndx == ca->random_rate_ndx) &&
+				(ndx != ci->max_tp_rate_ndx))
+			ci->tc.explore += ar[i].count;
 	
 		/* If it is the last used rate and resultesd in tx success, also
 		 * increse the success counter */
 		if (((i != IEEE80211_TX_MAX_RATES - 1) && (ar[i + 1].idx < 0)) ||
 				(i == IEEE80211_TX_MAX_RATES - 1)) {
-			ci->r[ndx].success += success;
+			atomic_add (success, &ci->h[ndx].success);
 			ct[i].suc += success;
 		}
 	}
+
+	ci->tc.frames++;
+	if (ca == &ci->ac[COGTRA_AC_DATA])
+		atomic_inc (&ci->cycle_frames);
+	if (!success)
+		ci->tc.lost++;
+}
+
+static void
+cogtra_tx_status (void *priv, struct ieee80211_supported_band *sband, 
+		struct ieee80211_sta *sta, void *priv_sta, struct sk_buff *skb)
+{
+	struct cogtra_sta_info *ci = priv_sta;
+	ktime_t start = rc_prof_start ();
+
+	__cogtra_tx_status (priv, sband, sta, priv_sta, skb);
+	rc_prof_end (&ci->prof, RC_PROF_TX_STATUS, start);
+}
+
+
+/* Runs update_stats for ci and lets the next interval trigger another one */
+static void
+cogtra_sta_update (struct cogtra_priv *cp, struct cogtra_sta_info *ci,
+		struct ieee80211_sta *sta)
+{
+	ktime_t start = rc_prof_start ();
+
+	cogtra_update_stats (cp, ci, sta);
+	rc_prof_end (&ci->prof, RC_PROF_UPDATE_STATS, start);
+	clear_bit_unlock (COGTRA_STA_UPDATING, &ci->flags);
+}
+
+#ifdef COGTRA_USE_DEFER
+static void
+cogtra_defer_sta_update (struct cogtra_priv *cp, struct cogtra_defer *cd)
+{
+	struct cogtra_sta_info *ci = container_of (cd, struct cogtra_sta_info, defer);
+
+	cogtra_sta_update (cp, ci, ci->sta);
+}
+
+/* cogtra_defer_update queues a station for the update tasklet. It is called
+ * once per interval, with COGTRA_STA_UPDATING just set */
+void
+cogtra_defer_update (struct cogtra_priv *cp, struct cogtra_defer *cd)
+{
+	spin_lock_bh (&cp->defer_lock);
+	if (list_empty (&cd->list))
+		list_add_tail (&cd->list, &cp->defer_list);
+	spin_unlock_bh (&cp->defer_lock);
+	tasklet_schedule (&cp->defer_task);
+}
+
+/* cogtra_defer_cancel takes a station out of the update queue and waits for
+ * an update that may be running on it, before the station is reset or freed.
+ * Returns true if the station was queued: its COGTRA_STA_UPDATING is then
+ * left set, for the caller to take over */
+bool
+cogtra_defer_cancel (struct cogtra_priv *cp, struct cogtra_defer *cd)
+{
+	bool queued;
+
+	spin_lock_bh (&cp->defer_lock);
+	queued = !list_empty (&cd->list);
+	list_del_init (&cd->list);
+	spin_unlock_bh (&cp->defer_lock);
+	tasklet_unlock_wait (&cp->defer_task);
+	return queued;
+}
+
+/* cogtra_defer_task updates all queued stations of the phy in a batch */
+static void
+cogtra_defer_task (unsigned long data)
+{
+	struct cogtra_priv *cp = (struct cogtra_priv *) data;
+	struct cogtra_defer *cd;
+
+	spin_lock (&cp->defer_lock);
+	while (!list_empty (&cp->defer_list)) {
+		cd = list_first_entry (&cp->defer_list, struct cogtra_defer, list);
+		list_del_init (&cd->list);
+		spin_unlock (&cp->defer_lock);
+
+		cd->update (cp, cd);
+
+		spin_lock (&cp->defer_lock);
+	}
+	spin_unlock (&cp->defer_lock);
+}
+#endif
+
+
+/* __cogtra_sta_lock takes COGTRA_STA_UPDATING from update_stats: it waits for
+ * an update running on another cpu, and takes over one queued for the
+ * tasklet (cd is NULL without COGTRA_USE_DEFER) */
+void
+__cogtra_sta_lock (struct cogtra_priv *cp, unsigned long *flags,
+		struct cogtra_defer *cd)
+{
+	while (test_and_set_bit_lock (COGTRA_STA_UPDATING, flags)) {
+#ifdef COGTRA_USE_DEFER
+		if (cogtra_defer_cancel (cp, cd))
+			return;
+#endif
+		cpu_relax ();
+	}
 }
 
 
 /* cogtra_get_rate is called just before each frame tx and sets the appropriate
  * data rate to be used */
 static void
-cogtra_get_rate (void *priv, struct ieee80211_sta *sta, void *priv_sta,
+__cogtra_get_rate (void *priv, struct ieee80211_sta *sta, void *priv_sta,
 		struct ieee80211_tx_rate_control *txrc)
 {
 	struct sk_buff *skb = txrc->skb;
@@ -448,6 +564,8 @@ cogtra_get_rate (void *priv, struct ieee80211_sta *sta, void *priv_sta,
 	struct cogtra_sta_info *ci = priv_sta;
 	struct cogtra_priv *cp = priv;
 	struct ieee80211_tx_rate *ar = info->control.rates;
+	struct cogtra_ac *ca;
+	struct chain_table *ct;
 	bool mrr;
 	int i;
 
@@ -459,32 +577,53 @@ cogtra_get_rate (void *priv, struct ieee80211_sta *sta, void *priv_sta,
 	/* Check MRR hardware support */
 	mrr = cp->has_mrr && !txrc->rts && !txrc->bss_conf->use_cts_prot;
 
-	/* Check the need of an update_stats based on update_interval */
-	if (ci->update_counter >= ci->update_interval)
-		cogtra_update_stats (cp, ci, sta);
+	/* Check the need of an update_stats based on update_interval. Only one
+	 * cpu runs (or queues) it, the others go on with the current rates */
+	if (atomic_read (&ci->update_counter) >= ci->update_interval &&
+			!test_and_set_bit_lock (COGTRA_STA_UPDATING, &ci->flags)) {
+#ifdef COGTRA_USE_DEFER
+		cogtra_defer_update (cp, &ci->defer);
+#else
+		cogtra_sta_update (cp, ci, sta);
+#endif
+	}
 
 	/* Setting up tx rate information. 
 	 * Be careful to convert ndx indexes into ieee80211_tx_rate indexes */
+	ca = cogtra_ac_of (cp, ci, skb);
 
 #ifdef COGTRA_USE_MRR
 	if (mrr) {
 		/* MRR setup */
-		for (i = 0; i < 4; i++) {
-			ar[i].idx = ci->t[i].rix;
-			ar[i].count = ci->t[i].count;
+		ct = ACCESS_ONCE (ca->t);
+		smp_read_barrier_depends ();
+		for (i = 0; i < COGTRA_MRR_STAGES; i++) {
+			ar[i].idx = ct[i].rix;
+			ar[i].count = ct[i].count;
 		}
 		return;	
 	}
 #endif
 
 	/* Executed when no MRR support or COGTRA_USE_MRR disable */	
-	ar[0].idx = ci->r[ci->random_rate_ndx].rix;
+	ar[0].idx = ci->r[ca->random_rate_ndx].rix;
 	ar[0].count = cp->max_retry;
 	ar[1].idx = -1;
 	ar[1].count = 0;
 	return;
 }
 
+static void
+cogtra_get_rate (void *priv, struct ieee80211_sta *sta, void *priv_sta,
+		struct ieee80211_tx_rate_control *txrc)
+{
+	struct cogtra_sta_info *ci = priv_sta;
+	ktime_t start = rc_prof_start ();
+
+	__cogtra_get_rate (priv, sta, priv_sta, txrc);
+	rc_prof_end (&ci->prof, RC_PROF_GET_RATE, start);
+}
+
 
 /* calc_rate_durations estimates the tx time for a single data frame of 1200
  * bytes and for an ack frame of standard size for a specific rate */
@@ -504,7 +643,7 @@ calc_rate_durations (struct ieee80211_local *local, struct cogtra_rate *cr,
 /* cogtra_rate_init is called after cogtra_alloc_sta to check and populate
  * information for supported rates */
 static void
-cogtra_rate_init (void *priv, struct ieee80211_supported_band *sband,
+__cogtra_rate_init (void *priv, struct ieee80211_supported_band *sband,
 		struct ieee80211_sta *sta, void *priv_sta)
 {
 	struct cogtra_sta_info *ci = priv_sta;
@@ -512,6 +651,18 @@ cogtra_rate_init (void *priv, struct ieee80211_supported_band *sband,
 	struct ieee80211_local *local = hw_to_local(cp->hw);
 	struct ieee80211_rate *ctl_rate;
 	unsigned int i, n = 0;
+#ifdef CONFIG_MAC80211_DEBUGFS
+	struct cogtra_hist_info *ht;
+#endif
+
+	/* No update_stats may run on this station while it is set up, and
+	 * snapshots retry until it is */
+	cogtra_sta_lock (cp, ci);
+	write_seqcount_begin (&ci->seq);
+#ifdef COGTRA_USE_DEFER
+	ci->defer.update = cogtra_defer_sta_update;
+	ci->sta = sta;
+#endif
 
 	/* Get the lowest index rate and calculate the duration of a ack tx */
 	ci->lowest_rix = rate_lowest_index (sband, sta);
@@ -536,6 +687,12 @@ cogtra_rate_init (void *priv, struct ieee80211_supported_band *sband,
 
 	/* Sort rates based on bitrate */
 	sort_bitrates (ci, n);
+	memset (ci->h, 0, sizeof (*ci->h) * cp->max_rates);
+
+	/* Reverse map from mac80211 rate index to local array index */
+	memset (ci->rix_ndx, -1, sizeof (ci->rix_ndx));
+	for (i = 0; i < n; i++)
+		ci->rix_ndx[ci->r[i].rix] = i;
 
 	/* Mark unsupported rates with rix = -1 */
 	for (i = n; i < sband->n_bitrates; i++)
@@ -543,98 +700,155 @@ cogtra_rate_init (void *priv, struct ieee80211_supported_band *sband,
 
 #ifdef CONFIG_MAC80211_DEBUGFS
 	/* Filling information for this first rate adaptation */
-	ci->hi[0].start_ms = 0;
-	ci->hi[0].rand_rate = ci->hi[0].best_rate = ci->hi[0].prob_rate = ci->r[0].bitrate;
-	ci->hi[0].cur_stdev = COGTRA_MAX_STDEV;
-	ci->hi[0].pkt_interval = COGTRA_UPDATE_INTERVAL;
-	ci->dbg_idx = 0;
+	rc_hist_reset (&ci->hist, cp->phy_stats.hist_size);
+	ht = rc_hist_entry (&ci->hist, 0, sizeof (*ht));
+	if (ht) {
+		memset (ht, 0, sizeof (*ht));
+		ht->rand_rate = ht->best_rate = ht->prob_rate = ci->r[0].bitrate;
+		ht->cur_stdev = COGTRA_MAX_STDEV;
+		ht->pkt_interval = COGTRA_UPDATE_INTERVAL;
+	}
 #endif
 
+	memset (&ci->tc, 0, sizeof (ci->tc));
+	rc_rand_seed (&ci->rand, cp->seed, sta->addr);
+	atomic_set (&ci->cycle_frames, 0);
 	ci->update_interval = COGTRA_UPDATE_INTERVAL;	
-	ci->cur_stdev = COGTRA_MAX_STDEV;
 	ci->n_rates = n;
-	ci->update_counter = 0UL;
+
+	/* Exploration state for each access category, with its own mrr chains */
+	memset (ci->ac, 0, sizeof (ci->ac));
+	for (i = 0; i < COGTRA_NUM_ACS; i++) {
+		ci->ac[i].cur_stdev = cogtra_ac_policy[i].max_stdev;
+		ci->ac[i].chain = ci->chain + 2 * COGTRA_MRR_STAGES * i;
+		ci->ac[i].t = ci->ac[i].chain;
+	}
+
+	atomic_set (&ci->update_counter, 0);
 	ci->first_time = ci->last_time = jiffies;
+
+	write_seqcount_end (&ci->seq);
+	clear_bit_unlock (COGTRA_STA_UPDATING, &ci->flags);
+}
+
+static void
+cogtra_rate_init (void *priv, struct ieee80211_supported_band *sband,
+		struct ieee80211_sta *sta, void *priv_sta)
+{
+	struct cogtra_sta_info *ci = priv_sta;
+	struct cogtra_priv *cp = priv;
+	ktime_t start = rc_prof_start ();
+
+	__cogtra_rate_init (priv, sband, sta, priv_sta);
+	rc_prof_end (&ci->prof, RC_PROF_RATE_INIT, start);
+	rc_prof_end (&cp->phy_stats.prof, RC_PROF_RATE_INIT, start);
 }
 
 
 /* cogtra_alloc_sta is called every time a new station joins the networks */
 static void *
-cogtra_alloc_sta (void *priv, struct ieee80211_sta *sta, gfp_t gfp)
+__cogtra_alloc_sta (void *priv, struct ieee80211_sta *sta, gfp_t gfp)
 {
-	struct ieee80211_supported_band *sband;
 	struct cogtra_sta_info *ci;
 	struct cogtra_priv *cp = priv;
-	struct ieee80211_hw *hw = cp->hw;
-	int max_rates = 0;
-	int i;
 
-	ci = kzalloc (sizeof (struct cogtra_sta_info), gfp);
+	/* Station state, rates and mrr chain table come in a single object */
+	ci = kmem_cache_zalloc (cp->sta_cache, gfp);
 	if (!ci)
 		return NULL;
 
-	/* Get the maximum number of rates based on available bands */
-	for (i = 0; i < IEEE80211_NUM_BANDS; i++) {
-		sband = hw->wiphy->bands[i];
-		if (sband && sband->n_bitrates > max_rates)
-			max_rates = sband->n_bitrates;
-	}
-
-	/* Memory allocation for rates that can be used by this station */
-	ci->r = kzalloc (sizeof (struct cogtra_rate) * (max_rates), gfp);
-	if (!ci->r) {
-		kfree(ci);
-		return NULL;
-	}
-
-	/* Memory allocation for mrr chain table */
-	ci->t = kzalloc (sizeof (struct chain_table) * 4, gfp);
-	if (!ci->t) {
-		kfree(ci->r);
-		kfree(ci);
-		return NULL;
-	}
-
-#ifdef CONFIG_MAC80211_DEBUGFS
-	/* If in debugfs mode, memory allocation for history table */
-   	ci->hi = kzalloc (sizeof (struct cogtra_hist_info) * COGTRA_DEBUGFS_HIST_SIZE, gfp);
-	if (!ci->hi) {
-		kfree (ci->t);
-		kfree (ci->r);
-		kfree (ci);
-		return NULL;
-	}
+	ci->r = (struct cogtra_rate *) ((u8 *) ci + cp->sta_size);
+	ci->h = (struct cogtra_rate_hot *) (ci->r + cp->max_rates);
+	ci->chain = (struct chain_table *) (ci->h + cp->max_rates);
+	seqcount_init (&ci->seq);
+#ifdef COGTRA_USE_DEFER
+	INIT_LIST_HEAD (&ci->defer.list);
 #endif
 
+	rc_phy_sta_alloc (&cp->phy_stats, kmem_cache_size (cp->sta_cache));
+
 	return ci;
 }
 
+static void *
+cogtra_alloc_sta (void *priv, struct ieee80211_sta *sta, gfp_t gfp)
+{
+	struct cogtra_priv *cp = priv;
+	ktime_t start = rc_prof_start ();
+	void *priv_sta;
+
+	priv_sta = __cogtra_alloc_sta (priv, sta, gfp);
+	if (!priv_sta)
+		cp->phy_stats.alloc_fail++;
+	rc_prof_end (&cp->phy_stats.prof, RC_PROF_ALLOC_STA, start);
+	return priv_sta;
+}
+
 
 /* cogtra_free_sta used to release memory when a station leaves the network */
 static void
-cogtra_free_sta (void *priv, struct ieee80211_sta *sta, void *priv_sta)
+__cogtra_free_sta (void *priv, struct ieee80211_sta *sta, void *priv_sta)
 {
 	struct cogtra_sta_info *ci = priv_sta;
+	struct cogtra_priv *cp = priv;
 
-	kfree (ci->t);
-	kfree (ci->r);
+#ifdef COGTRA_USE_DEFER
+	cogtra_defer_cancel (cp, &ci->defer);
+#endif
+	rc_phy_sta_free (&cp->phy_stats, kmem_cache_size (cp->sta_cache));
 #ifdef CONFIG_MAC80211_DEBUGFS
-	kfree (ci->hi);
+	rc_hist_free (&ci->hist);
 #endif
-	kfree (ci);
+	kmem_cache_free (cp->sta_cache, ci);
+}
+
+static void
+cogtra_free_sta (void *priv, struct ieee80211_sta *sta, void *priv_sta)
+{
+	struct cogtra_priv *cp = priv;
+	ktime_t start = rc_prof_start ();
+
+	__cogtra_free_sta (priv, sta, priv_sta);
+	rc_prof_end (&cp->phy_stats.prof, RC_PROF_FREE_STA, start);
 }
 
 
-/* cogtra_alloc called once before turning on the wireless interface */
-static void *
-cogtra_alloc (struct ieee80211_hw *hw, struct dentry *debugfsdir)
+/* cogtra_priv_alloc sets up the phy for cogtra and cogtra_ht. Each station is
+ * a single object from a per-phy cache: sta_size bytes of station state,
+ * followed by the rate and counter arrays (sized for the largest band) and the
+ * two mrr chains of each access category */
+void *
+cogtra_priv_alloc (struct ieee80211_hw *hw, struct dentry *debugfsdir,
+		const char *name, size_t sta_size)
 {
+	struct ieee80211_supported_band *sband;
 	struct cogtra_priv *cp;
+	int i;
 
 	cp = kzalloc (sizeof (struct cogtra_priv), GFP_ATOMIC);
 	if (!cp)
 		return NULL;
 
+	/* Get the maximum number of rates based on available bands */
+	for (i = 0; i < IEEE80211_NUM_BANDS; i++) {
+		sband = hw->wiphy->bands[i];
+		if (sband && sband->n_bitrates > cp->max_rates)
+			cp->max_rates = sband->n_bitrates;
+	}
+
+	cp->sta_size = ALIGN (sta_size, __alignof__ (struct cogtra_rate));
+	snprintf (cp->sta_cache_name, sizeof (cp->sta_cache_name), "rc_%s_%s",
+			name, wiphy_name (hw->wiphy));
+	cp->sta_cache = kmem_cache_create (cp->sta_cache_name, cp->sta_size +
+			(sizeof (struct cogtra_rate) + sizeof (struct cogtra_rate_hot)) *
+			cp->max_rates +
+			sizeof (struct chain_table) * 2 * COGTRA_MRR_STAGES * COGTRA_NUM_ACS,
+			0, SLAB_HWCACHE_ALIGN, NULL);
+	if (!cp->sta_cache) {
+		kfree (cp);
+		return NULL;
+	}
+
 	/* Default cogtra values */
 	cp->ewma_level = COGTRA_EWMA_LEVEL;
 
@@ -642,15 +856,42 @@ cogtra_alloc (struct ieee80211_hw *hw, struct dentry *debugfsdir)
 	cp->max_retry = hw->max_rate_tries > 0 ? hw->max_rate_tries : 7;
 	cp->has_mrr = hw->max_rates >= 4 ? true : false;
 
+#ifdef COGTRA_USE_DEFER
+	spin_lock_init (&cp->defer_lock);
+	INIT_LIST_HEAD (&cp->defer_list);
+	tasklet_init (&cp->defer_task, cogtra_defer_task, (unsigned long) cp);
+#endif
+
+#ifdef CONFIG_MAC80211_DEBUGFS
+	rc_phy_add_debugfs (&cp->phy_stats, debugfsdir, &cp->seed, RC_HIST_SIZE);
+#endif
+
 	cp->hw = hw;
 	return cp;
 }
 
+/* cogtra_alloc called once before turning on the wireless interface */
+static void *
+cogtra_alloc (struct ieee80211_hw *hw, struct dentry *debugfsdir)
+{
+	return cogtra_priv_alloc (hw, debugfsdir, "cogtra",
+			sizeof (struct cogtra_sta_info));
+}
+
 
 /* cogtra_free called once before turning off the wireless interface */
 static void
 cogtra_free (void *priv)
 {
+	struct cogtra_priv *cp = priv;
+
+#ifdef CONFIG_MAC80211_DEBUGFS
+	rc_phy_remove_debugfs (&cp->phy_stats);
+#endif
+#ifdef COGTRA_USE_DEFER
+	tasklet_kill (&cp->defer_task);
+#endif
+	kmem_cache_destroy (cp->sta_cache);
 	kfree (priv);
 }
 
@@ -32,12 +32,45 @@
  */
 #define COGTRA_ASA_DELTA			10
 
+/* Stdev (times 100) added or removed by each ASA adjustment. Any value works,
+ * the normal sampler is not limited to multiples of 5 */
+#define COGTRA_ASA_STEP				10
+
 /* Use this flags to enable/disable ISA, ASA and MRR improvements */
 #define COGTRA_USE_ASA				
 #define COGTRA_USE_ISA
 #define COGTRA_USE_MRR
 
-#define COGTRA_DEBUGFS_HIST_SIZE	10000U
+/* Use this flag to take update_stats off the tx path: get_rate (tx_status in
+ * cogtra_ht) only queues the station, and a per-phy tasklet updates all queued
+ * stations at once. Frames keep using the previous mrr chain meanwhile */
+#define COGTRA_USE_DEFER
+
+/* Use this flag to keep a separate exploration state (normal curve, random
+ * rate and mrr chain) for each WMM access category, with the policies in
+ * cogtra_ac_policy. Rate statistics are still shared by all of them */
+#define COGTRA_USE_PER_AC
+
+/* Delivery probability (out of 1800) above which the most reliable rate is
+ * the fastest one, as in minstrel: 95% */
+#define COGTRA_GOOD_PROB			1710
+
+/* Fixed stdev for voice frames (COGTRA_USE_PER_AC) */
+#define COGTRA_VO_STDEV				40
+
+#ifdef COGTRA_USE_PER_AC
+#define COGTRA_NUM_ACS				4
+#define COGTRA_AC_DATA				IEEE80211_AC_BE		// AC shown in rc_history and used by ISA
+#else
+#define COGTRA_NUM_ACS				1
+#define COGTRA_AC_DATA				0
+#endif
+
+/* Number of stages in a mrr chain */
+#define COGTRA_MRR_STAGES			4
+
+/* Buffer space for each rc_history line */
+#define COGTRA_HIST_LINE_LEN		160
 
 struct chain_table {
 	unsigned int type;
@@ -48,6 +81,54 @@ struct chain_table {
 	u32 suc;
 };
 
+/* Delivery counters since rate_init, shown at the end of rc_stats */
+struct cogtra_tx_counters {
+	u64 frames;						// frames reported by tx_status
+	u64 lost;						// frames not acked after all attempts
+	u64 attempts;					// tx attempts on all rates
+	u64 airtime;					// tx time on all rates (usecs)
+	u64 explore;					// attempts on the random rate while it differs from the best one
+};
+
+
+/* Per-packet counters for a rate. They are kept in an array apart from
+ * cogtra_rate, so that tx_status for a whole mrr chain touches a single
+ * cache line. Folded into cogtra_rate at each update_stats.
+ *
+ * tx_status may run on a cpu while get_rate runs update_stats on another
+ * one, so the counters are atomic and update_stats takes them by swapping
+ * them with 0: attempts reported meanwhile go to the next interval instead
+ * of being lost. */
+struct cogtra_rate_hot {
+	atomic_t attempts;				// during current interval
+	atomic_t success;				// during current interval
+};
+
+/* Takes the counters of the interval that ends and starts a new one. A
+ * frame reported between both swaps may leave its success in the next
+ * interval, so success is kept below attempts */
+static inline void
+cogtra_rate_hot_fold (struct cogtra_rate_hot *ch, u32 *attempts, u32 *success)
+{
+	*attempts = atomic_xchg (&ch->attempts, 0);
+	*success = atomic_xchg (&ch->success, 0);
+	if (*success > *attempts)
+		*success = *attempts;
+}
+
+/* Bits in cogtra_sta_info.flags and cogtra_ht_sta.flags */
+#define COGTRA_STA_UPDATING			0	// update_stats queued or running on some cpu
+
+struct cogtra_priv;
+
+/* Station waiting for the per-phy update tasklet (COGTRA_USE_DEFER). The
+ * update callback runs update_stats for the station that holds this entry
+ * and clears COGTRA_STA_UPDATING */
+struct cogtra_defer {
+	struct list_head list;			// entry in cogtra_priv.defer_list
+	void (*update) (struct cogtra_priv *cp, struct cogtra_defer *cd);
+};
+
 
 /* cogtra_rate is allocated once for each available rate at each cogtra_sta_info.
  * Information in this struct is private to this rate at this station */ 
@@ -70,40 +151,70 @@ struct cogtra_rate {
 	/* Personalized retry count to avoid stall in the same packet */
 	unsigned int retry_count;
 
-	/* Tx success and attempts counters */
-	u32 success;					// during last interval
-	u32 attempts;					// during last interval
+	/* Tx success and attempts counters (current interval in cogtra_rate_hot) */
 	u64 succ_hist;					// since ever 
 	u64 att_hist;					// since ever
 	u32 last_attempts;				// before last cogtra_update_stats
 	u32 last_success;				// before last cogtra_update_stats
+	u64 airtime;					// tx time spent on this rate since ever (usecs)
 	
 	/* Number of times this rate was used by cogtra */
 	u32 times_called;
 };
 
 
+/* Exploration policy for an access category */
+struct cogtra_ac_policy {
+	unsigned int min_stdev;			// lower stdev limit for ASA
+	unsigned int max_stdev;			// upper stdev limit for ASA (and initial stdev)
+	bool robust;					// normal mean at the best probability rate (best thp otherwise)
+	unsigned int count;				// tries on each mrr stage
+};
+
+/* cogtra_ac is the exploration state for an access category (a single one
+ * without COGTRA_USE_PER_AC) at each cogtra_sta_info */
+struct cogtra_ac {
+	unsigned int cur_stdev;			// current normal stdev
+	unsigned int random_rate_ndx;	// random rate index (will be used in the next interval) 
+	struct cogtra_normal_cache nc;	// normal cdf for cur_stdev
+	struct chain_table *chain;		// two mrr chains, one in use and one being filled
+	struct chain_table *t;			// mrr chain in use (published by cogtra_mrr_populate)
+};
+
+
 /* cogtra_sta_info is allocated once per station. Information in this strcut
  * allows independed rate adaptation for each station */
 struct cogtra_sta_info {
-	unsigned int cur_stdev;			// current normal stdev
 	unsigned int max_tp_rate_ndx;	// index of rate with highest thp (current normal mean)
 	unsigned int max_prob_rate_ndx;	// index of rate with highest probability
-	unsigned int random_rate_ndx;	// random rate index (will be used in the next interval) 
 	unsigned int lowest_rix;		// lowest rate index 
 	unsigned int n_rates;			// number o supported rates 
-	unsigned long update_counter;	// pkt counter
+	atomic_t update_counter;		// pkt counter
     unsigned int update_interval; 	// pkts between cogtra_update_stats
-	unsigned long up_stats_counter;	// update stats counter
+	unsigned long up_stats_counter;	// update stats counter (generation of the published stats)
+	unsigned long flags;			// COGTRA_STA_* bits
+	seqcount_t seq;					// update_stats publishes rate stats, chain and history inside it
 	unsigned long last_time;		// jiffies for the last rate adaptation
 	unsigned long first_time;		// jiffies for the fist rate adaptation
+	atomic_t cycle_frames;			// COGTRA_AC_DATA frames reported since last cogtra_update_stats
 	
 	struct cogtra_rate *r;			// rate pointer for each station
-	struct chain_table *t;			// chain table pointer for mrr
+	s8 rix_ndx[IEEE80211_MAX_SUPP_RATES];	// r index for each mac80211 rate index (-1 if unsupported)
+	struct cogtra_rate_hot *h;		// per-packet counters for each rate (same index as r)
+	struct chain_table *chain;		// mrr chains for all access categories
+	struct cogtra_ac ac[COGTRA_NUM_ACS];	// exploration state for each access category
+
+	struct cogtra_tx_counters tc;	// delivery counters
+	struct rc_prof prof;			// per-call time accounting
+	struct rc_rand rand;			// random source for the normal generator
+
+#ifdef COGTRA_USE_DEFER
+	struct cogtra_defer defer;		// entry in the phy update queue
+	struct ieee80211_sta *sta;		// for deferred update_stats
+#endif
 
 #ifdef CONFIG_MAC80211_DEBUGFS
-	struct cogtra_hist_info *hi;	// history table (for the first COGTRA_DEBUGFS_HIST_SIZE rate adaptations)
-	unsigned int dbg_idx;			// history table index
+	struct rc_hist hist;			// history ring (most recent rate adaptations)
 	struct dentry *dbg_stats;		// debug rc_stats file pointer
 	struct dentry *dbg_hist;		// debug rc_history file pointer
 #endif
@@ -117,11 +228,44 @@ struct cogtra_priv {
 	bool has_mrr;				  	// mrr support
 	unsigned int max_retry;		  	// default max number o retries before frame discard
 	unsigned int ewma_level;	  	// ewma alpha for ammortize throughput.
+	u32 seed;						// random seed for new stations (0 for get_random_bytes)
+
+	/* Per-station objects: station state, rate arrays and mrr chain table */
+	struct kmem_cache *sta_cache;	// station object cache for this phy
+	char sta_cache_name[32];		// sta_cache name (must outlive the cache)
+	size_t sta_size;				// station state size (rate array offset)
+	unsigned int max_rates;			// number of rates in the largest band
+	unsigned int max_groups;		// MCS groups the phy can send (cogtra_ht only)
+
+	struct rc_phy_stats phy_stats;	// station setup accounting for this phy
+
+#ifdef COGTRA_USE_DEFER
+	/* Stations waiting for update_stats */
+	spinlock_t defer_lock;			// protects defer_list
+	struct list_head defer_list;	// queued cogtra_defer entries
+	struct tasklet_struct defer_task;	// runs update_stats for defer_list
+#endif
 };
 
 
 /* Common functions */
 extern struct rate_control_ops mac80211_cogtra;
+void *cogtra_priv_alloc (struct ieee80211_hw *hw, struct dentry *debugfsdir,
+		const char *name, size_t sta_size);
+#ifdef COGTRA_USE_DEFER
+void cogtra_defer_update (struct cogtra_priv *cp, struct cogtra_defer *cd);
+bool cogtra_defer_cancel (struct cogtra_priv *cp, struct cogtra_defer *cd);
+#endif
+void __cogtra_sta_lock (struct cogtra_priv *cp, unsigned long *flags,
+		struct cogtra_defer *cd);
+
+/* Takes COGTRA_STA_UPDATING of a cogtra_sta_info or cogtra_ht_sta before it
+ * is set up again */
+#ifdef COGTRA_USE_DEFER
+#define cogtra_sta_lock(cp, ci)	__cogtra_sta_lock (cp, &(ci)->flags, &(ci)->defer)
+#else
+#define cogtra_sta_lock(cp, ci)	__cogtra_sta_lock (cp, &(ci)->flags, NULL)
+#endif
 void cogtra_add_sta_debugfs (void *priv, void *priv_sta, struct dentry *dir);
 void cogtra_remove_sta_debugfs (void *priv, void *priv_sta);
 
@@ -131,6 +275,23 @@ struct cogtra_debugfs_info {
 	char buf[];
 };
 
+/* Copy of what update_stats publishes for a station, all from the same
+ * update (see cogtra_sta_snapshot) */
+struct cogtra_sta_snapshot {
+	unsigned long gen;				// up_stats_counter of this copy
+	unsigned int n_rates;			// number o supported rates
+	unsigned int random_rate_ndx[COGTRA_NUM_ACS];	// random rate index for each access category
+	unsigned int max_tp_rate_ndx;	// index of rate with highest thp
+	unsigned int max_prob_rate_ndx;	// index of rate with highest probability
+	unsigned int update_interval;	// pkts between cogtra_update_stats
+	unsigned int cur_stdev[COGTRA_NUM_ACS];	// current normal stdev for each access category
+	struct chain_table t[COGTRA_MRR_STAGES];	// COGTRA_AC_DATA mrr chain in use
+	struct cogtra_rate r[];			// n_rates rates
+};
+
+struct cogtra_sta_snapshot *cogtra_sta_snapshot (struct cogtra_sta_info *ci,
+		gfp_t gfp);
+
 /* Debugfs history table entry */
 struct cogtra_hist_info {
 	int start_ms;					// Time of rate adaptation (milisec)
@@ -146,7 +307,8 @@ struct cogtra_hist_info {
 	unsigned int cur_stdev;
 	unsigned int pkt_interval;
 
-	/* % of packages successfuly sent on each rate */
+	/* % of frames successfuly sent on each MRR stage (the remaining ones were
+	 * lost) */
 	int rand_pct;
 	int best_pct;
 	int prob_pct;
@@ -159,6 +321,8 @@ int cogtra_stats_open (struct inode *inode, struct file *file);
 ssize_t cogtra_stats_read (struct file *file, char __user *buf, size_t len, 
 		loff_t *ppos);
 int cogtra_stats_release (struct inode *inode, struct file *file);
+int cogtra_tx_counters_scnprintf (char *buf, size_t size,
+		struct cogtra_tx_counters *tc);
 
 #endif
 
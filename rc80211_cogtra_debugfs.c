@@ -54,7 +54,13 @@
 #include <linux/debugfs.h>
 #include <linux/ieee80211.h>
 #include <linux/slab.h>
+#include <linux/math64.h>
 #include <net/mac80211.h>
+#include "rc80211_prof.h"
+#include "rc80211_phy.h"
+#include "rc80211_random.h"
+#include "rc80211_hist.h"
+#include "rc80211_cogtra_normal.h"
 #include "rc80211_cogtra.h"
 
 /* Information for rc_stats file */
@@ -63,6 +69,7 @@ cogtra_stats_open (struct inode *inode, struct file *file)
 {
 	struct cogtra_sta_info *ci = inode->i_private;
 	struct cogtra_debugfs_info *cs;
+	struct cogtra_sta_snapshot *ss;
 	unsigned int i, avg_tp, avg_prob, cur_tp, cur_prob;
 	char *p;
 
@@ -70,24 +77,31 @@ cogtra_stats_open (struct inode *inode, struct file *file)
 	if (!cs)
 		return -ENOMEM;
 
+	/* Rate stats and mrr chain are printed from a consistent copy */
+	ss = cogtra_sta_snapshot (ci, GFP_KERNEL);
+	if (!ss) {
+		kfree (cs);
+		return -ENOMEM;
+	}
+
 	file->private_data = cs;
 	p = cs->buf;
 
 	/* Table header */
-	p += sprintf(p, "\n Rate Table:\n");
+	p += sprintf(p, "\n Rate Table (update %lu):\n", ss->gen);
 	p += sprintf(p, "    | rate | avg_thp | avg_pro | cur_thp | cur_pro | "
-			"succ ( atte ) | success | attempts | #used \n");
+			"succ ( atte ) | success | attempts | #used | airtime(ms)\n");
 
 	/* Table lines */
-	for (i = 0; i < ci->n_rates; i++) {
-		struct cogtra_rate *cr = &ci->r[i];
+	for (i = 0; i < ss->n_rates; i++) {
+		struct cogtra_rate *cr = &ss->r[i];
 
 		/* Print T for the rate with highest throughput (the mean of normal
 		 * curve), P for the rate with hisgest delivery probability and print *
 		 * for the rate been used now */
-		*(p++) = (i == ci->random_rate_ndx)		? '*' : ' ';
-		*(p++) = (i == ci->max_tp_rate_ndx) 	? 'T' : ' ';   
-		*(p++) = (i == ci->max_prob_rate_ndx) 	? 'P' : ' ';   
+		*(p++) = (i == ss->random_rate_ndx[COGTRA_AC_DATA])	? '*' : ' ';
+		*(p++) = (i == ss->max_tp_rate_ndx) 	? 'T' : ' ';   
+		*(p++) = (i == ss->max_prob_rate_ndx) 	? 'P' : ' ';   
 
 		p += sprintf(p, " |%3u%s ", cr->bitrate / 2,
 				(cr->bitrate & 1 ? ".5" : "  "));
@@ -101,7 +115,7 @@ cogtra_stats_open (struct inode *inode, struct file *file)
 		p += sprintf (
 				p, 
 				"| %5u.%1u | %7u | %5u.%1u | %7u "
-				"| %4u ( %4u ) | %7llu | %8llu | %5u\n",
+				"| %4u ( %4u ) | %7llu | %8llu | %5u | %11llu\n",
 				avg_tp / 10, avg_tp % 10,
 				avg_prob / 18,
 				cur_tp / 10, cur_tp % 10,
@@ -109,7 +123,8 @@ cogtra_stats_open (struct inode *inode, struct file *file)
 				cr->last_success, cr->last_attempts,
 				(unsigned long long) cr->succ_hist,
 				(unsigned long long) cr->att_hist,
-				cr->times_called
+				cr->times_called,
+				(unsigned long long) div_u64 (cr->airtime, 1000)
 			);
 	}
 
@@ -117,8 +132,8 @@ cogtra_stats_open (struct inode *inode, struct file *file)
 	p += sprintf(p, "\n MRR Chain Table:\n");
 	p += sprintf(p, " type |  rate | count | success | attempts \n");
 
-	for (i = 0; i < 4; i++) {
-		struct chain_table *ct = &ci->t[i];
+	for (i = 0; i < COGTRA_MRR_STAGES; i++) {
+		struct chain_table *ct = &ss->t[i];
 
 		p += sprintf (
 			p, 
@@ -137,12 +152,31 @@ cogtra_stats_open (struct inode *inode, struct file *file)
 			"   Current pkt interval: %u\n"
 			"   Current Normal Mean:  %u\n"
 		   	"   Current Normal Stdev: %u.%2u\n",
-			ci->n_rates,
-			ci->update_interval,
-			ci->max_tp_rate_ndx,
-			ci->cur_stdev / 100, ci->cur_stdev % 100
+			ss->n_rates,
+			ss->update_interval,
+			ss->max_tp_rate_ndx,
+			ss->cur_stdev[COGTRA_AC_DATA] / 100,
+			ss->cur_stdev[COGTRA_AC_DATA] % 100
 		);
 
+#ifdef COGTRA_USE_PER_AC
+	/* Random rate and stdev of each access category (rates and chain above
+	 * are the COGTRA_AC_DATA ones) */
+	for (i = 0; ss->n_rates && i < COGTRA_NUM_ACS; i++) {
+		struct cogtra_rate *cr = &ss->r[ss->random_rate_ndx[i]];
+
+		p += sprintf (p, "   AC %s: random %3u%s, stdev %u.%2u\n",
+				i == IEEE80211_AC_VO ? "VO" : i == IEEE80211_AC_VI ? "VI" :
+				i == IEEE80211_AC_BE ? "BE" : "BK",
+				cr->bitrate / 2, (cr->bitrate & 1 ? ".5" : "  "),
+				ss->cur_stdev[i] / 100, ss->cur_stdev[i] % 100);
+	}
+#endif
+	kfree (ss);
+
+	p += cogtra_tx_counters_scnprintf (p, cs->buf + 4096 - p, &ci->tc);
+	p += rc_prof_scnprintf (p, cs->buf + 4096 - p, &ci->prof);
+
 	cs->len = p - cs->buf;
 	return 0;
 }
@@ -153,29 +187,53 @@ cogtra_hist_open (struct inode *inode, struct file *file)
 {
 	struct cogtra_sta_info *ci = inode->i_private;
 	struct cogtra_debugfs_info *ch;
-	unsigned int i;
+	struct cogtra_hist_info *e;
+	unsigned long gen;
+	unsigned int i, first, last, seq;
 	char *p;
-	// int rest;
+	int rest;
+
+	/* Recording starts with the first open */
+	if (rc_hist_alloc (&ci->hist, sizeof (struct cogtra_hist_info)))
+		return -ENOMEM;
 
-	ch = kmalloc (sizeof (*ch) 
-			    + sizeof (struct cogtra_hist_info) * COGTRA_DEBUGFS_HIST_SIZE 
-				+ 1024, GFP_KERNEL);
+	ch = kmalloc (sizeof (*ch) + COGTRA_HIST_LINE_LEN *
+			(ci->hist.ring->mask + 1) + 1024, GFP_KERNEL);
 	if (!ch)
 		return -ENOMEM;
 
+	e = kmalloc (sizeof (*e) * (ci->hist.ring->mask + 1), GFP_KERNEL);
+	if (!e) {
+		kfree (ch);
+		return -ENOMEM;
+	}
+
+	/* Copy the entries written up to the same update_stats */
+	do {
+		seq = read_seqcount_begin (&ci->seq);
+		gen = ci->up_stats_counter;
+		last = ci->hist.idx;
+		first = rc_hist_first (&ci->hist, last + 1);
+		for (i = first; i < last; i++)
+			e[i - first] = *(struct cogtra_hist_info *)
+					rc_hist_entry (&ci->hist, i, sizeof (*e));
+	} while (read_seqcount_retry (&ci->seq, seq));
+
 	file->private_data = ch;
 	p = ch->buf;
 
 	/* Table header */
 	p += sprintf (p, "Cognitive Transmission Rate Adaptation (CogTRA)\n");
-	p += sprintf (p, "History Information Table\n"); 
-	p += sprintf (p, "Rate adaptations: %u (max of %u)\n\n", ci->dbg_idx, COGTRA_DEBUGFS_HIST_SIZE);
-	p += sprintf (p, "Idx | Start time | Duration | AvgSig | Random | BestThp | BestPro | Stdev | Pktint | MRR usage\n");
+	p += sprintf (p, "History Information Table (update %lu)\n", gen); 
+	p += sprintf (p, "Rate adaptations: %u (%u kept, ring of %u)\n\n", last,
+			last > first ? last - first : 0, ci->hist.ring->mask + 1);
+	p += sprintf (p, "Idx | Start time | Duration | AvgSig | Random | BestThp | BestPro | Stdev | Pktint | MRR usage (rand,best,prob,lowr,lost %%)\n");
 
 	/* Table lines */
-	for (i = 0; i < ci->dbg_idx && i < COGTRA_DEBUGFS_HIST_SIZE; i++) {
-		struct cogtra_hist_info	*t = &ci->hi[i];
-		// rest = 100 - t->rand_pct - t->best_pct - t->prob_pct - t->lowr_pct;
+	/* The slot of the current cycle holds no complete entry */
+	for (i = first; i < last; i++) {
+		struct cogtra_hist_info	*t = &e[i - first];
+		rest = 100 - t->rand_pct - t->best_pct - t->prob_pct - t->lowr_pct;
 
 		p += sprintf (p, "%3u | %10d | %8d | %6d | %4u%s | %5u%s | %5u%s | %2u.%2u | %6u | %3d,%3d,%3d,%3d,%3d\n", 
 				i,
@@ -187,24 +245,58 @@ cogtra_hist_open (struct inode *inode, struct file *file)
 				t->prob_rate / 2, (t->prob_rate & 1 ? ".5" : "  "),
 				t->cur_stdev / 100, t->cur_stdev % 100,
 				t->pkt_interval,
-				
-				// Nao estava funcionando direito entao deixei de lado...
-				0, 0, 0, 0, 0
-				// t->rand_pct > 100 ? 100 : t->rand_pct, 
-				// t->best_pct > 100 ? 100 : t->best_pct, 
-				// t->prob_pct > 100 ? 100 : t->prob_pct, 
-				// t->lowr_pct > 100 ? 100 : t->lowr_pct, 
-				// rest < 0 ? 0 : rest
+				t->rand_pct > 100 ? 100 : t->rand_pct, 
+				t->best_pct > 100 ? 100 : t->best_pct, 
+				t->prob_pct > 100 ? 100 : t->prob_pct, 
+				t->lowr_pct > 100 ? 100 : t->lowr_pct, 
+				rest < 0 ? 0 : rest
 			);
 	}
-
-	if (i == COGTRA_DEBUGFS_HIST_SIZE)
-		p += sprintf (p, "\n   *** Table Full... ***\n");
+	kfree (e);
 
 	ch->len = p - ch->buf;
 	return 0;
 }
 
+/* Delivery summary, shared by cogtra and cogtra_ht rc_stats files */
+int
+cogtra_tx_counters_scnprintf (char *buf, size_t size,
+		struct cogtra_tx_counters *tc)
+{
+	char *p = buf;
+	u64 acked = tc->frames - tc->lost;
+	u64 retries = tc->attempts > tc->frames ? tc->attempts - tc->frames : 0;
+	unsigned int loss = 0, retry_pf = 0, goodput = 0, explore = 0;
+
+	/* Loss and exploration in 0.1%, retries per frame in 0.01 and goodput in
+	 * 0.1 Mbps. Goodput considers a 1200-byte frame for each acked frame. */
+	if (tc->frames) {
+		loss = (unsigned int) div64_u64 (tc->lost * 1000, tc->frames);
+		retry_pf = (unsigned int) div64_u64 (retries * 100, tc->frames);
+	}
+	if (tc->attempts)
+		explore = (unsigned int) div64_u64 (tc->explore * 1000, tc->attempts);
+	if (tc->airtime)
+		goodput = (unsigned int) div64_u64 (acked * 96000, tc->airtime);
+
+	p += scnprintf (p, size, "\n Delivery Summary:\n"
+			"   Frames:            %llu\n"
+			"   Lost frames:       %llu (%u.%1u%%)\n"
+			"   Retries per frame: %u.%02u\n"
+			"   Airtime:           %llu ms\n"
+			"   Goodput:           %u.%1u Mbps\n"
+			"   Exploration:       %u.%1u%% of attempts\n",
+			(unsigned long long) tc->frames,
+			(unsigned long long) tc->lost, loss / 10, loss % 10,
+			retry_pf / 100, retry_pf % 100,
+			(unsigned long long) div_u64 (tc->airtime, 1000),
+			goodput / 10, goodput % 10,
+			explore / 10, explore % 10
+		);
+
+	return p - buf;
+}
+
 ssize_t
 cogtra_stats_read (struct file *file, char __user *buf, size_t len, loff_t *ppos)
 {
@@ -45,84 +45,23 @@
 #include <linux/types.h>
 #include <linux/skbuff.h>
 #include <linux/debugfs.h>
+#include <linux/interrupt.h>
 #include <linux/random.h>
 #include <linux/ieee80211.h>
 #include <linux/slab.h>
 #include <net/mac80211.h>
 #include "rate.h"
+#include "rc80211_prof.h"
+#include "rc80211_phy.h"
+#include "rc80211_random.h"
+#include "rc80211_hist.h"
+#include "rc80211_cogtra_normal.h"
 #include "rc80211_cogtra.h"
+#include "rc80211_mcs_groups.h"
 #include "rc80211_cogtra_ht.h"
 
 
 
-#define AVG_PKT_SIZE	1200
-
-/* Number of bits for an average sized packet */
-#define MCS_NBITS (AVG_PKT_SIZE << 3)
-
-/* Number of symbols for a packet with (bps) bits per symbol */
-#define MCS_NSYMS(bps) ((MCS_NBITS + (bps) - 1) / (bps))
-
-/* Transmission time for a packet containing (syms) symbols */
-#define MCS_SYMBOL_TIME(sgi, syms)                                      \
-        (sgi ?                                                          \
-          ((syms) * 18 + 4) / 5 :       /* syms * 3.6 us */             \
-          (syms) << 2                   /* syms * 4 us */               \
-        )
-
-/* Transmit duration for the raw data part of an average sized packet */
-#define MCS_DURATION(streams, sgi, bps) MCS_SYMBOL_TIME(sgi, MCS_NSYMS((streams) * (bps)))
-
-/* MCS rate information for an MCS group */
-#define MCS_GROUP(_streams, _sgi, _ht40) {                              \
-        .streams = _streams,                                            \
-        .flags =                                                        \
-                (_sgi ? IEEE80211_TX_RC_SHORT_GI : 0) |                 \
-                (_ht40 ? IEEE80211_TX_RC_40_MHZ_WIDTH : 0),             \
-        .duration = {                                                   \
-                MCS_DURATION(_streams, _sgi, _ht40 ? 54 : 26),          \
-                MCS_DURATION(_streams, _sgi, _ht40 ? 108 : 52),         \
-                MCS_DURATION(_streams, _sgi, _ht40 ? 162 : 78),         \
-                MCS_DURATION(_streams, _sgi, _ht40 ? 216 : 104),        \
-                MCS_DURATION(_streams, _sgi, _ht40 ? 324 : 156),        \
-                MCS_DURATION(_streams, _sgi, _ht40 ? 432 : 208),        \
-                MCS_DURATION(_streams, _sgi, _ht40 ? 486 : 234),        \
-                MCS_DURATION(_streams, _sgi, _ht40 ? 540 : 260)         \
-        }                                                               \
-}
-
-
-/*
- * To enable sufficiently targeted rate sampling, MCS rates are divided into
- * groups, based on the number of streams and flags (HT40, SGI) that they
- * use.
- */
-const struct mcs_group minstrel_mcs_groups[] = {
-	MCS_GROUP(1, 0, 0),
-	MCS_GROUP(2, 0, 0),
-#if MINSTREL_MAX_STREAMS >= 3
-	MCS_GROUP(3, 0, 0),
-#endif
-
-	MCS_GROUP(1, 1, 0),
-	MCS_GROUP(2, 1, 0),
-#if MINSTREL_MAX_STREAMS >= 3
-	MCS_GROUP(3, 1, 0),
-#endif
-
-	MCS_GROUP(1, 0, 1),
-	MCS_GROUP(2, 0, 1),
-#if MINSTREL_MAX_STREAMS >= 3
-	MCS_GROUP(3, 0, 1),
-#endif
-
-	MCS_GROUP(1, 1, 1),
-	MCS_GROUP(2, 1, 1),
-#if MINSTREL_MAX_STREAMS >= 3
-	MCS_GROUP(3, 1, 1),
-#endif
-};
-
 int groupFlag = 0; 
 
 static inline int cogtra_ht_aaa (unsigned int last_mean, unsigned int curr_mean, u32 last_thp, u32 curr_thp, unsigned int stdev) {
@@ -131,121 +70,11 @@ static inline int cogtra_ht_aaa (unsigned int last_mean, unsigned int curr_mean,
 	s32 diff = (s32)(curr_thp - last_thp);
 	
 	if (abs (diff) > delta)
-		return min (stdev + 10, (unsigned int) COGTRA_HT_MAX_STDEV);
+		return min (stdev + COGTRA_HT_ASA_STEP, (unsigned int) COGTRA_HT_MAX_STDEV);
 	else
-		return max (stdev - 10, (unsigned int) COGTRA_HT_MIN_STDEV);
+		return max (stdev - COGTRA_HT_ASA_STEP, (unsigned int) COGTRA_HT_MIN_STDEV);
 } 
 
-static int rc80211_cogtra_ht_normal_generator (int mean, int stdev_times100) {
-	u32 rand = 0;
-	int value = 0;
-	int round_fac = 0;
-	unsigned int i = 0;
-
-	/* Convolution method to generate random normal numbers
-	 * Refer to "Raj Jain", "The art of computer systems performance analysis",
-	 * 1 edition, page 494.
-	 *
-	 * In LaTeX Syntax:
-	 * \mathcal{N}(\mu, \sigma) = \mu + \sigma
-	 * \dfrac{(\sum_{i=1}^{n}{\mathcal{U}_{i}}) -
-	 * \frac{n}{2}}{\sqrt{\frac{n}{12}}}
-	 *
-	 * Since we are using twelve integer uniform numbers of one byte (n in
-	 * [0,255]) instead of uniform numbers from 0 to 1, this code returns a
-	 * variable from a normal curve with mean of ((12 * 255)-12)/2 = 1524 and
-	 * stdev of 256 (1 byte) */
-	for (i = 0; i < 12; i++) {
-		get_random_bytes(&rand, 4);
-		value += (int)(rand & 0x000000FF);
-	}
-
-	/* Calculating a rouding factor used to avoid problems during integer
-	 * rounding. The following values were obtained from simulations. I'm still
-	 * not sure about this, but is working well... */
-	switch (stdev_times100) {
-	case 25:
-		round_fac = 45;
-		break;
-	case 30:
-		round_fac = 50;
-		break;
-	case 35:
-		round_fac = 55;
-		break;
-	case 40:
-		round_fac = 57;
-		break;
-	case 45:
-		round_fac = 60;
-		break;
-	case 50:
-		round_fac = 63;
-		break;
-	case 55: case 60:
-		round_fac = 66;
-		break;
-	case 65: case 70:
-		round_fac = 68;
-		break;
-	case 75:
-		round_fac = 70;
-		break;
-	case 80:
-		round_fac = 72;
-		break;
-	case 85: case 90:
-		round_fac = 73;
-		break;
-	case 95:
-		round_fac = 74;
-		break;
-	case 100: case 105:
-		round_fac = 75;
-		break;
-	case 110: case 115:
-		round_fac = 76;
-		break;
-	case 120:
-		round_fac = 77;
-		break;
-	case 125:
-		round_fac = 78;
-		break;
-	case 130: case 135:
-		round_fac = 79;
-		break;
-	case 140: case 145:
-		round_fac = 80;
-		break;
-	case 150: case 155:
-		round_fac = 81;
-		break;
-	case 160: case 165: case 170:
-		round_fac = 82;
-		break;
-	case 175: case 180: case 185:
-		round_fac = 83;
-		break;
-	case 190: case 195:
-		round_fac = 84;
-		break;
-	case 200:
-		round_fac = 85;
-		break;
-	default:
-		if (stdev_times100 < 25)
-			round_fac = 40;
-		else
-			round_fac = 87;	
-	}
-
-	/* Converting the above normal random variable to the appropriate curve
-	 * from parameter mean and stdev (considering stdev_times100 = stdev * 100)
-	 * return mean + ((value - 1524) * stdev) / 256)) */
-	return (int)(mean + ((value - 1524) * stdev_times100)/(round_fac * 256));
-}
-
 /*
 static inline int minstrel_get_duration(int index) {
 	const struct mcs_group *group = &minstrel_mcs_groups[index / MCS_GROUP_RATES];
@@ -270,32 +99,69 @@ static void cogtra_ht_set_rate(struct ieee80211_tx_rate *rate, int index, bool s
 }
 
 static void cogtra_ht_tx_rate_populate(struct cogtra_ht_sta *ci) {
-	cogtra_ht_set_rate(&ci->tx_rates[0], ci->random_rate_mcs,true,false);
-	cogtra_ht_set_rate(&ci->tx_rates[1], ci->max_tp_rate_mcs,false,true);
-	cogtra_ht_set_rate(&ci->tx_rates[2], ci->max_prob_rate_mcs,false,true);
-	cogtra_ht_set_rate(&ci->tx_rates[3], 0, false,true);
+	/* Fill the chain not in use */
+	struct ieee80211_tx_rate *tx_rates = ci->tx_rates == ci->chain[0] ?
+			ci->chain[1] : ci->chain[0];
+
+	cogtra_ht_set_rate(&tx_rates[0], ci->random_rate_mcs,true,false);
+	cogtra_ht_set_rate(&tx_rates[1], ci->max_tp_rate_mcs,false,true);
+	cogtra_ht_set_rate(&tx_rates[2], ci->max_prob_rate_mcs,false,true);
+	cogtra_ht_set_rate(&tx_rates[3], 0, false,true);
+
+	/* Publish the whole chain at once: get_rate on other cpus uses either the
+	 * previous chain or this one, never a mix of both */
+	smp_wmb();
+	ci->tx_rates = tx_rates;
+}
+
+/* Supported rate of a group nearest to rate, the slower one on a tie */
+static inline int cogtra_ht_nearest_supported(u8 supported, int rate){
+	int d;
+
+	for (d = 0; d < MCS_GROUP_RATES; d++) {
+		if (rate - d >= 0 && (supported & BIT(rate - d)))
+			return rate - d;
+		if (rate + d < MCS_GROUP_RATES && (supported & BIT(rate + d)))
+			return rate + d;
+	}
+	return rate;
+}
+
+/* Group data for a minstrel_mcs_groups index (NULL if unsupported) */
+static inline struct minstrel_mcs_group_data * cogtra_ht_group(struct cogtra_ht_sta *ci, int group){
+	struct cogtra_ht_sta_priv *csp = container_of (ci, struct cogtra_ht_sta_priv, ht);
+	int g = ci->group_ndx[group];
+
+	return g < 0 ? NULL : &csp->groups[g];
 }
 
 static inline struct minstrel_rate_stats * minstrel_get_ratestats(struct cogtra_ht_sta *ci, int index){
-        return &ci->groups[index / MCS_GROUP_RATES].rates[index % MCS_GROUP_RATES];
+        return &cogtra_ht_group(ci, index / MCS_GROUP_RATES)->rates[index % MCS_GROUP_RATES];
 }
 
 static void cogtra_ht_update_stats (struct cogtra_priv *cp, struct cogtra_ht_sta *ci) {
+	struct cogtra_ht_sta_priv *csp = container_of (ci, struct cogtra_ht_sta_priv, ht);
 	struct minstrel_mcs_group_data *cg;
     struct minstrel_rate_stats *cr;
+	u32 attempts, success, ampdu_len, ampdu_packets;
+	u64 airtime;
 	
 	unsigned int random_rate_gix, random_rt, random_val_total;
 	unsigned int max_tp_rate_gix, max_tp_rate, tp_val_total;
 	unsigned int max_prob_rate_gix, max_prob_rate, prob_val_total;
 	int random_gix = 0;
-	int i,j;
+	int i,j,k;
+	ktime_t start;
 	
+	/* Readers of the published stats retry while this update runs */
+	write_seqcount_begin(&ci->seq);
 	ci->up_stats_counter++;
 	
-	if (ci->ampdu_packets > 0) {
-		ci->avg_ampdu_len = (MINSTREL_FRAC(ci->ampdu_len, ci->ampdu_packets) * (100 - cp->ewma_level)  +  ci->avg_ampdu_len * cp->ewma_level) / 100;
-		ci->ampdu_len = 0;
-		ci->ampdu_packets = 0;
+	/* Packets before length, the reverse of tx_status */
+	ampdu_packets = atomic_xchg(&ci->ampdu_packets, 0);
+	ampdu_len = atomic_xchg(&ci->ampdu_len, 0);
+	if (ampdu_packets > 0) {
+		ci->avg_ampdu_len = (MINSTREL_FRAC(ampdu_len, ampdu_packets) * (100 - cp->ewma_level)  +  ci->avg_ampdu_len * cp->ewma_level) / 100;
 	}
 
 	
@@ -305,9 +171,10 @@ static void cogtra_ht_update_stats (struct cogtra_priv *cp, struct cogtra_ht_sta
 	random_val_total = 0;
 	tp_val_total = 0;
 	prob_val_total = 0;
+	max_tp_rate_gix = max_prob_rate_gix = csp->groups[0].index;
 	
-	/* For each supported rate... */
-	for (i = 0; i < ARRAY_SIZE(minstrel_mcs_groups); i++) {
+	/* For each supported group... */
+	for (k = 0; k < ci->n_groups; k++) {
 		unsigned int old_stdev, old_mean;
 		u32 old_thp, new_thp;
 		
@@ -317,9 +184,8 @@ static void cogtra_ht_update_stats (struct cogtra_priv *cp, struct cogtra_ht_sta
 		unsigned int max_tp_gix = 0, max_prob_gix = 0;
 		u32 max_tp_value = 0, max_prob_value = 0;		
 		
-		cg = &ci->groups[i];
-		if (!cg->supported)
-			continue;
+		cg = &csp->groups[k];
+		i = cg->index;
 		
 		old_stdev 	= cg->cur_stdev;
 		old_mean 	= cg->max_tp_rate_gix;
@@ -334,18 +200,22 @@ static void cogtra_ht_update_stats (struct cogtra_priv *cp, struct cogtra_ht_sta
 			continue;
 			
 			cr = &cg->rates[j];
+			cogtra_rate_hot_fold(&csp->hot[k][j], &attempts, &success);
 			
 			/* To avoid rounding issues, probabilities scale from 0 (0%)
 			 * to 1800 (100%) */
-			if (cr->attempts) {
+			if (attempts) {
 				usecs = minstrel_mcs_groups[i].duration[j];
 				if (!usecs)
 					usecs = 1000000;
 
 				/* Update thp and prob for last interval */
-				cr->cur_prob 	= (cr->success * 1800) / cr->attempts;
+				cr->cur_prob 	= (success * 1800) / attempts;
 				
-				usecs += ci->overhead / MINSTREL_TRUNC(ci->avg_ampdu_len);
+				/* A packet counted in one interval and its length in
+				 * the previous one can bring the average below 1 */
+				usecs += ci->overhead /
+					max_t(u32, MINSTREL_TRUNC(ci->avg_ampdu_len), 1);
 				cr->cur_tp = (1000000 / usecs) * cr->cur_prob;
 				
 				/* Update average thp and prob with EWMA */
@@ -355,15 +225,18 @@ static void cogtra_ht_update_stats (struct cogtra_priv *cp, struct cogtra_ht_sta
 						(cr->avg_tp * cp->ewma_level)) / 100 : cr->cur_tp;
 
 				/* Update success and attempt counters */
-				cr->succ_hist += cr->success;
-				cr->att_hist += cr->attempts;
+				cr->succ_hist += success;
+				cr->att_hist += attempts;
+
+				/* Accounting tx time spent on this rate */
+				airtime = (u64) attempts * minstrel_mcs_groups[i].duration[j];
+				cr->airtime += airtime;
+				ci->tc.airtime += airtime;
 			}
 
 			/* Update success and attempt counters */
-			cr->last_success = cr->success;
-			cr->last_attempts = cr->attempts;
-			cr->success = 0;
-			cr->attempts = 0;
+			cr->last_success = success;
+			cr->last_attempts = attempts;
 			
 			/* Look for the rate with highest throughput and probability */
 			if (max_tp_value < cr->avg_tp) {
@@ -405,15 +278,23 @@ static void cogtra_ht_update_stats (struct cogtra_priv *cp, struct cogtra_ht_sta
 		ci->max_tp_rate_mcs = (max_tp_rate_gix * MCS_GROUP_RATES) + max_tp_rate;
 		ci->max_prob_rate_mcs = (max_prob_rate_gix * MCS_GROUP_RATES) + max_prob_rate;
 		
-		//Get the Random Group
-		random_rate_gix = rc80211_cogtra_ht_normal_generator((int)ci->max_tp_rate_mcs, (int)150) / 8;
-		random_rate_gix = (unsigned int) ( max( 0 , min( (int)random_rate_gix, (int)((int) ci->n_groups - 1))));
+		/* Random rates are drawn in group 0, or in the best group when the
+		 * station has no group 0 */
 		random_rate_gix = 0;
-		/* Get a new random of internal group */
-		random_rt = rc80211_cogtra_ht_normal_generator ((int)ci->groups[random_rate_gix].max_tp_rate_gix, (int) ci->groups[random_rate_gix].cur_stdev);
-		random_rt = (unsigned int)(max (0, min (random_rt, (int)((int)(MCS_GROUP_RATES) - 1))));
-		ci->groups[random_rate_gix].random_rate_gix = random_rt;
-		ci->groups[random_rate_gix].rates[random_rt].times_called++;
+		cg = cogtra_ht_group(ci, random_rate_gix);
+		if (!cg) {
+			random_rate_gix = max_tp_rate_gix;
+			cg = cogtra_ht_group(ci, random_rate_gix);
+		}
+		/* Get a new random of internal group, between its lowest and highest
+		 * supported rates and moved to a supported one if it falls in a gap */
+		start = rc_prof_start ();
+		random_rt = cogtra_normal_sample (&csp->rand, &csp->nc_rate, (int)cg->max_tp_rate_gix, (int) cg->cur_stdev,
+				ffs(cg->supported) - 1, fls(cg->supported) - 1);
+		random_rt = cogtra_ht_nearest_supported(cg->supported, random_rt);
+		rc_prof_end (&csp->prof, RC_PROF_NORMAL, start);
+		cg->random_rate_gix = random_rt;
+		cg->rates[random_rt].times_called++;
 		//Get the MCS of random
 		ci->random_rate_mcs = (random_rate_gix * MCS_GROUP_RATES) + random_rt;
 		
@@ -424,31 +305,47 @@ static void cogtra_ht_update_stats (struct cogtra_priv *cp, struct cogtra_ht_sta
 		/* RANDOM < BEST || RANDOM.PROB < 10% */
 		cr = minstrel_get_ratestats(ci,ci->random_rate_mcs);
 		if (( minstrel_mcs_groups[random_rate_gix].duration[random_rt] > minstrel_mcs_groups[max_tp_rate_gix].duration[max_tp_rate]) || 
-(ci->groups[random_rate_gix].rates[random_rt].avg_prob < 180)){
+(cr->avg_prob < 180)){
 			ci->update_interval = COGTRA_HT_RECOVERY_INTERVAL;
 		}else{
 			ci->update_interval = COGTRA_HT_UPDATE_INTERVAL;
 		}
 		
-		ci->update_counter = 0UL;
+		atomic_set(&ci->update_counter, 0);
+		write_seqcount_end(&ci->seq);
 }
 
-static int minstrel_ht_get_group_idx(struct ieee80211_tx_rate *rate) {
-	int streams = (rate->idx / MCS_GROUP_RATES) + 1;
-	u32 flags = IEEE80211_TX_RC_SHORT_GI | IEEE80211_TX_RC_40_MHZ_WIDTH;
-	int i;
-
-	for (i = 0; i < ARRAY_SIZE(minstrel_mcs_groups); i++) {
-		if (minstrel_mcs_groups[i].streams != streams)
-			continue;
-		if (minstrel_mcs_groups[i].flags != (rate->flags & flags))
-			continue;
+/* cogtra_ht_sta_snapshot copies what update_stats publishes for an HT station
+ * (group stats, selected rates and mrr chain), all from the same update. It
+ * never holds update_stats back: the copy is just taken again when an update
+ * ran meanwhile. The caller releases it with kfree */
+struct cogtra_ht_sta_snapshot *
+cogtra_ht_sta_snapshot (struct cogtra_ht_sta *ci, gfp_t gfp)
+{
+	struct cogtra_ht_sta_priv *csp = container_of (ci, struct cogtra_ht_sta_priv, ht);
+	struct cogtra_ht_sta_snapshot *cs;
+	unsigned int n = ci->n_groups;	// only changes at update_caps
+	unsigned int seq;
 
-		return i;
-	}
+	cs = kmalloc (sizeof (*cs) + n * sizeof (*cs->groups), gfp);
+	if (!cs)
+		return NULL;
 
-	WARN_ON(1);
-	return 0;
+	do {
+		seq = read_seqcount_begin (&ci->seq);
+		cs->gen = ci->up_stats_counter;
+		cs->n_rates = ci->n_rates;
+		cs->update_interval = ci->update_interval;
+		cs->avg_ampdu_len = ci->avg_ampdu_len;
+		cs->random_rate_mcs = ci->random_rate_mcs;
+		cs->max_tp_rate_mcs = ci->max_tp_rate_mcs;
+		cs->max_prob_rate_mcs = ci->max_prob_rate_mcs;
+		memcpy (cs->tx_rates, ci->tx_rates, sizeof (cs->tx_rates));
+		memcpy (cs->groups, csp->groups, n * sizeof (*cs->groups));
+	} while (read_seqcount_retry (&ci->seq, seq));
+	cs->n_groups = n;
+
+	return cs;
 }
 
 static bool minstrel_ht_txstat_valid(struct ieee80211_tx_rate *rate) {
@@ -492,14 +389,34 @@ minstrel_aggr_check(struct cogtra_priv *cp, struct cogtra_ht_sta *ci,
 	ieee80211_start_tx_ba_session(pubsta, tid, 5000);
 }
 
-static void cogtra_ht_tx_status (void *priv, struct ieee80211_supported_band *sband, struct ieee80211_sta *sta, void *priv_sta, struct sk_buff *skb){
+/* Runs update_stats for ci and lets the next interval trigger another one */
+static void
+cogtra_ht_sta_update (struct cogtra_priv *cp, struct cogtra_ht_sta *ci)
+{
+	struct cogtra_ht_sta_priv *csp = container_of (ci, struct cogtra_ht_sta_priv, ht);
+	ktime_t start = rc_prof_start ();
+
+	cogtra_ht_update_stats (cp, ci);
+	rc_prof_end (&csp->prof, RC_PROF_UPDATE_STATS, start);
+	clear_bit_unlock(COGTRA_STA_UPDATING, &ci->flags);
+}
+
+#ifdef COGTRA_USE_DEFER
+static void
+cogtra_ht_defer_sta_update (struct cogtra_priv *cp, struct cogtra_defer *cd)
+{
+	cogtra_ht_sta_update (cp, container_of (cd, struct cogtra_ht_sta, defer));
+}
+#endif
+
+static void __cogtra_ht_tx_status (void *priv, struct ieee80211_supported_band *sband, struct ieee80211_sta *sta, void *priv_sta, struct sk_buff *skb){
 	struct cogtra_ht_sta_priv *csp = priv_sta;
 	struct cogtra_ht_sta *ci = &csp->ht;
 	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(skb);
 	struct ieee80211_tx_rate *ar = info->status.rates;
-	struct minstrel_rate_stats *rate;
+	struct cogtra_rate_hot *rate;
 	struct cogtra_priv *cp = priv;
-	int i, last = 0,group;
+	int i, last = 0,group,g;
  
 	if(!csp->is_ht){
 		return mac80211_cogtra.tx_status(priv,sband, sta, &csp->legacy,skb);
@@ -517,8 +434,11 @@ static void cogtra_ht_tx_status (void *priv, struct ieee80211_supported_band *sb
 		info->status.ampdu_len = 1;
 	}
 	
-	ci->ampdu_packets++;
-	ci->ampdu_len += info->status.ampdu_len;
+	/* Length before packets: update_stats takes packets first, so the
+	 * lengths it takes always cover the packets it counts */
+	atomic_add(info->status.ampdu_len, &ci->ampdu_len);
+	smp_wmb();
+	atomic_inc(&ci->ampdu_packets);
 	for (i = 0; i < IEEE80211_TX_MAX_RATES; i++) {
 	
 		/* A rate idx -1 means that the following rates weren't used in tx */
@@ -526,40 +446,75 @@ static void cogtra_ht_tx_status (void *priv, struct ieee80211_supported_band *sb
 			break;
 			
 		group = minstrel_ht_get_group_idx(&ar[i]);
-		rate = &ci->groups[group].rates[ar[i].idx % 8];
+		g = ci->group_ndx[group];
+		if (g < 0)
+			continue;
+		rate = &csp->hot[g][ar[i].idx % 8];
 				
 		/* Increasing attempts counter */
-		rate->attempts += ar[i].count * info->status.ampdu_len;
-		ci->update_counter += ar[i].count * info->status.ampdu_len; //ampdu_len: number of aggregated frames. relevant only if IEEE80211_TX_STAT_AMPDU was set.
+		atomic_add(ar[i].count * info->status.ampdu_len, &rate->attempts);
+		atomic_add(ar[i].count * info->status.ampdu_len, &ci->update_counter); //ampdu_len: number of aggregated frames. relevant only if IEEE80211_TX_STAT_AMPDU was set.
+
+		ci->tc.attempts += ar[i].count * info->status.ampdu_len;
+
+		/* Exploration: the first stage holds the random rate */
+		if ((i == 0) && (ar[i].idx == ci->random_rate_mcs) &&
+				(ci->random_rate_mcs != ci->max_tp_rate_mcs))
+			ci->tc.explore += ar[i].count * info->status.ampdu_len;
 
 		
 	
 		/* If it is the last used rate and resultesd in tx success, also
 		 * increse the success counter */
 		if ((i != IEEE80211_TX_MAX_RATES - 1) && (ar[i + 1].idx < 0)) {
-			rate->success += info->status.ampdu_ack_len; // number of acked aggregated frames. relevant only if IEEE80211_TX_STAT_AMPDU was set.
+			atomic_add(info->status.ampdu_ack_len, &rate->success); // number of acked aggregated frames. relevant only if IEEE80211_TX_STAT_AMPDU was set.
 		}
 		
 	}
 	
-	/* Check the need of an update_stats based on update_interval */
-	if (ci->update_counter >= ci->update_interval)
-		cogtra_ht_update_stats (cp, ci);
+	ci->tc.frames += info->status.ampdu_len;
+	ci->tc.lost += info->status.ampdu_len - info->status.ampdu_ack_len;
+
+	/* Check the need of an update_stats based on update_interval. Only one
+	 * cpu runs (or queues) it, the others go on with the current rates */
+	if (atomic_read(&ci->update_counter) >= ci->update_interval &&
+			!test_and_set_bit_lock(COGTRA_STA_UPDATING, &ci->flags)) {
+#ifdef COGTRA_USE_DEFER
+		cogtra_defer_update (cp, &ci->defer);
+#else
+		cogtra_ht_sta_update (cp, ci);
+#endif
+	}
 		if (!(info->flags & IEEE80211_TX_CTL_AMPDU))
 			minstrel_aggr_check(cp, ci, sta, skb);
 	
 }
 
+static void
+cogtra_ht_tx_status (void *priv, struct ieee80211_supported_band *sband, struct ieee80211_sta *sta, void *priv_sta, struct sk_buff *skb) {
+	struct cogtra_ht_sta_priv *csp = priv_sta;
+	ktime_t start;
+
+	/* Legacy stations are accounted by cogtra itself */
+	if (!csp->is_ht)
+		return mac80211_cogtra.tx_status (priv, sband, sta, &csp->legacy, skb);
+
+	start = rc_prof_start ();
+	__cogtra_ht_tx_status (priv, sband, sta, priv_sta, skb);
+	rc_prof_end (&csp->prof, RC_PROF_TX_STATUS, start);
+}
+
 
 /* cogtra_ht_get_rate is called just before each frame tx and sets the appropriate
  * data rate to be used */
 static void
-cogtra_ht_get_rate (void *priv, struct ieee80211_sta *sta, void *priv_sta, struct ieee80211_tx_rate_control *txrc) {
+__cogtra_ht_get_rate (void *priv, struct ieee80211_sta *sta, void *priv_sta, struct ieee80211_tx_rate_control *txrc) {
 	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(txrc->skb);
 	struct ieee80211_tx_rate *ar = info->control.rates;
 	struct cogtra_ht_sta_priv *csp = priv_sta;
 	struct cogtra_ht_sta *ci = &csp->ht;
 	struct cogtra_priv *cp = priv;
+	struct ieee80211_tx_rate *tx_rates;
 	
 	bool mrr;
 	int i;	
@@ -579,20 +534,60 @@ cogtra_ht_get_rate (void *priv, struct ieee80211_sta *sta, void *priv_sta, struc
 	/* Check MRR hardware support */
 	mrr = cp->has_mrr && !txrc->rts && !txrc->bss_conf->use_cts_prot;
 
+	tx_rates = ACCESS_ONCE(ci->tx_rates);
+	smp_read_barrier_depends();
 	
 	if (!mrr) {
-		ar[0] = ci->tx_rates[0];
+		ar[0] = tx_rates[0];
 		ar[1].idx = -1;
 		ar[1].count = 0;
 		return;
 	}
 	
 	/* MRR setup */
-	for (i = 0; i < 4; i++) {
-		ar[i] = ci->tx_rates[i];
+	for (i = 0; i < COGTRA_MRR_STAGES; i++) {
+		ar[i] = tx_rates[i];
 	}
 }
 
+static void
+cogtra_ht_get_rate (void *priv, struct ieee80211_sta *sta, void *priv_sta, struct ieee80211_tx_rate_control *txrc) {
+	struct cogtra_ht_sta_priv *csp = priv_sta;
+	ktime_t start;
+
+	/* Legacy stations are accounted by cogtra itself */
+	if (!csp->is_ht)
+		return mac80211_cogtra.get_rate (priv, sta, &csp->legacy, txrc);
+
+	start = rc_prof_start ();
+	__cogtra_ht_get_rate (priv, sta, priv_sta, txrc);
+	rc_prof_end (&csp->prof, RC_PROF_GET_RATE, start);
+}
+
+
+/* Bitmap of the rates of minstrel_mcs_groups[group] that a peer with these
+ * HT capabilities can receive (0 if none) */
+static u8
+cogtra_ht_group_mask (u16 cap, const struct ieee80211_mcs_info *mcs, int group)
+{
+	const struct mcs_group *g = &minstrel_mcs_groups[group];
+	u16 req = 0;
+
+	if (g->flags & IEEE80211_TX_RC_SHORT_GI) {
+		if (g->flags & IEEE80211_TX_RC_40_MHZ_WIDTH)
+			req |= IEEE80211_HT_CAP_SGI_40;
+		else
+			req |= IEEE80211_HT_CAP_SGI_20;
+	}
+
+	if (g->flags & IEEE80211_TX_RC_40_MHZ_WIDTH)
+		req |= IEEE80211_HT_CAP_SUP_WIDTH_20_40;
+
+	if ((cap & req) != req)
+		return 0;
+
+	return mcs->rx_mask[g->streams - 1];
+}
 
 /* cogtra_ht_rate_init is called after cogtra_ht_alloc_sta to check and populate
  * information for supported rates */
@@ -605,21 +600,25 @@ cogtra_ht_update_caps (void *priv, struct ieee80211_supported_band *sband, struc
 	struct ieee80211_local *local = hw_to_local(cp->hw);
 	u16 sta_cap = sta->ht_cap.cap;
 	unsigned int i = 0;
-	int n_supported = 0;
 	int ack_dur;
 	int stbc;
+	u8 supported;
 
 	/* fall back to the old cogtra for legacy stations */
-	if(!sta->ht_cap.ht_supported){
-		csp->is_ht = false;
-		memset(&csp->legacy, 0, sizeof(csp->legacy));
-		csp->legacy.r = csp->r;
-		csp->legacy.t = csp->t;
-		return mac80211_cogtra.rate_init(priv,sband,sta,&csp->legacy);
+	if(!sta->ht_cap.ht_supported || !cp->max_groups)
+		goto legacy;
+
+	/* No update_stats may run on this station while it is set up again, and
+	 * snapshots retry until it is. Frames in flight may still run get_rate
+	 * and tx_status: the chain in use and the group storage stay valid, and
+	 * a legacy station only becomes HT once it is set up */
+	cogtra_sta_lock(cp, ci);
+	write_seqcount_begin(&ci->seq);
+	if (!csp->is_ht) {
+		memset(ci->chain, 0, sizeof(ci->chain));
+		ci->tx_rates = ci->chain[0];
 	}
-
-	csp->is_ht = true;
-	memset(ci,0,sizeof(*ci));
+	memset(&ci->overhead, 0, sizeof(*ci) - offsetof(struct cogtra_ht_sta, overhead));
 
 	ack_dur = ieee80211_frame_duration(local, 10, 60, 1, 1);
 	ci->overhead = ieee80211_frame_duration(local, 0, 60, 1, 1) + ack_dur;
@@ -638,54 +637,67 @@ cogtra_ht_update_caps (void *priv, struct ieee80211_supported_band *sband, struc
 	    oper_chan_type != NL80211_CHAN_HT40PLUS)
 		sta_cap &= ~IEEE80211_HT_CAP_SUP_WIDTH_20_40;
 
-	for (i = 0; i < ARRAY_SIZE(ci->groups); i++) {
-		u16 req = 0;
-
-		ci->groups[i].supported = 0;
-		if (minstrel_mcs_groups[i].flags & IEEE80211_TX_RC_SHORT_GI) {
-			if (minstrel_mcs_groups[i].flags & IEEE80211_TX_RC_40_MHZ_WIDTH)
-				req |= IEEE80211_HT_CAP_SGI_40;
-			else
-				req |= IEEE80211_HT_CAP_SGI_20;
-		}
-
-		if (minstrel_mcs_groups[i].flags & IEEE80211_TX_RC_40_MHZ_WIDTH)
-			req |= IEEE80211_HT_CAP_SUP_WIDTH_20_40;
+	/* The supported groups take the first n_groups entries of the storage,
+	 * which has room for every group the phy can send */
+	memset(ci->group_ndx, -1, sizeof(ci->group_ndx));
+	for (i = 0; i < ARRAY_SIZE(minstrel_mcs_groups); i++) {
+		struct minstrel_mcs_group_data *cg;
 
-		if ((sta_cap & req) != req)
+		supported = cogtra_ht_group_mask(sta_cap, mcs, i);
+		if (!supported || ci->n_groups == cp->max_groups)
 			continue;
 
-		ci->groups[i].supported =
-			mcs->rx_mask[minstrel_mcs_groups[i].streams - 1];
-
-		if (ci->groups[i].supported){
-			n_supported++;
-			ci->groups[i].cur_stdev = COGTRA_HT_MAX_STDEV;
-		}
+		cg = &csp->groups[ci->n_groups];
+		memset(cg, 0, sizeof(*cg));
+		memset(csp->hot[ci->n_groups], 0, sizeof(*csp->hot));
+		ci->group_ndx[i] = ci->n_groups++;
+		cg->index = i;
+		cg->supported = supported;
+		cg->cur_stdev = COGTRA_HT_MAX_STDEV;
 	}
 
-	if (!n_supported){
-		csp->is_ht = false;
-		memset(&csp->legacy, 0, sizeof(csp->legacy));
-		csp->legacy.r = csp->r;
-		csp->legacy.t = csp->t;
-		return mac80211_cogtra.rate_init(priv,sband,sta,&csp->legacy);
+	if (!ci->n_groups) {
+		write_seqcount_end(&ci->seq);
+		clear_bit_unlock(COGTRA_STA_UPDATING, &ci->flags);
+		goto legacy;
 	}
-	
-	ci->n_groups = n_supported;
+
 	ci->n_rates = ci->n_groups * MCS_GROUP_RATES;
 
 	/*Antes no alloc_sta()*/
 	ci->update_interval = COGTRA_HT_UPDATE_INTERVAL;
-	ci->update_counter = 0UL;
+	atomic_set(&ci->update_counter, 0);
+
+	/* Lowest rates of the first group until the first update_stats */
+	cogtra_ht_tx_rate_populate(ci);
+	write_seqcount_end(&ci->seq);
+	clear_bit_unlock(COGTRA_STA_UPDATING, &ci->flags);
+	smp_wmb();
+	csp->is_ht = true;
 
 	return;
+
+legacy:
+	/* The HT state is left as it is for frames still using it */
+	mac80211_cogtra.rate_init(priv,sband,sta,&csp->legacy);
+	smp_wmb();
+	csp->is_ht = false;
 }
 
 static void
 cogtra_ht_rate_init (void *priv, struct ieee80211_supported_band *sband, struct ieee80211_sta *sta, void *priv_sta) {
+	struct cogtra_ht_sta_priv *csp = priv_sta;
 	struct cogtra_priv *cp = priv;
+	ktime_t start = rc_prof_start ();
+
 	cogtra_ht_update_caps(priv, sband, sta, priv_sta, cp->hw->conf.channel_type);
+
+	/* Legacy stations are seeded and accounted by cogtra itself */
+	if (csp->is_ht) {
+		rc_rand_seed (&csp->rand, cp->seed, sta->addr);
+		rc_prof_end (&csp->prof, RC_PROF_RATE_INIT, start);
+		rc_prof_end (&cp->phy_stats.prof, RC_PROF_RATE_INIT, start);
+	}
 }
 
 static void
@@ -695,67 +707,122 @@ cogtra_ht_rate_update (void *priv, struct ieee80211_supported_band *sband, struc
 
 /* cogtra_ht_alloc_sta is called every time a new station joins the networks */
 static void *
-cogtra_ht_alloc_sta (void *priv, struct ieee80211_sta *sta, gfp_t gfp) {
-	struct ieee80211_supported_band *sband;
+__cogtra_ht_alloc_sta (void *priv, struct ieee80211_sta *sta, gfp_t gfp) {
 	struct cogtra_ht_sta_priv *csp;
 	struct cogtra_priv *cp = priv;
-	struct ieee80211_hw *hw = cp->hw;
-	int max_rates = 0;
-	int i;
-
 
-	csp = kzalloc (sizeof (struct cogtra_ht_sta_priv), gfp);
+	/* Station state, legacy rates and mrr chain table come in a single object */
+	csp = kmem_cache_zalloc (cp->sta_cache, gfp);
 	if (!csp)
 		return NULL;
 
-	/* Get the maximum number of rates based on available bands */
-	for (i = 0; i < IEEE80211_NUM_BANDS; i++) {
-		sband = hw->wiphy->bands[i];
-		if (sband && sband->n_bitrates > max_rates)
-			max_rates = sband->n_bitrates;
-	}
-
-	/* Memory allocation for rates that can be used by this station */
-	csp->r = kzalloc (sizeof (struct cogtra_rate) * (max_rates), gfp);
-	if (!csp->r) {
-		kfree(csp);
-		return NULL;
-	}
+	csp->r = (struct cogtra_rate *) ((u8 *) csp + cp->sta_size);
+	csp->h = (struct cogtra_rate_hot *) (csp->r + cp->max_rates);
+	csp->t = (struct chain_table *) (csp->h + cp->max_rates);
+	csp->groups = (struct minstrel_mcs_group_data *) ((u8 *) csp +
+			ALIGN (sizeof (*csp), __alignof__ (*csp->groups)));
+	csp->hot = (void *) (csp->groups + cp->max_groups);
+	csp->legacy.r = csp->r;
+	csp->legacy.h = csp->h;
+	csp->legacy.chain = csp->t;
+	seqcount_init (&csp->ht.seq);
+	seqcount_init (&csp->legacy.seq);
+#ifdef COGTRA_USE_DEFER
+	INIT_LIST_HEAD (&csp->ht.defer.list);
+	csp->ht.defer.update = cogtra_ht_defer_sta_update;
+	INIT_LIST_HEAD (&csp->legacy.defer.list);
+#endif
 
-	/* Memory allocation for mrr chain table */
-	csp->t = kzalloc (sizeof (struct chain_table) * 4, gfp);
-	if (!csp->t) {
-		kfree(csp->r);
-		kfree(csp);
-		return NULL;
-	}
+	rc_phy_sta_alloc (&cp->phy_stats, kmem_cache_size (cp->sta_cache));
 
 	return csp;
 }
 
+static void *
+cogtra_ht_alloc_sta (void *priv, struct ieee80211_sta *sta, gfp_t gfp) {
+	struct cogtra_priv *cp = priv;
+	ktime_t start = rc_prof_start ();
+	void *priv_sta;
+
+	priv_sta = __cogtra_ht_alloc_sta (priv, sta, gfp);
+	if (!priv_sta)
+		cp->phy_stats.alloc_fail++;
+	rc_prof_end (&cp->phy_stats.prof, RC_PROF_ALLOC_STA, start);
+	return priv_sta;
+}
+
 
 /* cogtra_ht_free_sta used to release memory when a station leaves the network */
 static void
-cogtra_ht_free_sta (void *priv, struct ieee80211_sta *sta, void *priv_sta) {
+__cogtra_ht_free_sta (void *priv, struct ieee80211_sta *sta, void *priv_sta) {
 	struct cogtra_ht_sta_priv *csp = priv_sta;
+	struct cogtra_priv *cp = priv;
+
+#ifdef COGTRA_USE_DEFER
+	/* Either side may still have an update queued */
+	cogtra_defer_cancel (cp, &csp->ht.defer);
+	cogtra_defer_cancel (cp, &csp->legacy.defer);
+#endif
 
-	kfree (csp->t);
-	kfree (csp->r);
-	kfree (csp);
+	rc_phy_sta_free (&cp->phy_stats, kmem_cache_size (cp->sta_cache));
+	kmem_cache_free (cp->sta_cache, csp);
 }
 
+static void
+cogtra_ht_free_sta (void *priv, struct ieee80211_sta *sta, void *priv_sta) {
+	struct cogtra_priv *cp = priv;
+	ktime_t start = rc_prof_start ();
+
+	__cogtra_ht_free_sta (priv, sta, priv_sta);
+	rc_prof_end (&cp->phy_stats.prof, RC_PROF_FREE_STA, start);
+}
+
+
+/* Largest number of minstrel_mcs_groups the phy can send in a band. Stations
+ * cannot use more (mac80211 masks their capabilities with the phy ones), so
+ * their group storage is sized for it once, in the station object */
+static unsigned int
+cogtra_ht_max_groups (struct ieee80211_hw *hw)
+{
+	struct ieee80211_supported_band *sband;
+	unsigned int max_groups = 0, n, i, b;
+
+	for (b = 0; b < IEEE80211_NUM_BANDS; b++) {
+		sband = hw->wiphy->bands[b];
+		if (!sband || !sband->ht_cap.ht_supported)
+			continue;
+
+		n = 0;
+		for (i = 0; i < ARRAY_SIZE(minstrel_mcs_groups); i++)
+			if (cogtra_ht_group_mask (sband->ht_cap.cap,
+					&sband->ht_cap.mcs, i))
+				n++;
+		max_groups = max (max_groups, n);
+	}
+
+	return max_groups;
+}
 
 /* chama o alloc do cogtra */
 static void *
 cogtra_ht_alloc (struct ieee80211_hw *hw, struct dentry *debugfsdir) {
-	return mac80211_cogtra.alloc(hw, debugfsdir);
+	struct cogtra_ht_sta_priv *csp;
+	unsigned int max_groups = cogtra_ht_max_groups (hw);
+	struct cogtra_priv *cp;
+
+	cp = cogtra_priv_alloc (hw, debugfsdir, "cogtra_ht",
+			ALIGN (sizeof (*csp), __alignof__ (*csp->groups)) + max_groups *
+			(sizeof (*csp->groups) + sizeof (*csp->hot)));
+	if (cp)
+		cp->max_groups = max_groups;
+	return cp;
 }
 
 
 /* cogtra_ht_free called once before turning off the wireless interface */
 static void
 cogtra_ht_free (void *priv){
-	kfree (priv);
+	mac80211_cogtra.free (priv);
 }
 
 struct rate_control_ops mac80211_cogtra_ht = {
@@ -13,36 +13,22 @@
 #ifndef __RC_COGTRA_HT_H
 #define __RC_COGTRA_HT_H
 
-/*
- * The number of streams can be changed to 2 to reduce code
- * size and memory footprint.
- */
-#define MINSTREL_MAX_STREAMS	3
-#define MINSTREL_STREAM_GROUPS	4
-#define MCS_GROUP_RATES	8
-/* scaled fraction values */
-#define MINSTREL_SCALE	16
-#define MINSTREL_FRAC(val, div) (((val) << MINSTREL_SCALE) / div)
-#define MINSTREL_TRUNC(val) ((val) >> MINSTREL_SCALE)
-
 /* Cogtra_HT custom code optimization */
 #define COGTRA_HT_MAX_STDEV			150
 #define COGTRA_HT_MIN_STDEV			40
+#define COGTRA_HT_ASA_STEP			10
 #define COGTRA_HT_EWMA_LEVEL			30
 #define COGTRA_HT_UPDATE_INTERVAL	    150
 #define COGTRA_HT_RECOVERY_INTERVAL	20
 
+/* Buffer space for each rate line of rc_stats, and for its header, chain,
+ * footer and summaries */
+#define COGTRA_HT_STATS_LINE_LEN		192
+#define COGTRA_HT_STATS_FIXED_LEN		2048
+
 extern struct chain_table;
 extern struct cogtra_rate;
 
-struct mcs_group {
-	u32 flags;
-	int streams;
-	unsigned int duration[MCS_GROUP_RATES];
-};
-
-extern const struct mcs_group minstrel_mcs_groups[];
-
 struct minstrel_rate_stats {
 	/* Devilery probability */
 	u32 cur_prob;					// prob for last interval (parts per thousand)
@@ -59,13 +45,12 @@ struct minstrel_rate_stats {
 	/* Personalized retry count to avoid stall in the same packet */
 	unsigned int retry_count;
 
-	/* Tx success and attempts counters */
-	u32 success;					// during last interval
-	u32 attempts;					// during last interval
+	/* Tx success and attempts counters (current interval in cogtra_ht_sta.hot) */
 	u64 succ_hist;					// since ever 
 	u64 att_hist;					// since ever
 	u32 last_attempts;				// before last cogtra_update_stats
 	u32 last_success;				// before last cogtra_update_stats
+	u64 airtime;					// tx time spent on this rate since ever (usecs)
 	
 	/* Number of times this rate was used by cogtra */
 	u32 times_called;
@@ -82,6 +67,9 @@ struct minstrel_rate_stats {
 };
 
 struct minstrel_mcs_group_data {
+	/* index of this group in minstrel_mcs_groups */
+	unsigned int index;
+
 	/* bitfield of supported MCS rates of this group */
 	u8 supported;
 
@@ -98,15 +86,24 @@ struct minstrel_mcs_group_data {
 
 struct cogtra_ht_sta{
 
-	struct ieee80211_tx_rate tx_rates[4];
+	struct ieee80211_tx_rate chain[2][COGTRA_MRR_STAGES];	// two mrr chains, one in use and one being filled
+	struct ieee80211_tx_rate *tx_rates;	// mrr chain in use (published by cogtra_ht_tx_rate_populate)
+
+	/* Set up once in alloc_sta: update_caps takes COGTRA_STA_UPDATING to
+	 * reinit the fields below and leaves these alone */
+	unsigned long flags;				// COGTRA_STA_* bits
+	seqcount_t seq;						// update_stats publishes group stats and chain inside it
+#ifdef COGTRA_USE_DEFER
+	struct cogtra_defer defer;		// entry in the phy update queue
+#endif
 
 	/* overhead time in usec for each frame */
 	unsigned int overhead;
 	unsigned int overhead_rtscts;
 	
 	/* ampdu length (average, per sampling interval) */
-	unsigned int ampdu_len;
-	unsigned int ampdu_packets;
+	atomic_t ampdu_len;
+	atomic_t ampdu_packets;
 
 	/* ampdu length (EWMA) */
 	unsigned int avg_ampdu_len;
@@ -119,14 +116,17 @@ struct cogtra_ht_sta{
 	unsigned int n_groups;				// number of actives MCS GROUPS
 	unsigned int n_rates;				// number o supported rates
 	
-	unsigned long update_counter;		// last update time (time based) or pkt counter (pkt based)
-    unsigned int update_interval; 		// time (or pkts) between cogtra_ht_update_stats
-	unsigned long up_stats_counter;		// update stats counter
+	atomic_t update_counter;			// pkt counter
+    unsigned int update_interval; 		// pkts between cogtra_ht_update_stats
+	unsigned long up_stats_counter;		// update stats counter (generation of the published stats)
 
 	/* tx flags to add for frames for this sta */
 	u32 tx_flags;
+
+	struct cogtra_tx_counters tc;		// delivery counters
 		
-	struct minstrel_mcs_group_data groups[MINSTREL_MAX_STREAMS * MINSTREL_STREAM_GROUPS];
+	/* The first n_groups of cogtra_ht_sta_priv.groups are the supported ones */
+	s8 group_ndx[MINSTREL_MAX_STREAMS * MINSTREL_STREAM_GROUPS];	// groups index for each minstrel_mcs_groups index (-1 if unsupported)
 	
 	unsigned long last_aggr_start_time[IEEE80211_QOS_CTL_TID_MASK + 1];
 #ifdef CONFIG_MAC80211_DEBUGFS
@@ -134,22 +134,48 @@ struct cogtra_ht_sta{
 #endif
 };
 
+/* The HT and legacy states are kept apart, not overlaid: update_caps builds
+ * one while frames in flight may still use the other through is_ht */
 struct cogtra_ht_sta_priv {
-	union {
-		struct cogtra_ht_sta ht;
-		struct cogtra_sta_info legacy;
-	};
+	struct cogtra_ht_sta ht;
+	struct cogtra_sta_info legacy;
 #ifdef CONFIG_MAC80211_DEBUGFS
 	struct dentry *dbg_stats;		// debug file pointer 
 #endif
 	struct cogtra_rate *r;	
+	struct cogtra_rate_hot *h;
 	struct chain_table *t;
+	/* Group storage for the phy's max_groups, in the station object too. It
+	 * stays in place for the station lifetime: update_caps only changes
+	 * ht.n_groups, so frames in flight never see it go away */
+	struct minstrel_mcs_group_data *groups;	// group data (HT only)
+	struct cogtra_rate_hot (*hot)[MCS_GROUP_RATES];	// per-packet counters, apart from groups to keep tx_status on one cache line (HT only)
+	struct rc_prof prof;			// per-call time accounting (HT only)
+	struct rc_rand rand;			// random source for the normal generator (HT only)
+	struct cogtra_normal_cache nc_rate;		// normal cdf for the rate draw (HT only)
 	bool is_ht;
 
 };
 
+/* Copy of what update_stats publishes for an HT station, all from the same
+ * update (see cogtra_ht_sta_snapshot) */
+struct cogtra_ht_sta_snapshot {
+	unsigned long gen;					// up_stats_counter of this copy
+	unsigned int n_rates;				// number o supported rates
+	unsigned int n_groups;				// number of actives MCS GROUPS
+	unsigned int update_interval;		// pkts between cogtra_ht_update_stats
+	unsigned int avg_ampdu_len;			// ampdu length (EWMA)
+	unsigned int random_rate_mcs;		// random mcs index
+	unsigned int max_tp_rate_mcs;		// index mcs with highest thp
+	unsigned int max_prob_rate_mcs;		// index mcs with highest probability
+	struct ieee80211_tx_rate tx_rates[COGTRA_MRR_STAGES];	// mrr chain in use
+	struct minstrel_mcs_group_data groups[];	// n_groups supported groups
+};
+
 /* Common functions */
 extern struct rate_control_ops mac80211_cogtra_ht;
+struct cogtra_ht_sta_snapshot *cogtra_ht_sta_snapshot (struct cogtra_ht_sta *ci,
+		gfp_t gfp);
 void cogtra_ht_add_sta_debugfs (void *priv, void *priv_sta, struct dentry *dir);
 void cogtra_ht_remove_sta_debugfs (void *priv, void *priv_sta);
 
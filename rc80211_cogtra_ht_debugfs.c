@@ -54,8 +54,15 @@
 #include <linux/debugfs.h>
 #include <linux/ieee80211.h>
 #include <linux/slab.h>
+#include <linux/math64.h>
 #include <net/mac80211.h>
+#include "rc80211_prof.h"
+#include "rc80211_phy.h"
+#include "rc80211_random.h"
+#include "rc80211_hist.h"
+#include "rc80211_cogtra_normal.h"
 #include "rc80211_cogtra.h"
+#include "rc80211_mcs_groups.h"
 #include "rc80211_cogtra_ht.h"
 
 int
@@ -64,8 +71,10 @@ cogtra_ht_stats_open (struct inode *inode, struct file *file)
 	struct cogtra_ht_sta_priv *csp = inode->i_private;
 	struct cogtra_ht_sta *ci = &csp->ht;
 	struct cogtra_debugfs_info *cs;
-	unsigned int i, j, avg_tp, avg_prob, cur_tp, cur_prob;
-	char *p;
+	struct cogtra_ht_sta_snapshot *ss;
+	unsigned int i, j, k, avg_tp, avg_prob, cur_tp, cur_prob;
+	size_t size;
+	char *p, *end;
 	int ret;
 	
 	if (!csp->is_ht) {
@@ -75,24 +84,35 @@ cogtra_ht_stats_open (struct inode *inode, struct file *file)
 		return ret;
 	}
 	
-	cs = kmalloc (sizeof (*cs) + 4096, GFP_KERNEL);
-	if (!cs)
+	/* Group stats and mrr chain are printed from a consistent copy */
+	ss = cogtra_ht_sta_snapshot (ci, GFP_KERNEL);
+	if (!ss)
 		return -ENOMEM;
 
+	/* One line per rate of each group, plus the chain and the summaries */
+	size = ss->n_groups * MCS_GROUP_RATES * COGTRA_HT_STATS_LINE_LEN +
+		COGTRA_HT_STATS_FIXED_LEN;
+	cs = kmalloc (sizeof (*cs) + size, GFP_KERNEL);
+	if (!cs) {
+		kfree (ss);
+		return -ENOMEM;
+	}
+
 	file->private_data = cs;
 	p = cs->buf;
+	end = cs->buf + size;
 
 	/* Table header */
-	p += sprintf(p, "\n Rate Table:\n");
-	p += sprintf(p, "             MCS  | avg_thp | avg_pro | cur_thp | cur_pro | "
-			"succ ( atte ) | success | attempts | #used \n");
+	p += scnprintf(p, end - p, "\n Rate Table (update %lu):\n", ss->gen);
+	p += scnprintf(p, end - p, "             MCS  | avg_thp | avg_pro | cur_thp | cur_pro | "
+			"succ ( atte ) | success | attempts | #used | airtime(ms)\n");
 
-	for (i = 0; i < MINSTREL_MAX_STREAMS * MINSTREL_STREAM_GROUPS; i++) {
+	for (k = 0; k < ss->n_groups; k++) {
+		struct minstrel_mcs_group_data *cg = &ss->groups[k];
 		char htmode = '2';
 		char gimode = 'L';
 
-		if (!ci->groups[i].supported)
-			continue;
+		i = cg->index;
 
 		if (minstrel_mcs_groups[i].flags & IEEE80211_TX_RC_40_MHZ_WIDTH)
 			htmode = '4';
@@ -100,19 +120,18 @@ cogtra_ht_stats_open (struct inode *inode, struct file *file)
 			gimode = 'S';
 
 		for (j = 0; j < MCS_GROUP_RATES; j++) {
-			struct minstrel_rate_stats *cr = &ci->groups[i].rates[j];
+			struct minstrel_rate_stats *cr = &cg->rates[j];
 			int idx = i * MCS_GROUP_RATES + j;
 
-			if (!(ci->groups[i].supported & BIT(j)))
+			if (!(cg->supported & BIT(j)))
 				continue;
 
-			p += sprintf(p, "HT%c0/%cGI ", htmode, gimode);
-
-			*(p++) = (idx == ci->random_rate_mcs)	? '*' : ' ';
-			*(p++) = (idx == ci->max_tp_rate_mcs) 	? 'T' : ' ';   
-			*(p++) = (idx == ci->max_prob_rate_mcs) ? 'P' : ' ';  
-
-			p += sprintf(p, " MCS%-2u", (minstrel_mcs_groups[i].streams - 1) *
+			p += scnprintf(p, end - p, "HT%c0/%cGI %c%c%c MCS%-2u",
+					htmode, gimode,
+					(idx == ss->random_rate_mcs)	? '*' : ' ',
+					(idx == ss->max_tp_rate_mcs) 	? 'T' : ' ',
+					(idx == ss->max_prob_rate_mcs) ? 'P' : ' ',
+					(minstrel_mcs_groups[i].streams - 1) *
 					MCS_GROUP_RATES + j);
 		
 			/* Converting the internal thp and prob format */
@@ -121,10 +140,10 @@ cogtra_ht_stats_open (struct inode *inode, struct file *file)
 			avg_prob = cr->avg_prob;
 			cur_prob = cr->cur_prob;
 
-			p += sprintf (
-				p, 
+			p += scnprintf (
+				p, end - p,
 				"| %5u.%1u | %7u | %5u.%1u | %7u "
-				"| %4u ( %4u ) | %7llu | %8llu | %5u\n",
+				"| %4u ( %4u ) | %7llu | %8llu | %5u | %11llu\n",
 				avg_tp / 10, avg_tp % 10,
 				avg_prob / 18,
 				cur_tp / 10, cur_tp % 10,
@@ -132,36 +151,41 @@ cogtra_ht_stats_open (struct inode *inode, struct file *file)
 				cr->last_success, cr->last_attempts,
 				(unsigned long long) cr->succ_hist,
 				(unsigned long long) cr->att_hist,
-				cr->times_called
+				cr->times_called,
+				(unsigned long long) div_u64 (cr->airtime, 1000)
 			);
 		}
 	}
 	
 
 	/* Chain table  */
-	p += sprintf(p, "\n MRR Tx_Rate Table:\n");
-	p += sprintf(p, " idx \n");
+	p += scnprintf(p, end - p, "\n MRR Tx_Rate Table:\n");
+	p += scnprintf(p, end - p, " idx \n");
 
-	for (i = 0; i < 4; i++) {
-		struct ieee80211_tx_rate *tx = &ci->tx_rates[i];
-		p += sprintf (p, " %u\n",tx->idx);
+	for (i = 0; i < COGTRA_MRR_STAGES; i++) {
+		struct ieee80211_tx_rate *tx = &ss->tx_rates[i];
+		p += scnprintf (p, end - p, " %u\n",tx->idx);
 	}
 
 	/* Table footer */
-	p += sprintf(p, "\n Cognitive Transmission Rate Adaptation High Throughput(CogTRA_HT):\n"
+	p += scnprintf(p, end - p, "\n Cognitive Transmission Rate Adaptation High Throughput(CogTRA_HT):\n"
 			"   Number of rates:      %u\n"
 			"   Current pkt interval: %u\n"
 			"   Current Normal Mean:  %u\n",
 		   	//"   Current Normal Stdev: %u.%2u\n",
-			ci->n_rates,
-			ci->update_interval,
-			ci->max_tp_rate_mcs//,
+			ss->n_rates,
+			ss->update_interval,
+			ss->max_tp_rate_mcs//,
 			//ci->cur_stdev / 100, ci->cur_stdev % 100
 		);
 
-	p += sprintf(p,"   Average A-MPDU length: %d.%d\n",
-		MINSTREL_TRUNC(ci->avg_ampdu_len),
-		MINSTREL_TRUNC(ci->avg_ampdu_len * 10) % 10);
+	p += scnprintf(p, end - p, "   Average A-MPDU length: %d.%d\n",
+		MINSTREL_TRUNC(ss->avg_ampdu_len),
+		MINSTREL_TRUNC(ss->avg_ampdu_len * 10) % 10);
+	kfree (ss);
+
+	p += cogtra_tx_counters_scnprintf (p, end - p, &ci->tc);
+	p += rc_prof_scnprintf (p, end - p, &csp->prof);
 	cs->len = p - cs->buf;
 	return 0;
 }
@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2012 Luciano Jerez Chaves <luciano@lrc.ic.unicamp.br>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#include <linux/types.h>
+#include <linux/kernel.h>
+#include "rc80211_random.h"
+#include "rc80211_cogtra_normal.h"
+
+#define COGTRA_NORMAL_N_OFFSET		(2 * COGTRA_NORMAL_MAX_OFFSET + 1)
+
+/* Standard normal cdf, in units of 1 / COGTRA_NORMAL_SCALE, for x from 0 to
+ * COGTRA_NORMAL_PHI_MAX in steps of 1 / COGTRA_NORMAL_PHI_RES. Linear
+ * interpolation between entries is within one unit of the exact value. */
+#define COGTRA_NORMAL_PHI_RES		64
+#define COGTRA_NORMAL_PHI_MAX		5
+static const u16 cogtra_normal_phi[COGTRA_NORMAL_PHI_MAX * COGTRA_NORMAL_PHI_RES + 1] = {
+	16384, 16588, 16792, 16997, 17201, 17404, 17608, 17811, 18014, 18216,
+	18418, 18620, 18821, 19021, 19221, 19420, 19618, 19816, 20013, 20209,
+	20404, 20598, 20791, 20983, 21174, 21364, 21552, 21740, 21926, 22111,
+	22295, 22477, 22658, 22837, 23015, 23192, 23367, 23541, 23713, 23883,
+	24052, 24219, 24385, 24549, 24711, 24871, 25030, 25187, 25342, 25495,
+	25647, 25796, 25944, 26090, 26234, 26376, 26516, 26655, 26791, 26926,
+	27058, 27189, 27318, 27444, 27569, 27692, 27813, 27932, 28049, 28164,
+	28278, 28389, 28499, 28606, 28712, 28815, 28917, 29017, 29115, 29212,
+	29306, 29399, 29489, 29578, 29666, 29751, 29835, 29917, 29997, 30075,
+	30152, 30227, 30301, 30373, 30443, 30512, 30579, 30644, 30708, 30771,
+	30832, 30891, 30950, 31006, 31061, 31115, 31168, 31219, 31269, 31317,
+	31365, 31411, 31455, 31499, 31541, 31583, 31623, 31662, 31699, 31736,
+	31772, 31807, 31840, 31873, 31905, 31936, 31965, 31994, 32023, 32050,
+	32076, 32102, 32126, 32150, 32174, 32196, 32218, 32239, 32259, 32279,
+	32298, 32316, 32334, 32351, 32367, 32383, 32399, 32414, 32428, 32442,
+	32455, 32468, 32480, 32492, 32504, 32515, 32526, 32536, 32546, 32555,
+	32565, 32573, 32582, 32590, 32598, 32605, 32612, 32619, 32626, 32632,
+	32639, 32644, 32650, 32655, 32661, 32666, 32670, 32675, 32679, 32683,
+	32687, 32691, 32695, 32698, 32702, 32705, 32708, 32711, 32714, 32716,
+	32719, 32721, 32724, 32726, 32728, 32730, 32732, 32734, 32736, 32737,
+	32739, 32740, 32742, 32743, 32744, 32746, 32747, 32748, 32749, 32750,
+	32751, 32752, 32753, 32754, 32754, 32755, 32756, 32757, 32757, 32758,
+	32758, 32759, 32759, 32760, 32760, 32761, 32761, 32762, 32762, 32762,
+	32763, 32763, 32763, 32764, 32764, 32764, 32764, 32765, 32765, 32765,
+	32765, 32765, 32765, 32766, 32766, 32766, 32766, 32766, 32766, 32766,
+	32766, 32767, 32767, 32767, 32767, 32767, 32767, 32767, 32767, 32767,
+	32767, 32767, 32767, 32767, 32767, 32767, 32767, 32768, 32768, 32768,
+	32768, 32768, 32768, 32768, 32768, 32768, 32768, 32768, 32768, 32768,
+	32768, 32768, 32768, 32768, 32768, 32768, 32768, 32768, 32768, 32768,
+	32768, 32768, 32768, 32768, 32768, 32768, 32768, 32768, 32768, 32768,
+	32768, 32768, 32768, 32768, 32768, 32768, 32768, 32768, 32768, 32768,
+	32768, 32768, 32768, 32768, 32768, 32768, 32768, 32768, 32768, 32768,
+	32768
+};
+
+/* Phi (num / den) for num >= 0, den > 0 */
+static u32
+cogtra_normal_phi_frac (u32 num, u32 den)
+{
+	u32 pos = num * COGTRA_NORMAL_PHI_RES;
+	u32 i = pos / den;
+	u32 rem = pos - i * den;
+
+	if (i >= COGTRA_NORMAL_PHI_MAX * COGTRA_NORMAL_PHI_RES)
+		return COGTRA_NORMAL_SCALE;
+
+	return cogtra_normal_phi[i] + ((cogtra_normal_phi[i + 1] -
+				cogtra_normal_phi[i]) * rem + den / 2) / den;
+}
+
+/* Offset cdf for stdev_times100. The offset is the normal curve N(0, stdev)
+ * rounded to the nearest integer, so P(offset <= o) = Phi ((o + 0.5) / stdev).
+ * Both halves come from the same Phi values, as the curve is symmetric. */
+static void
+cogtra_normal_fill (struct cogtra_normal_cache *nc, int stdev_times100)
+{
+	int o;
+
+	for (o = 0; o < COGTRA_NORMAL_MAX_OFFSET; o++) {
+		/* (o + 0.5) / stdev = ((2o + 1) * 50) / stdev_times100 */
+		u32 q = cogtra_normal_phi_frac ((2 * o + 1) * 50, stdev_times100);
+
+		nc->cdf[COGTRA_NORMAL_MAX_OFFSET + o] = q;
+		nc->cdf[COGTRA_NORMAL_MAX_OFFSET - 1 - o] = COGTRA_NORMAL_SCALE - q;
+	}
+	nc->cdf[COGTRA_NORMAL_N_OFFSET - 1] = COGTRA_NORMAL_SCALE;
+	nc->stdev = stdev_times100;
+}
+
+/* Draw a value in [lo, hi] from a discrete normal curve centred at mean and
+ * truncated to that interval: the mass outside [lo, hi] is spread over the
+ * values inside it in proportion to their own probability, instead of piling
+ * up on lo and hi. stdev parameter has to be stdev * 100 (to avoid FP
+ * operations) and can take any value; zero or less always returns mean. Only
+ * two random bytes are used per draw, and the lookup is a binary search over
+ * at most COGTRA_NORMAL_N_OFFSET entries. */
+int
+cogtra_normal_sample (struct rc_rand *rr, struct cogtra_normal_cache *nc,
+		int mean, int stdev_times100, int lo, int hi)
+{
+	unsigned int first, last, base, u;
+
+	mean = max (lo, min (mean, hi));
+	if (stdev_times100 <= 0)
+		return mean;
+
+	stdev_times100 = min (stdev_times100, COGTRA_NORMAL_MAX_STDEV);
+	if (nc->stdev != stdev_times100)
+		cogtra_normal_fill (nc, stdev_times100);
+
+	/* Table entries for the allowed offsets */
+	first = max (lo - mean, -COGTRA_NORMAL_MAX_OFFSET) + COGTRA_NORMAL_MAX_OFFSET;
+	last = min (hi - mean, COGTRA_NORMAL_MAX_OFFSET) + COGTRA_NORMAL_MAX_OFFSET;
+
+	/* Uniform u in [cdf(first - 1), cdf(last)), without a division. Offset 0
+	 * is always allowed and has non-zero mass, so the interval is not empty */
+	base = first ? nc->cdf[first - 1] : 0;
+	u = base + ((rc_rand_u16 (rr) * (nc->cdf[last] - base)) >> 16);
+
+	/* Find the first allowed offset whose cdf is above u */
+	while (first < last) {
+		unsigned int mid = (first + last) / 2;
+
+		if (u < nc->cdf[mid])
+			last = mid;
+		else
+			first = mid + 1;
+	}
+
+	return mean + (int)first - COGTRA_NORMAL_MAX_OFFSET;
+}
@@ -0,0 +1,30 @@
+/*
+ * Copyright (C) 2012 Luciano Jerez Chaves <luciano@lrc.ic.unicamp.br>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#ifndef __RC80211_COGTRA_NORMAL_H
+#define __RC80211_COGTRA_NORMAL_H
+
+/* Normal sampler shared by cogtra, cogtra_ht and cora. Any stdev (times 100)
+ * up to COGTRA_NORMAL_MAX_STDEV is accepted. Offsets from the mean are limited
+ * to +-COGTRA_NORMAL_MAX_OFFSET, which holds all but 3e-5 of the mass at the
+ * largest stdev. */
+#define COGTRA_NORMAL_MAX_STDEV		250
+#define COGTRA_NORMAL_MAX_OFFSET	10
+#define COGTRA_NORMAL_SCALE			(1 << 15)	// cdf of 1.0
+
+/* Offset cdf for a single stdev. Each user keeps one and it is only
+ * recomputed when the stdev changes. */
+struct cogtra_normal_cache {
+	int stdev;						// stdev (times 100) of cdf, 0 if not computed yet
+	u16 cdf[2 * COGTRA_NORMAL_MAX_OFFSET + 1];
+};
+
+int cogtra_normal_sample (struct rc_rand *rr, struct cogtra_normal_cache *nc,
+		int mean, int stdev_times100, int lo, int hi);
+
+#endif
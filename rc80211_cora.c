@@ -49,132 +49,19 @@
 #include <linux/slab.h>
 #include <net/mac80211.h>
 #include "rate.h"
+#include "rc80211_prof.h"
+#include "rc80211_phy.h"
+#include "rc80211_random.h"
+#include "rc80211_cogtra_normal.h"
 #include "rc80211_cora.h"
 
-/* CORA Normal random number generator. 
- * stdev parameter has to be stedv * 100 (to avoid FP operations) */
-static int
-rc80211_cora_normal_generator (int mean, int stdev_times100)
-{
-	u32 rand = 0;
-	int value = 0;
-	int round_fac = 0;
-	unsigned int i = 0;
-
-	/* Convolution method to generate random normal numbers
-	 * Refer to "Raj Jain", "The art of computer systems performance analysis",
-	 * 1 edition, page 494.
-	 *
-	 * In LaTeX Syntax:
-	 * \mathcal{N}(\mu, \sigma) = \mu + \sigma
-	 * \dfrac{(\sum_{i=1}^{n}{\mathcal{U}_{i}}) -
-	 * \frac{n}{2}}{\sqrt{\frac{n}{12}}}
-	 *
-	 * Since we are using twelve integer uniform numbers of one byte (n in
-	 * [0,255]) instead of uniform numbers from 0 to 1, this code returns a
-	 * variable from a normal curve with mean of ((12 * 255)-12)/2 = 1524 and
-	 * stdev of 256 (1 byte) */
-	for (i = 0; i < 12; i++) {
-		get_random_bytes(&rand, 4);
-		value += (int)(rand & 0x000000FF);
-	}
-
-	/* Calculating a rouding factor used to avoid problems during integer
-	 * rounding. The following values were obtained from simulations. I'm still
-	 * not sure about this, but is working well... */
-	switch (stdev_times100) {
-	case 25:
-		round_fac = 45;
-		break;
-	case 30:
-		round_fac = 50;
-		break;
-	case 35:
-		round_fac = 55;
-		break;
-	case 40:
-		round_fac = 57;
-		break;
-	case 45:
-		round_fac = 60;
-		break;
-	case 50:
-		round_fac = 63;
-		break;
-	case 55: case 60:
-		round_fac = 66;
-		break;
-	case 65: case 70:
-		round_fac = 68;
-		break;
-	case 75:
-		round_fac = 70;
-		break;
-	case 80:
-		round_fac = 72;
-		break;
-	case 85: case 90:
-		round_fac = 73;
-		break;
-	case 95:
-		round_fac = 74;
-		break;
-	case 100: case 105:
-		round_fac = 75;
-		break;
-	case 110: case 115:
-		round_fac = 76;
-		break;
-	case 120:
-		round_fac = 77;
-		break;
-	case 125:
-		round_fac = 78;
-		break;
-	case 130: case 135:
-		round_fac = 79;
-		break;
-	case 140: case 145:
-		round_fac = 80;
-		break;
-	case 150: case 155:
-		round_fac = 81;
-		break;
-	case 160: case 165: case 170:
-		round_fac = 82;
-		break;
-	case 175: case 180: case 185:
-		round_fac = 83;
-		break;
-	case 190: case 195:
-		round_fac = 84;
-		break;
-	case 200:
-		round_fac = 85;
-		break;
-	default:
-		if (stdev_times100 < 25)
-			round_fac = 40;
-		else
-			round_fac = 87;	
-	}
-
-	/* Converting the above normal random variable to the appropriate curve
-	 * from parameter mean and stdev (considering stdev_times100 = stdev * 100)
-	 * return mean + ((value - 1524) * stdev) / 256)) */
-	return (int)(mean + ((value - 1524) * stdev_times100)/(round_fac * 256));
-}
-
-
 /* Converting mac80211 rate index into local array index */
 static inline int
 rix_to_ndx (struct cora_sta_info *ci, int rix)
 {
-	int i;
-	for (i = ci->n_rates - 1; i >= 0; i--)
-		if (ci->r[i].rix == rix)
-			break;
-	return i;
+	if ((unsigned int) rix >= IEEE80211_MAX_SUPP_RATES)
+		return -1;
+	return ci->rix_ndx[rix];
 }
 
 
@@ -203,27 +90,37 @@ sort_bitrates (struct cora_sta_info *ci, int n_rates)
 static void
 cora_update_stats (struct cora_priv *cp, struct cora_sta_info *ci)
 {
-	u32 usecs;
+	u32 usecs, attempts, success;
 	u32 max_tp = 0;
 	unsigned int i, max_tp_ndx;
 	int random = 0;
+	ktime_t start;
 
+	/* Readers of the published stats retry while this update runs */
+	write_seqcount_begin (&ci->seq);
 	ci->up_stats_counter++;
 
 	/* For each supported rate... */
 	for (i = 0; i < ci->n_rates; i++) {
 		struct cora_rate *cr = &ci->r[i]; 
 
+		/* Take the counters of the interval that ends. A frame reported
+		 * between both swaps may leave its success in the next interval */
+		attempts = atomic_xchg (&cr->attempts, 0);
+		success = atomic_xchg (&cr->success, 0);
+		if (success > attempts)
+			success = attempts;
+
 		/* To avoid rounding issues, probabilities scale from 0 (0%)
 		 * to 1800 (100%) */
-		if (cr->attempts) {
+		if (attempts) {
 			
 			usecs = cr->perfect_tx_time;
 			if (!usecs)
 				usecs = 1000000;
 
 			/* Update thp and prob for last interval */
-			cr->cur_prob = (cr->success * 1800) / cr->attempts;
+			cr->cur_prob = (success * 1800) / attempts;
 			cr->cur_tp = cr->cur_prob * (1000000 / usecs);
 
 			/* Update average thp and prob with EWMA */
@@ -234,18 +131,18 @@ cora_update_stats (struct cora_priv *cp, struct cora_sta_info *ci)
 					(cr->avg_tp * cp->ewma_level)) / 100 : cr->cur_tp;
 
 			/* Update success and attempt counters */
-			cr->succ_hist += cr->success;
-			cr->att_hist += cr->attempts;
+			cr->succ_hist += success;
+			cr->att_hist += attempts;
 		}
 
 		/* Update success and attempt counters */
-		cr->last_success = cr->success;
-		cr->last_attempts = cr->attempts;
-		cr->success = 0;
-		cr->attempts = 0;
+		cr->last_success = success;
+		cr->last_attempts = attempts;
 	}
 
-	/* Look for the rate with highest throughput */
+	/* Look for the rate with highest throughput; keep the previous one when
+	 * no rate delivered anything yet */
+	max_tp_ndx = ci->max_tp_rate_ndx;
 	for (i = 0; i < ci->n_rates; i++) {
 		struct cora_rate *cr = &ci->r[i];
 		if (max_tp < cr->avg_tp) {
@@ -257,18 +154,50 @@ cora_update_stats (struct cora_priv *cp, struct cora_sta_info *ci)
 	ci->update_counter = jiffies;
 
 	/* Get a new random rate for next interval (using a normal distribution) */
-	random = rc80211_cora_normal_generator ((int)ci->max_tp_rate_ndx,
-			(int)ci->cur_stdev);
-	ci->random_rate_ndx = (unsigned int)(max (0, min (random,
-					(int)((int)(ci->n_rates) - 1))));
+	start = rc_prof_start ();
+	random = cogtra_normal_sample (&ci->rand, &ci->nc, (int)ci->max_tp_rate_ndx,
+			(int)ci->cur_stdev, 0, (int)ci->n_rates - 1);
+	rc_prof_end (&ci->prof, RC_PROF_NORMAL, start);
+	ci->random_rate_ndx = (unsigned int)random;
 	ci->r[ci->random_rate_ndx].times_called++;
+
+	write_seqcount_end (&ci->seq);
+}
+
+/* cora_sta_snapshot copies what update_stats publishes for a station (rate
+ * stats and selected rates), all from the same update. It never holds
+ * update_stats back: the copy is just taken again when an update ran
+ * meanwhile. The caller releases it with kfree */
+struct cora_sta_snapshot *
+cora_sta_snapshot (struct cora_sta_info *ci, gfp_t gfp)
+{
+	struct cora_sta_snapshot *cs;
+	unsigned int n = ci->n_rates;	// only changes at rate_init
+	unsigned int seq;
+
+	cs = kmalloc (sizeof (*cs) + n * sizeof (*cs->r), gfp);
+	if (!cs)
+		return NULL;
+
+	do {
+		seq = read_seqcount_begin (&ci->seq);
+		cs->gen = ci->up_stats_counter;
+		cs->random_rate_ndx = ci->random_rate_ndx;
+		cs->max_tp_rate_ndx = ci->max_tp_rate_ndx;
+		cs->update_interval = ci->update_interval;
+		cs->cur_stdev = ci->cur_stdev;
+		memcpy (cs->r, ci->r, n * sizeof (*cs->r));
+	} while (read_seqcount_retry (&ci->seq, seq));
+	cs->n_rates = n;
+
+	return cs;
 }
 
 
 /* cora_tx_status is called just after frame tx and it is used to update
  * statistics information for the used rate */
 static void
-cora_tx_status (void *priv, struct ieee80211_supported_band *sband, 
+__cora_tx_status (void *priv, struct ieee80211_supported_band *sband, 
 		struct ieee80211_sta *sta, void *priv_sta, struct sk_buff *skb)
 {
 	struct cora_sta_info *ci = priv_sta;
@@ -291,19 +220,32 @@ cora_tx_status (void *priv, struct ieee80211_supported_band *sband,
 		ndx = rix_to_ndx (ci, ar[i].idx);
 		if (ndx < 0)
 			continue;
+
+		atomic_add (ar[i].count, &ci->r[ndx].attempts);
 	
 		/* If it is the last used rate and resultesd in tx success, also
 		 * increse the success counter */
-		if ((i != IEEE80211_TX_MAX_RATES - 1) && (ar[i + 1].idx < 0)) 
-			ci->r[ndx].success += success;
+		if ((i == IEEE80211_TX_MAX_RATES - 1) || (ar[i + 1].idx < 0)) 
+			atomic_add (success, &ci->r[ndx].success);
 	}
 }
 
+static void
+cora_tx_status (void *priv, struct ieee80211_supported_band *sband, 
+		struct ieee80211_sta *sta, void *priv_sta, struct sk_buff *skb)
+{
+	struct cora_sta_info *ci = priv_sta;
+	ktime_t start = rc_prof_start ();
+
+	__cora_tx_status (priv, sband, sta, priv_sta, skb);
+	rc_prof_end (&ci->prof, RC_PROF_TX_STATUS, start);
+}
+
 
 /* cora_get_rate is called just before each frame tx and sets the appropriate
  * data rate to be used */
 static void
-cora_get_rate (void *priv, struct ieee80211_sta *sta, void *priv_sta,
+__cora_get_rate (void *priv, struct ieee80211_sta *sta, void *priv_sta,
 		struct ieee80211_tx_rate_control *txrc)
 {
 	struct sk_buff *skb = txrc->skb;
@@ -317,10 +259,16 @@ cora_get_rate (void *priv, struct ieee80211_sta *sta, void *priv_sta,
 	if (rate_control_send_low (sta, priv_sta, txrc))
 		return;
 
-	/* Check the need of an update_stats based on update_interval */
+	/* Check the need of an update_stats based on update_interval. Only one
+	 * cpu runs it, the others go on with the current rate */
 	if (time_after (jiffies, ci->update_counter + 
-			(ci->update_interval * HZ) / 1000))
+			(ci->update_interval * HZ) / 1000) &&
+			!test_and_set_bit_lock (CORA_STA_UPDATING, &ci->flags)) {
+		ktime_t start = rc_prof_start ();
 		cora_update_stats (cp, ci);
+		rc_prof_end (&ci->prof, RC_PROF_UPDATE_STATS, start);
+		clear_bit_unlock (CORA_STA_UPDATING, &ci->flags);
+	}
 
 	/* Setting up tx rate information. 
 	 * Be careful to convert ndx indexes into ieee80211_tx_rate indexes */
@@ -331,6 +279,17 @@ cora_get_rate (void *priv, struct ieee80211_sta *sta, void *priv_sta,
 	return;
 }
 
+static void
+cora_get_rate (void *priv, struct ieee80211_sta *sta, void *priv_sta,
+		struct ieee80211_tx_rate_control *txrc)
+{
+	struct cora_sta_info *ci = priv_sta;
+	ktime_t start = rc_prof_start ();
+
+	__cora_get_rate (priv, sta, priv_sta, txrc);
+	rc_prof_end (&ci->prof, RC_PROF_GET_RATE, start);
+}
+
 
 /* calc_rate_durations estimates the tx time for a single data frame of 1200
  * bytes and for an ack frame of standard size for a specific rate */
@@ -350,7 +309,7 @@ calc_rate_durations (struct ieee80211_local *local, struct cora_rate *cr,
 /* cora_rate_init is called after cora_alloc_sta to check and populate
  * information for supported rates */
 static void
-cora_rate_init (void *priv, struct ieee80211_supported_band *sband,
+__cora_rate_init (void *priv, struct ieee80211_supported_band *sband,
 		struct ieee80211_sta *sta, void *priv_sta)
 {
 	struct cora_sta_info *ci = priv_sta;
@@ -383,19 +342,38 @@ cora_rate_init (void *priv, struct ieee80211_supported_band *sband,
 	/* Sort rates based on bitrate */
 	sort_bitrates (ci, n);
 
+	/* Reverse map from mac80211 rate index to local array index */
+	memset (ci->rix_ndx, -1, sizeof (ci->rix_ndx));
+	for (i = 0; i < n; i++)
+		ci->rix_ndx[ci->r[i].rix] = i;
+
 	/* Mark unsupported rates with rix = -1 */
 	for (i = n; i < sband->n_bitrates; i++)
 		ci->r[i].rix = -1;
 
+	rc_rand_seed (&ci->rand, cp->seed, sta->addr);
 	ci->cur_stdev = CORA_STDEV;
 	ci->n_rates = n;
 	ci->update_counter = jiffies;
 }
 
+static void
+cora_rate_init (void *priv, struct ieee80211_supported_band *sband,
+		struct ieee80211_sta *sta, void *priv_sta)
+{
+	struct cora_sta_info *ci = priv_sta;
+	struct cora_priv *cp = priv;
+	ktime_t start = rc_prof_start ();
+
+	__cora_rate_init (priv, sband, sta, priv_sta);
+	rc_prof_end (&ci->prof, RC_PROF_RATE_INIT, start);
+	rc_prof_end (&cp->phy_stats.prof, RC_PROF_RATE_INIT, start);
+}
+
 
 /* cora_alloc_sta is called every time a new station joins the networks */
 static void *
-cora_alloc_sta (void *priv, struct ieee80211_sta *sta, gfp_t gfp)
+__cora_alloc_sta (void *priv, struct ieee80211_sta *sta, gfp_t gfp)
 {
 	struct ieee80211_supported_band *sband;
 	struct cora_sta_info *ci;
@@ -426,21 +404,51 @@ cora_alloc_sta (void *priv, struct ieee80211_sta *sta, gfp_t gfp)
 	 * represents the number of timer ticks since the machine started. */
 	ci->update_counter = jiffies;
 	ci->update_interval = CORA_UPDATE_INTERVAL;
+	seqcount_init (&ci->seq);
+
+	rc_phy_sta_alloc (&cp->phy_stats, ksize (ci) + ksize (ci->r));
     
     return ci;
 }
 
+static void *
+cora_alloc_sta (void *priv, struct ieee80211_sta *sta, gfp_t gfp)
+{
+	struct cora_priv *cp = priv;
+	ktime_t start = rc_prof_start ();
+	void *priv_sta;
+
+	priv_sta = __cora_alloc_sta (priv, sta, gfp);
+	if (!priv_sta)
+		cp->phy_stats.alloc_fail++;
+	rc_prof_end (&cp->phy_stats.prof, RC_PROF_ALLOC_STA, start);
+	return priv_sta;
+}
+
 
 /* cora_free_sta used to release memory when a station leaves the network */
 static void
-cora_free_sta (void *priv, struct ieee80211_sta *sta, void *priv_sta)
+__cora_free_sta (void *priv, struct ieee80211_sta *sta, void *priv_sta)
 {
 	struct cora_sta_info *ci = priv_sta;
+	struct cora_priv *cp = priv;
+
+	rc_phy_sta_free (&cp->phy_stats, ksize (ci) + ksize (ci->r));
 
 	kfree (ci->r);
 	kfree (ci);
 }
 
+static void
+cora_free_sta (void *priv, struct ieee80211_sta *sta, void *priv_sta)
+{
+	struct cora_priv *cp = priv;
+	ktime_t start = rc_prof_start ();
+
+	__cora_free_sta (priv, sta, priv_sta);
+	rc_prof_end (&cp->phy_stats.prof, RC_PROF_FREE_STA, start);
+}
+
 
 /* cora_alloc called once before turning on the wireless interface */
 static void *
@@ -457,6 +465,11 @@ cora_alloc (struct ieee80211_hw *hw, struct dentry *debugfsdir)
 	cp->cw_max = 1023;
 	cp->ewma_level = CORA_EWMA_LEVEL;
 	cp->max_retry = hw->max_rate_tries > 0 ? hw->max_rate_tries : 7;
+
+#ifdef CONFIG_MAC80211_DEBUGFS
+	rc_phy_add_debugfs (&cp->phy_stats, debugfsdir, &cp->seed, 0);
+#endif
+
 	cp->hw = hw;
 	return cp;
 }
@@ -466,6 +479,11 @@ cora_alloc (struct ieee80211_hw *hw, struct dentry *debugfsdir)
 static void
 cora_free (void *priv)
 {
+#ifdef CONFIG_MAC80211_DEBUGFS
+	struct cora_priv *cp = priv;
+
+	rc_phy_remove_debugfs (&cp->phy_stats);
+#endif
 	kfree (priv);
 }
 
@@ -18,6 +18,9 @@
 #define CORA_EWMA_LEVEL			30
 #define CORA_UPDATE_INTERVAL	100
 
+/* Bits in cora_sta_info.flags */
+#define CORA_STA_UPDATING		0	// update_stats running on some cpu
+
 /* cora_rate is allocated once for each available rate at each cora_sta_info.
  * Information in this struct is private to this rate at this station */ 
 struct cora_rate {
@@ -39,9 +42,11 @@ struct cora_rate {
 	/* Personalized retry count to avoid stall in the same packet */
 	unsigned int retry_count;
 
-	/* Tx success and attempts counters */
-	u32 success;					// during last interval
-	u32 attempts;					// during last interval
+	/* Tx success and attempts counters. The current interval ones are updated
+	 * by tx_status and swapped with 0 by cora_update_stats, which may run on
+	 * another cpu at the same time */
+	atomic_t success;				// during current interval
+	atomic_t attempts;				// during current interval
 	u64 succ_hist;					// since ever 
 	u64 att_hist;					// since ever
 	u32 last_attempts;				// before last cora_update_stats
@@ -63,9 +68,16 @@ struct cora_sta_info {
 	unsigned int n_rates;			// number o supported rates 
 	unsigned long update_counter;	// last update time
     unsigned int update_interval; 	// time between cora_update_stats
-	unsigned long up_stats_counter;	// update stats counter
+	unsigned long up_stats_counter;	// update stats counter (generation of the published stats)
+	unsigned long flags;			// CORA_STA_* bits
+	seqcount_t seq;					// update_stats publishes rate stats inside it
 	
 	struct cora_rate *r;			// rate pointer for each station
+	s8 rix_ndx[IEEE80211_MAX_SUPP_RATES];	// r index for each mac80211 rate index (-1 if unsupported)
+
+	struct rc_prof prof;			// per-call time accounting
+	struct rc_rand rand;			// random source for the normal generator
+	struct cogtra_normal_cache nc;	// normal cdf for cur_stdev
 
 #ifdef CONFIG_MAC80211_DEBUGFS
 	struct dentry *dbg_stats;		// debug file pointer 
@@ -82,11 +94,27 @@ struct cora_priv {
 	unsigned int max_retry;		  	// default max number o retries before frame discard
 	unsigned int ewma_level;	  	// ewma alpha for ammortize throughput.
 	unsigned int segment_time;	  	// maximum time allowed at the same mrr segment
+	u32 seed;						// random seed for new stations (0 for get_random_bytes)
+
+	struct rc_phy_stats phy_stats;	// station setup accounting for this phy
 };
 
 
+/* Copy of what update_stats publishes for a station, all from the same
+ * update (see cora_sta_snapshot) */
+struct cora_sta_snapshot {
+	unsigned long gen;				// up_stats_counter of this copy
+	unsigned int n_rates;			// number o supported rates
+	unsigned int random_rate_ndx;	// random rate index
+	unsigned int max_tp_rate_ndx;	// index of rate with highest thp
+	unsigned int update_interval;	// time between cora_update_stats
+	unsigned int cur_stdev;			// current normal stdev
+	struct cora_rate r[];			// n_rates rates
+};
+
 /* Common functions */
 extern struct rate_control_ops mac80211_cora;
+struct cora_sta_snapshot *cora_sta_snapshot (struct cora_sta_info *ci, gfp_t gfp);
 void cora_add_sta_debugfs (void *priv, void *priv_sta, struct dentry *dir);
 void cora_remove_sta_debugfs (void *priv, void *priv_sta);
 
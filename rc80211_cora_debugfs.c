@@ -55,6 +55,10 @@
 #include <linux/ieee80211.h>
 #include <linux/slab.h>
 #include <net/mac80211.h>
+#include "rc80211_prof.h"
+#include "rc80211_phy.h"
+#include "rc80211_random.h"
+#include "rc80211_cogtra_normal.h"
 #include "rc80211_cora.h"
 
 int
@@ -62,6 +66,7 @@ cora_stats_open (struct inode *inode, struct file *file)
 {
 	struct cora_sta_info *ci = inode->i_private;
 	struct cora_debugfs_info *cs;
+	struct cora_sta_snapshot *ss;
 	unsigned int i, avg_tp, avg_prob, cur_tp, cur_prob;
 	char *p;
 
@@ -69,23 +74,30 @@ cora_stats_open (struct inode *inode, struct file *file)
 	if (!cs)
 		return -ENOMEM;
 
+	/* Rate stats are printed from a consistent copy */
+	ss = cora_sta_snapshot (ci, GFP_KERNEL);
+	if (!ss) {
+		kfree (cs);
+		return -ENOMEM;
+	}
+
 	file->private_data = cs;
 	p = cs->buf;
 
 	/* Table header */
-	p += sprintf(p, "\n Rate Table:\n");
+	p += sprintf(p, "\n Rate Table (update %lu):\n", ss->gen);
 	p += sprintf(p, "   | rate | avg_thp | avg_pro | cur_thp | cur_pro | "
 			"succ ( atte ) | success | attempts | #used \n");
 
 	/* Table lines */
-	for (i = 0; i < ci->n_rates; i++) {
-		struct cora_rate *cr = &ci->r[i];
+	for (i = 0; i < ss->n_rates; i++) {
+		struct cora_rate *cr = &ss->r[i];
 
 		/* Print T for the rate with highest throughput (the mean of normal
 		 * curve), P for the rate with hisgest delivery probability and print *
 		 * for the rate been used now */
-		*(p++) = (i == ci->random_rate_ndx)		? '*' : ' ';
-		*(p++) = (i == ci->max_tp_rate_ndx) 	? 'T' : ' ';   
+		*(p++) = (i == ss->random_rate_ndx)		? '*' : ' ';
+		*(p++) = (i == ss->max_tp_rate_ndx) 	? 'T' : ' ';   
 
 		p += sprintf(p, " |%3u%s ", cr->bitrate / 2,
 				(cr->bitrate & 1 ? ".5" : "  "));
@@ -117,11 +129,14 @@ cora_stats_open (struct inode *inode, struct file *file)
 			"   Update interval: %u\n"
 			"   Normal Mean:     %u\n"
 		   	"   Normal Stdev:    %u.%2u\n",
-			ci->n_rates,
-			ci->update_interval,
-			ci->max_tp_rate_ndx,
-			ci->cur_stdev / 100, ci->cur_stdev % 100
+			ss->n_rates,
+			ss->update_interval,
+			ss->max_tp_rate_ndx,
+			ss->cur_stdev / 100, ss->cur_stdev % 100
 		);
+	kfree (ss);
+
+	p += rc_prof_scnprintf (p, cs->buf + 4096 - p, &ci->prof);
 
 	cs->len = p - cs->buf;
 	return 0;
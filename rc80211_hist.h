@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2012 Luciano Jerez Chaves <luciano@lrc.ic.unicamp.br>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#ifndef __RC80211_HIST_H
+#define __RC80211_HIST_H
+
+#include <linux/kernel.h>
+#include <linux/log2.h>
+#include <linux/slab.h>
+
+/* Default and limits for debugfs:ieee80211/phyX/rc/history_size */
+#define RC_HIST_SIZE			256
+#define RC_HIST_MIN_SIZE		2
+#define RC_HIST_MAX_SIZE		1024
+
+/* Per-station history of rate adaptations, shown in rc_history.
+ *
+ * Entries are kept in a ring that holds the most recent ones. The ring is
+ * allocated when rc_history is first opened for the station, so stations
+ * nobody looks at cost no history memory, and the rate control paths skip
+ * recording until then: only entries from start on were recorded. Its size
+ * is history_size at the station's last rate_init before that open, rounded
+ * up to a power of two, and it stays so until the station leaves (the rate
+ * control paths may be writing to it at any time). */
+struct rc_hist_ring {
+	unsigned int mask;				// number of entries - 1
+	unsigned int start;				// first entry recorded in the ring
+	u8 e[];							// entries
+};
+
+struct rc_hist {
+	struct rc_hist_ring *ring;		// NULL until rc_history is opened
+	unsigned int idx;				// entries recorded since rate_init
+	unsigned int size;				// ring size requested at rate_init
+};
+
+
+/* Restarts the history at rate_init. An allocated ring records from the first
+ * entry on, and keeps its size */
+static inline void
+rc_hist_reset (struct rc_hist *rh, unsigned int size)
+{
+	struct rc_hist_ring *ring = ACCESS_ONCE (rh->ring);
+
+	rh->idx = 0;
+	rh->size = size;
+	if (ring)
+		ring->start = 0;
+}
+
+/* Ring slot for entry idx, or NULL while the ring is not allocated */
+static inline void *
+rc_hist_entry (struct rc_hist *rh, unsigned int idx, size_t esize)
+{
+	struct rc_hist_ring *ring = ACCESS_ONCE (rh->ring);
+
+	if (!ring)
+		return NULL;
+	smp_read_barrier_depends ();
+	return ring->e + (idx & ring->mask) * esize;
+}
+
+/* Oldest entry recorded and still in the ring when entries up to last
+ * (excluded) exist. Above last when none is */
+static inline unsigned int
+rc_hist_first (struct rc_hist *rh, unsigned int last)
+{
+	unsigned int n = rh->ring->mask + 1;
+
+	return max (last > n ? last - n : 0, rh->ring->start);
+}
+
+/* Allocates the ring (process context). Safe against concurrent opens */
+static inline int
+rc_hist_alloc (struct rc_hist *rh, size_t esize)
+{
+	struct rc_hist_ring *ring;
+	unsigned int n;
+
+	if (rh->ring)
+		return 0;
+
+	n = roundup_pow_of_two (clamp_t (unsigned int, rh->size,
+				RC_HIST_MIN_SIZE, RC_HIST_MAX_SIZE));
+	ring = kzalloc (sizeof (*ring) + n * esize, GFP_KERNEL);
+	if (!ring)
+		return -ENOMEM;
+	ring->mask = n - 1;
+
+	/* The entry in progress may have been partly skipped, so recording
+	 * counts from the next one */
+	ring->start = ACCESS_ONCE (rh->idx) + 1;
+
+	/* cmpxchg publishes the ring after its setup, and drops ours if another
+	 * open got there first */
+	if (cmpxchg (&rh->ring, NULL, ring))
+		kfree (ring);
+	return 0;
+}
+
+static inline void
+rc_hist_free (struct rc_hist *rh)
+{
+	kfree (rh->ring);
+	rh->ring = NULL;
+}
+
+#endif
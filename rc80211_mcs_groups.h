@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2010 Felix Fietkau <nbd@openwrt.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#ifndef __RC80211_MCS_GROUPS_H
+#define __RC80211_MCS_GROUPS_H
+
+/*
+ * The number of streams can be changed to 2 to reduce code
+ * size and memory footprint.
+ */
+#define MINSTREL_MAX_STREAMS	3
+#define MINSTREL_STREAM_GROUPS	4
+
+/*
+ * Index of an MCS group in minstrel_mcs_groups: groups are laid out by
+ * stream count first, then by SGI and HT40 flags.
+ */
+#define MINSTREL_GROUP_IDX(_streams, _sgi, _ht40)			\
+	((_streams) - 1 + MINSTREL_MAX_STREAMS * ((_sgi) + 2 * (_ht40)))
+
+/* scaled fraction values */
+#define MINSTREL_SCALE	16
+#define MINSTREL_FRAC(val, div) (((val) << MINSTREL_SCALE) / div)
+#define MINSTREL_TRUNC(val) ((val) >> MINSTREL_SCALE)
+
+#define MCS_GROUP_RATES	8
+
+struct mcs_group {
+	u32 flags;
+	unsigned int streams;
+	unsigned int duration[MCS_GROUP_RATES];
+};
+
+/*
+ * MCS group table shared by minstrel_ht and cogtra_ht. It is defined in
+ * rc80211_mcs_groups.c, which both modules link.
+ */
+extern const struct mcs_group
+minstrel_mcs_groups[MINSTREL_MAX_STREAMS * MINSTREL_STREAM_GROUPS];
+
+/*
+ * Look up an MCS group index based on mac80211 rate information
+ */
+static inline int
+minstrel_ht_get_group_idx(struct ieee80211_tx_rate *rate)
+{
+	int streams = (rate->idx / MCS_GROUP_RATES) + 1;
+
+	if (WARN_ON(streams > MINSTREL_MAX_STREAMS))
+		return 0;
+
+	return MINSTREL_GROUP_IDX(streams,
+			!!(rate->flags & IEEE80211_TX_RC_SHORT_GI),
+			!!(rate->flags & IEEE80211_TX_RC_40_MHZ_WIDTH));
+}
+
+#endif
@@ -53,6 +53,10 @@
 #include <linux/slab.h>
 #include <net/mac80211.h>
 #include "rate.h"
+#include "rc80211_prof.h"
+#include "rc80211_phy.h"
+#include "rc80211_random.h"
+#include "rc80211_hist.h"
 #include "rc80211_minstrel.h"
 
 #define SAMPLE_COLUMNS	10
@@ -63,11 +67,9 @@
 static inline int
 rix_to_ndx(struct minstrel_sta_info *mi, int rix)
 {
-	int i = rix;
-	for (i = rix; i >= 0; i--)
-		if (mi->r[i].rix == rix)
-			break;
-	return i;
+	if ((unsigned int) rix >= IEEE80211_MAX_SUPP_RATES)
+		return -1;
+	return mi->rix_ndx[rix];
 }
 
 static void
@@ -150,7 +152,7 @@ minstrel_update_stats(struct minstrel_priv *mp, struct minstrel_sta_info *mi)
 }
 
 static void
-minstrel_tx_status(void *priv, struct ieee80211_supported_band *sband,
+__minstrel_tx_status(void *priv, struct ieee80211_supported_band *sband,
                    struct ieee80211_sta *sta, void *priv_sta,
 		   struct sk_buff *skb)
 {
@@ -183,6 +185,18 @@ minstrel_tx_status(void *priv, struct ieee80211_supported_band *sband,
 		mi->sample_deferred--;
 }
 
+static void
+minstrel_tx_status(void *priv, struct ieee80211_supported_band *sband,
+                   struct ieee80211_sta *sta, void *priv_sta,
+		   struct sk_buff *skb)
+{
+	struct minstrel_sta_info *mi = priv_sta;
+	ktime_t start = rc_prof_start();
+
+	__minstrel_tx_status(priv, sband, sta, priv_sta, skb);
+	rc_prof_end(&mi->prof, RC_PROF_TX_STATUS, start);
+}
+
 
 static inline unsigned int
 minstrel_get_retry_count(struct minstrel_rate *mr,
@@ -214,7 +228,7 @@ minstrel_get_next_sample(struct minstrel_sta_info *mi)
 }
 
 static void
-minstrel_get_rate(void *priv, struct ieee80211_sta *sta,
+__minstrel_get_rate(void *priv, struct ieee80211_sta *sta,
 		  void *priv_sta, struct ieee80211_tx_rate_control *txrc)
 {
 	struct sk_buff *skb = txrc->skb;
@@ -227,6 +241,9 @@ minstrel_get_rate(void *priv, struct ieee80211_sta *sta,
 	bool sample_slower = false;
 	bool sample = false;
 	int i, delta;
+#ifdef CONFIG_MAC80211_DEBUGFS
+	struct minstrel_hist_info *ht;
+#endif
 	int mrr_ndx[3];
 	int sample_rate;
 
@@ -236,8 +253,11 @@ minstrel_get_rate(void *priv, struct ieee80211_sta *sta,
 	mrr = mp->has_mrr && !txrc->rts && !txrc->bss_conf->use_cts_prot;
 
 	if (time_after(jiffies, mi->stats_update + (mp->update_interval *
-			HZ) / 1000))
+			HZ) / 1000)) {
+		ktime_t start = rc_prof_start();
 		minstrel_update_stats(mp, mi);
+		rc_prof_end(&mi->prof, RC_PROF_UPDATE_STATS, start);
+	}
 
 	ndx = mi->max_tp_rate;
 
@@ -332,24 +352,35 @@ minstrel_get_rate(void *priv, struct ieee80211_sta *sta,
 	}
 
 #ifdef CONFIG_MAC80211_DEBUGFS
-	if (mi->dbg_idx < MINSTREL_DEBUGFS_HIST_SIZE) {
-        struct minstrel_hist_info *ht = &mi->hi[mi->dbg_idx];
-        struct minstrel_hist_info *hl = &mi->hi[mi->dbg_idx-1];
+	ht = rc_hist_entry(&mi->hist, mi->hist.idx, sizeof(*ht));
+	if (ht) {
+        struct minstrel_hist_info *hl = rc_hist_entry(&mi->hist, mi->hist.idx - 1, sizeof(*hl));
         int r0 = mi->r[rix_to_ndx(mi, ar[0].idx)].bitrate;
 
-        if (hl->rate0 != r0) {
+        if (!mi->hist.idx || hl->rate0 != r0) {
             unsigned long diff = (long)jiffies - (long)mi->first_time;
 		    ht->start_ms = (int)(diff * 1000 / HZ);
 		    ht->rate0 = r0;
 		    ht->rate1 = mi->r[rix_to_ndx(mi, ar[1].idx)].bitrate;
 		    ht->sample = sample ? (sample_slower ? -1 : 1) : 0;
-            mi->dbg_idx++;
+            mi->hist.idx++;
         }
 	}
 #endif
 
 }
 
+static void
+minstrel_get_rate(void *priv, struct ieee80211_sta *sta,
+		  void *priv_sta, struct ieee80211_tx_rate_control *txrc)
+{
+	struct minstrel_sta_info *mi = priv_sta;
+	ktime_t start = rc_prof_start();
+
+	__minstrel_get_rate(priv, sta, priv_sta, txrc);
+	rc_prof_end(&mi->prof, RC_PROF_GET_RATE, start);
+}
+
 
 static void
 calc_rate_durations(struct ieee80211_local *local, struct minstrel_rate *d,
@@ -368,7 +399,6 @@ init_sample_table(struct minstrel_sta_info *mi)
 {
 	unsigned int i, col, new_idx;
 	unsigned int n_srates = mi->n_rates - 1;
-	u8 rnd[8];
 
 	mi->sample_column = 0;
 	mi->sample_idx = 0;
@@ -376,8 +406,7 @@ init_sample_table(struct minstrel_sta_info *mi)
 
 	for (col = 0; col < SAMPLE_COLUMNS; col++) {
 		for (i = 0; i < n_srates; i++) {
-			get_random_bytes(rnd, sizeof(rnd));
-			new_idx = (i + rnd[i & 7]) % n_srates;
+			new_idx = (i + rc_rand_u8(&mi->rand)) % n_srates;
 
 			while (SAMPLE_TBL(mi, new_idx, col) != 0)
 				new_idx = (new_idx + 1) % n_srates;
@@ -392,7 +421,7 @@ init_sample_table(struct minstrel_sta_info *mi)
 }
 
 static void
-minstrel_rate_init(void *priv, struct ieee80211_supported_band *sband,
+__minstrel_rate_init(void *priv, struct ieee80211_supported_band *sband,
                struct ieee80211_sta *sta, void *priv_sta)
 {
 	struct minstrel_sta_info *mi = priv_sta;
@@ -456,14 +485,36 @@ minstrel_rate_init(void *priv, struct ieee80211_supported_band *sband,
 		mr->rix = -1;
 	}
 
+	/* reverse map from mac80211 rate index to local array index */
+	memset(mi->rix_ndx, -1, sizeof(mi->rix_ndx));
+	for (i = 0; i < n; i++)
+		mi->rix_ndx[mi->r[i].rix] = i;
+
 	mi->n_rates = n;
 	mi->stats_update = jiffies;
 
+	rc_rand_seed(&mi->rand, mp->seed, sta->addr);
 	init_sample_table(mi);
+#ifdef CONFIG_MAC80211_DEBUGFS
+	rc_hist_reset(&mi->hist, mp->phy_stats.hist_size);
+#endif
+}
+
+static void
+minstrel_rate_init(void *priv, struct ieee80211_supported_band *sband,
+               struct ieee80211_sta *sta, void *priv_sta)
+{
+	struct minstrel_sta_info *mi = priv_sta;
+	struct minstrel_priv *mp = priv;
+	ktime_t start = rc_prof_start();
+
+	__minstrel_rate_init(priv, sband, sta, priv_sta);
+	rc_prof_end(&mi->prof, RC_PROF_RATE_INIT, start);
+	rc_prof_end(&mp->phy_stats.prof, RC_PROF_RATE_INIT, start);
 }
 
 static void *
-minstrel_alloc_sta(void *priv, struct ieee80211_sta *sta, gfp_t gfp)
+__minstrel_alloc_sta(void *priv, struct ieee80211_sta *sta, gfp_t gfp)
 {
 	struct ieee80211_supported_band *sband;
 	struct minstrel_sta_info *mi;
@@ -490,19 +541,13 @@ minstrel_alloc_sta(void *priv, struct ieee80211_sta *sta, gfp_t gfp)
 	if (!mi->sample_table)
 		goto error1;
 
-#ifdef CONFIG_MAC80211_DEBUGFS
-   	mi->hi = kzalloc (sizeof (struct minstrel_hist_info) * MINSTREL_DEBUGFS_HIST_SIZE, gfp);
-	if (!mi->hi)
-		goto error2;
-#endif
+	rc_phy_sta_alloc(&mp->phy_stats,
+			ksize(mi) + ksize(mi->r) + ksize(mi->sample_table));
 
 	mi->stats_update = jiffies;
 	mi->first_time = jiffies;
-    mi->dbg_idx = 1;
 	return mi;
 
-error2:
-	kfree(mi->sample_table);
 error1:
 	kfree(mi->r);
 error:
@@ -510,19 +555,47 @@ error:
 	return NULL;
 }
 
+static void *
+minstrel_alloc_sta(void *priv, struct ieee80211_sta *sta, gfp_t gfp)
+{
+	struct minstrel_priv *mp = priv;
+	ktime_t start = rc_prof_start();
+	void *priv_sta;
+
+	priv_sta = __minstrel_alloc_sta(priv, sta, gfp);
+	if (!priv_sta)
+		mp->phy_stats.alloc_fail++;
+	rc_prof_end(&mp->phy_stats.prof, RC_PROF_ALLOC_STA, start);
+	return priv_sta;
+}
+
 static void
-minstrel_free_sta(void *priv, struct ieee80211_sta *sta, void *priv_sta)
+__minstrel_free_sta(void *priv, struct ieee80211_sta *sta, void *priv_sta)
 {
 	struct minstrel_sta_info *mi = priv_sta;
+	struct minstrel_priv *mp = priv;
 
-	kfree(mi->sample_table);
-	kfree(mi->r);
+	rc_phy_sta_free(&mp->phy_stats,
+			ksize(mi) + ksize(mi->r) + ksize(mi->sample_table));
 #ifdef CONFIG_MAC80211_DEBUGFS
-	kfree(mi->hi);
+	rc_hist_free(&mi->hist);
 #endif
+
+	kfree(mi->sample_table);
+	kfree(mi->r);
 	kfree(mi);
 }
 
+static void
+minstrel_free_sta(void *priv, struct ieee80211_sta *sta, void *priv_sta)
+{
+	struct minstrel_priv *mp = priv;
+	ktime_t start = rc_prof_start();
+
+	__minstrel_free_sta(priv, sta, priv_sta);
+	rc_prof_end(&mp->phy_stats.prof, RC_PROF_FREE_STA, start);
+}
+
 static void *
 minstrel_alloc(struct ieee80211_hw *hw, struct dentry *debugfsdir)
 {
@@ -566,6 +639,7 @@ minstrel_alloc(struct ieee80211_hw *hw, struct dentry *debugfsdir)
 	mp->fixed_rate_idx = (u32) -1;
 	mp->dbg_fixed_rate = debugfs_create_u32("fixed_rate_idx",
 			S_IRUGO | S_IWUGO, debugfsdir, &mp->fixed_rate_idx);
+	rc_phy_add_debugfs(&mp->phy_stats, debugfsdir, &mp->seed, RC_HIST_SIZE);
 #endif
 
 	return mp;
@@ -576,6 +650,7 @@ minstrel_free(void *priv)
 {
 #ifdef CONFIG_MAC80211_DEBUGFS
 	debugfs_remove(((struct minstrel_priv *)priv)->dbg_fixed_rate);
+	rc_phy_remove_debugfs(&((struct minstrel_priv *)priv)->phy_stats);
 #endif
 	kfree(priv);
 }
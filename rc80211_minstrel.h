@@ -9,7 +9,8 @@
 #ifndef __RC_MINSTREL_H
 #define __RC_MINSTREL_H
 
-#define MINSTREL_DEBUGFS_HIST_SIZE	10000U
+/* buffer space for each rc_history line */
+#define MINSTREL_HIST_LINE_LEN	64
 
 struct minstrel_rate {
 	int bitrate;
@@ -61,15 +62,22 @@ struct minstrel_sta_info {
 
 	int n_rates;
 	struct minstrel_rate *r;
+	s8 rix_ndx[IEEE80211_MAX_SUPP_RATES];	/* -1 if unsupported */
 	bool prev_sample;
 
 	/* sampling table */
 	u8 *sample_table;
 
+	/* per-call time accounting */
+	struct rc_prof prof;
+
+	/* random source for the sampling table */
+	struct rc_rand rand;
+
 #ifdef CONFIG_MAC80211_DEBUGFS
 	struct dentry *dbg_stats;
-	struct minstrel_hist_info *hi;
-	unsigned int dbg_idx;
+	/* most recent rate changes (rc_history) */
+	struct rc_hist hist;
 	struct dentry *dbg_hist;
 #endif
 };
@@ -86,6 +94,12 @@ struct minstrel_priv {
 	unsigned int lookaround_rate;
 	unsigned int lookaround_rate_mrr;
 
+	/* random seed for new stations (0 for get_random_bytes) */
+	u32 seed;
+
+	/* station setup accounting (alloc_sta, rate_init and free_sta) */
+	struct rc_phy_stats phy_stats;
+
 #ifdef CONFIG_MAC80211_DEBUGFS
 	/*
 	 * enable fixed rate processing per RC
@@ -52,6 +52,10 @@
 #include <linux/slab.h>
 #include <linux/export.h>
 #include <net/mac80211.h>
+#include "rc80211_prof.h"
+#include "rc80211_phy.h"
+#include "rc80211_random.h"
+#include "rc80211_hist.h"
 #include "rc80211_minstrel.h"
 
 int
@@ -97,6 +101,7 @@ minstrel_stats_open(struct inode *inode, struct file *file)
 			"lookaround %d\n\n",
 			mi->packet_count - mi->sample_count,
 			mi->sample_count);
+	p += rc_prof_scnprintf(p, ms->buf + 4096 - p, &mi->prof);
 	ms->len = p - ms->buf;
 
 	return 0;
@@ -108,12 +113,15 @@ minstrel_hist_open (struct inode *inode, struct file *file)
 {
 	struct minstrel_sta_info *ci = inode->i_private;
 	struct minstrel_debugfs_info *ch;
-	unsigned int i;
+	unsigned int i, first, last;
 	char *p;
 
-	ch = kmalloc (sizeof (*ch) 
-			    + sizeof (struct minstrel_hist_info) * MINSTREL_DEBUGFS_HIST_SIZE 
-				+ 1024, GFP_KERNEL);
+	/* Recording starts with the first open */
+	if (rc_hist_alloc (&ci->hist, sizeof (struct minstrel_hist_info)))
+		return -ENOMEM;
+
+	ch = kmalloc (sizeof (*ch) + MINSTREL_HIST_LINE_LEN *
+			(ci->hist.ring->mask + 1) + 1024, GFP_KERNEL);
 	if (!ch)
 		return -ENOMEM;
 
@@ -123,12 +131,15 @@ minstrel_hist_open (struct inode *inode, struct file *file)
 	/* Table header */
 	p += sprintf (p, "Minstrel\n");
 	p += sprintf (p, "History Information Table\n"); 
-	p += sprintf (p, "Rate adaptations: %u (max of %u)\n\n", ci->dbg_idx, MINSTREL_DEBUGFS_HIST_SIZE);
+	last = ci->hist.idx;
+	first = rc_hist_first (&ci->hist, last);
+	p += sprintf (p, "Rate adaptations: %u (%u kept, ring of %u)\n\n", last,
+			last > first ? last - first : 0, ci->hist.ring->mask + 1);
 	p += sprintf (p, " Idx | Start time | Rate0 | Rate1 | Sample\n");
 
 	/* Table lines */
-	for (i = 0; i < ci->dbg_idx && i < MINSTREL_DEBUGFS_HIST_SIZE; i++) {
-		struct minstrel_hist_info	*t = &ci->hi[i];
+	for (i = first; i < last; i++) {
+		struct minstrel_hist_info	*t = rc_hist_entry (&ci->hist, i, sizeof (*t));
 
 		p += sprintf (p, "%4u | %10d | %3u%s | %3u%s | %s\n", 
 				i,
@@ -139,9 +150,6 @@ minstrel_hist_open (struct inode *inode, struct file *file)
 			);
 	}
 
-	if (i == MINSTREL_DEBUGFS_HIST_SIZE)
-		p += sprintf (p, "\n   *** Table Full... ***\n");
-
 	ch->len = p - ch->buf;
 	return 0;
 }
@@ -13,78 +13,17 @@
 #include <linux/ieee80211.h>
 #include <net/mac80211.h>
 #include "rate.h"
+#include "rc80211_prof.h"
+#include "rc80211_phy.h"
+#include "rc80211_random.h"
+#include "rc80211_hist.h"
 #include "rc80211_minstrel.h"
+#include "rc80211_mcs_groups.h"
 #include "rc80211_minstrel_ht.h"
 
-#define AVG_PKT_SIZE	1200
 #define SAMPLE_COLUMNS	10
 #define EWMA_LEVEL		75
 
-/* Number of bits for an average sized packet */
-#define MCS_NBITS (AVG_PKT_SIZE << 3)
-
-/* Number of symbols for a packet with (bps) bits per symbol */
-#define MCS_NSYMS(bps) ((MCS_NBITS + (bps) - 1) / (bps))
-
-/* Transmission time for a packet containing (syms) symbols */
-#define MCS_SYMBOL_TIME(sgi, syms)					\
-	(sgi ?								\
-	  ((syms) * 18 + 4) / 5 :	/* syms * 3.6 us */		\
-	  (syms) << 2			/* syms * 4 us */		\
-	)
-
-/* Transmit duration for the raw data part of an average sized packet */
-#define MCS_DURATION(streams, sgi, bps) MCS_SYMBOL_TIME(sgi, MCS_NSYMS((streams) * (bps)))
-
-/* MCS rate information for an MCS group */
-#define MCS_GROUP(_streams, _sgi, _ht40) {				\
-	.streams = _streams,						\
-	.flags =							\
-		(_sgi ? IEEE80211_TX_RC_SHORT_GI : 0) |			\
-		(_ht40 ? IEEE80211_TX_RC_40_MHZ_WIDTH : 0),		\
-	.duration = {							\
-		MCS_DURATION(_streams, _sgi, _ht40 ? 54 : 26),		\
-		MCS_DURATION(_streams, _sgi, _ht40 ? 108 : 52),		\
-		MCS_DURATION(_streams, _sgi, _ht40 ? 162 : 78),		\
-		MCS_DURATION(_streams, _sgi, _ht40 ? 216 : 104),	\
-		MCS_DURATION(_streams, _sgi, _ht40 ? 324 : 156),	\
-		MCS_DURATION(_streams, _sgi, _ht40 ? 432 : 208),	\
-		MCS_DURATION(_streams, _sgi, _ht40 ? 486 : 234),	\
-		MCS_DURATION(_streams, _sgi, _ht40 ? 540 : 260)		\
-	}								\
-}
-
-/*
- * To enable sufficiently targeted rate sampling, MCS rates are divided into
- * groups, based on the number of streams and flags (HT40, SGI) that they
- * use.
- */
-const struct mcs_group minstrel_mcs_groups[] = {
-	MCS_GROUP(1, 0, 0),
-	MCS_GROUP(2, 0, 0),
-#if MINSTREL_MAX_STREAMS >= 3
-	MCS_GROUP(3, 0, 0),
-#endif
-
-	MCS_GROUP(1, 1, 0),
-	MCS_GROUP(2, 1, 0),
-#if MINSTREL_MAX_STREAMS >= 3
-	MCS_GROUP(3, 1, 0),
-#endif
-
-	MCS_GROUP(1, 0, 1),
-	MCS_GROUP(2, 0, 1),
-#if MINSTREL_MAX_STREAMS >= 3
-	MCS_GROUP(3, 0, 1),
-#endif
-
-	MCS_GROUP(1, 1, 1),
-	MCS_GROUP(2, 1, 1),
-#if MINSTREL_MAX_STREAMS >= 3
-	MCS_GROUP(3, 1, 1),
-#endif
-};
-
 static u8 sample_table[SAMPLE_COLUMNS][MCS_GROUP_RATES];
 
 static void
@@ -100,29 +39,6 @@ minstrel_ewma(int old, int new, int weight)
 	return (new * (100 - weight) + old * weight) / 100;
 }
 
-/*
- * Look up an MCS group index based on mac80211 rate information
- */
-static int
-minstrel_ht_get_group_idx(struct ieee80211_tx_rate *rate)
-{
-	int streams = (rate->idx / MCS_GROUP_RATES) + 1;
-	u32 flags = IEEE80211_TX_RC_SHORT_GI | IEEE80211_TX_RC_40_MHZ_WIDTH;
-	int i;
-
-	for (i = 0; i < ARRAY_SIZE(minstrel_mcs_groups); i++) {
-		if (minstrel_mcs_groups[i].streams != streams)
-			continue;
-		if (minstrel_mcs_groups[i].flags != (rate->flags & flags))
-			continue;
-
-		return i;
-	}
-
-	WARN_ON(1);
-	return 0;
-}
-
 static inline struct minstrel_rate_stats *
 minstrel_get_ratestats(struct minstrel_ht_sta *mi, int index)
 {
@@ -716,9 +632,6 @@ minstrel_ht_update_caps(void *priv, struct ieee80211_supported_band *sband,
 	if (!sta->ht_cap.ht_supported)
 		goto use_legacy;
 
-	BUILD_BUG_ON(ARRAY_SIZE(minstrel_mcs_groups) !=
-		MINSTREL_MAX_STREAMS * MINSTREL_STREAM_GROUPS);
-
 	msp->is_ht = true;
 	memset(mi, 0, sizeof(*mi));
 	mi->stats_update = jiffies;
@@ -821,9 +734,9 @@ minstrel_ht_alloc_sta(void *priv, struct ieee80211_sta *sta, gfp_t gfp)
 			max_rates = sband->n_bitrates;
 	}
 
-	msp = kzalloc(sizeof(struct minstrel_ht_sta), gfp);
+	msp = kzalloc(sizeof(*msp), gfp);
 	if (!msp)
-		return NULL;
+		goto error_msp;
 
 	msp->ratelist = kzalloc(sizeof(struct minstrel_rate) * max_rates, gfp);
 	if (!msp->ratelist)
@@ -833,12 +746,16 @@ minstrel_ht_alloc_sta(void *priv, struct ieee80211_sta *sta, gfp_t gfp)
 	if (!msp->sample_table)
 		goto error1;
 
+	rc_phy_sta_alloc(&mp->phy_stats, ksize(msp) + ksize(msp->ratelist) +
+			ksize(msp->sample_table));
 	return msp;
 
 error1:
 	kfree(msp->ratelist);
 error:
 	kfree(msp);
+error_msp:
+	mp->phy_stats.alloc_fail++;
 	return NULL;
 }
 
@@ -846,7 +763,10 @@ static void
 minstrel_ht_free_sta(void *priv, struct ieee80211_sta *sta, void *priv_sta)
 {
 	struct minstrel_ht_sta_priv *msp = priv_sta;
+	struct minstrel_priv *mp = priv;
 
+	rc_phy_sta_free(&mp->phy_stats, ksize(msp) + ksize(msp->ratelist) +
+			ksize(msp->sample_table));
 	kfree(msp->sample_table);
 	kfree(msp->ratelist);
 	kfree(msp);
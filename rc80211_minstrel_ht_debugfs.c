@@ -12,7 +12,12 @@
 #include <linux/ieee80211.h>
 #include <linux/export.h>
 #include <net/mac80211.h>
+#include "rc80211_prof.h"
+#include "rc80211_phy.h"
+#include "rc80211_random.h"
+#include "rc80211_hist.h"
 #include "rc80211_minstrel.h"
+#include "rc80211_mcs_groups.h"
 #include "rc80211_minstrel_ht.h"
 
 static int
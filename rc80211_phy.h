@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2012 Luciano Jerez Chaves <luciano@lrc.ic.unicamp.br>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#ifndef __RC80211_PHY_H
+#define __RC80211_PHY_H
+
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/debugfs.h>
+
+/* Station setup accounting for a phy, embedded in the priv struct of each
+ * rate control algorithm. Counted by alloc_sta, rate_init and free_sta, and
+ * shown in debugfs:ieee80211/phyX/rc with rc_phy_add_debugfs. */
+struct rc_phy_stats {
+	struct rc_prof prof;			// alloc_sta, rate_init and free_sta time
+	u32 alloc_fail;					// failed alloc_sta calls
+
+#ifdef CONFIG_MAC80211_DEBUGFS
+	u32 n_sta;						// number of allocated stations
+	u32 sta_mem;					// memory allocated for stations (bytes)
+	u32 hist_size;					// rc_history entries for new stations
+	struct dentry *dbg_n_sta;		// debug sta_count file pointer
+	struct dentry *dbg_sta_mem;		// debug sta_memory file pointer
+	struct dentry *dbg_phy_stats;	// debug sta_stats file pointer
+	struct dentry *dbg_seed;		// debug random_seed file pointer
+	struct dentry *dbg_hist_size;	// debug history_size file pointer
+#endif
+};
+
+
+/* A station of mem bytes was allocated (or freed) */
+static inline void
+rc_phy_sta_alloc (struct rc_phy_stats *ps, size_t mem)
+{
+#ifdef CONFIG_MAC80211_DEBUGFS
+	ps->n_sta++;
+	ps->sta_mem += mem;
+#endif
+}
+
+static inline void
+rc_phy_sta_free (struct rc_phy_stats *ps, size_t mem)
+{
+#ifdef CONFIG_MAC80211_DEBUGFS
+	ps->n_sta--;
+	ps->sta_mem -= mem;
+#endif
+}
+
+
+#ifdef CONFIG_MAC80211_DEBUGFS
+struct rc_phy_debugfs_info {
+	size_t len;
+	char buf[];
+};
+
+/* Information for the per-phy sta_stats file */
+static inline int
+rc_phy_stats_open (struct inode *inode, struct file *file)
+{
+	struct rc_phy_stats *ps = inode->i_private;
+	struct rc_phy_debugfs_info *pi;
+	char *p;
+
+	pi = kmalloc (sizeof (*pi) + 1024, GFP_KERNEL);
+	if (!pi)
+		return -ENOMEM;
+
+	file->private_data = pi;
+	p = pi->buf;
+
+	p += sprintf (p, "\n Station setup:\n"
+			"   Stations:      %u\n"
+			"   Failed allocs: %u\n", ps->n_sta, ps->alloc_fail);
+	p += rc_prof_scnprintf (p, pi->buf + 1024 - p, &ps->prof);
+
+	pi->len = p - pi->buf;
+	return 0;
+}
+
+static inline ssize_t
+rc_phy_stats_read (struct file *file, char __user *buf, size_t len,
+		loff_t *ppos)
+{
+	struct rc_phy_debugfs_info *pi = file->private_data;
+
+	return simple_read_from_buffer (buf, len, ppos, pi->buf, pi->len);
+}
+
+static inline int
+rc_phy_stats_release (struct inode *inode, struct file *file)
+{
+	kfree (file->private_data);
+	return 0;
+}
+
+/* Creates sta_count, sta_memory and sta_stats in the phy rc directory, plus
+ * random_seed when the algorithm has a seed and history_size (starting at
+ * hist_size) when its stations keep an rc_history. history_size applies to
+ * the stations whose rc_history has not been opened yet, see rc_hist_ring */
+static inline void
+rc_phy_add_debugfs (struct rc_phy_stats *ps, struct dentry *dir, u32 *seed,
+		u32 hist_size)
+{
+	static const struct file_operations rc_phy_stat_fops = {
+		.owner = THIS_MODULE,
+		.open = rc_phy_stats_open,
+		.read = rc_phy_stats_read,
+		.release = rc_phy_stats_release,
+	};
+
+	ps->dbg_n_sta = debugfs_create_u32 ("sta_count", S_IRUGO,
+			dir, &ps->n_sta);
+	ps->dbg_sta_mem = debugfs_create_u32 ("sta_memory", S_IRUGO,
+			dir, &ps->sta_mem);
+	ps->dbg_phy_stats = debugfs_create_file ("sta_stats", S_IRUGO,
+			dir, ps, &rc_phy_stat_fops);
+	if (seed)
+		ps->dbg_seed = debugfs_create_u32 ("random_seed",
+				S_IRUGO | S_IWUSR, dir, seed);
+	if (hist_size) {
+		ps->hist_size = hist_size;
+		ps->dbg_hist_size = debugfs_create_u32 ("history_size",
+				S_IRUGO | S_IWUSR, dir, &ps->hist_size);
+	}
+}
+
+static inline void
+rc_phy_remove_debugfs (struct rc_phy_stats *ps)
+{
+	debugfs_remove (ps->dbg_n_sta);
+	debugfs_remove (ps->dbg_sta_mem);
+	debugfs_remove (ps->dbg_phy_stats);
+	debugfs_remove (ps->dbg_seed);
+	debugfs_remove (ps->dbg_hist_size);
+}
+#endif
+
+#endif
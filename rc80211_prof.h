@@ -0,0 +1,159 @@
+/*
+ * Copyright (C) 2012 Luciano Jerez Chaves <luciano@lrc.ic.unicamp.br>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#ifndef __RC80211_PROF_H
+#define __RC80211_PROF_H
+
+#include <linux/ktime.h>
+#include <linux/bitops.h>
+#include <asm/div64.h>
+
+/* Define this flag (here or with -DRC80211_USE_PROF) to enable per-call
+ * time accounting for the rate control callbacks. Results are shown at the
+ * end of each rc_stats file. It is off by default: every profiled call pays
+ * two ktime_get() and each station carries the histograms. */
+/* #define RC80211_USE_PROF */
+
+/* Number of log2 latency buckets. Bucket b holds calls that took from
+ * 2^(b-1) to 2^b - 1 ns, and the last one also holds every slower call. */
+#define RC_PROF_HIST_SIZE		23
+
+/* Profiled rate control callbacks and internal sections. update_stats and
+ * normal are nested inside tx_status or get_rate, so they are not additive.
+ * alloc_sta and free_sta are only accounted per phy. */
+enum rc_prof_op {
+	RC_PROF_GET_RATE = 0,
+	RC_PROF_TX_STATUS,
+	RC_PROF_RATE_INIT,
+	RC_PROF_UPDATE_STATS,
+	RC_PROF_NORMAL,
+	RC_PROF_ALLOC_STA,
+	RC_PROF_FREE_STA,
+	RC_PROF_N_OPS
+};
+
+/* Accounting for a single callback */
+struct rc_prof_stat {
+	u32 calls;						// number of profiled calls
+	u64 nsecs;						// total time spent on these calls (ns)
+	u32 max;						// slowest call (ns)
+	u32 hist[RC_PROF_HIST_SIZE];	// log2 histogram of call times
+};
+
+/* rc_prof is embedded once per station by each rate control algorithm. It
+ * is empty when profiling is disabled */
+struct rc_prof {
+#ifdef RC80211_USE_PROF
+	struct rc_prof_stat op[RC_PROF_N_OPS];
+#endif
+};
+
+
+#ifdef RC80211_USE_PROF
+/* ktime_get is used instead of get_cycles, which is a stub returning 0 on
+ * the MIPS targets we run on */
+static inline ktime_t
+rc_prof_start (void)
+{
+	return ktime_get ();
+}
+
+static inline void
+rc_prof_end (struct rc_prof *pf, enum rc_prof_op op, ktime_t start)
+{
+	struct rc_prof_stat *ps = &pf->op[op];
+	s64 delta = ktime_to_ns (ktime_sub (ktime_get (), start));
+	u32 ns = delta > 0xffffffffLL ? 0xffffffffU : (u32) delta;
+
+	ps->calls++;
+	ps->nsecs += ns;
+	if (ns > ps->max)
+		ps->max = ns;
+	ps->hist[min (fls (ns), RC_PROF_HIST_SIZE - 1)]++;
+}
+#else
+static inline ktime_t
+rc_prof_start (void)
+{
+	ktime_t zero = { .tv64 = 0 };
+	return zero;
+}
+
+static inline void
+rc_prof_end (struct rc_prof *pf, enum rc_prof_op op, ktime_t start)
+{
+}
+#endif
+
+
+#ifdef CONFIG_MAC80211_DEBUGFS
+#ifdef RC80211_USE_PROF
+/* Upper bound (ns) of the bucket holding the 99.9th percentile call */
+static inline u32
+rc_prof_p999 (struct rc_prof_stat *ps)
+{
+	u32 skip = ps->calls / 1000;
+	u32 seen = 0;
+	int b;
+
+	/* Walk down from the slowest bucket, leaving 0.1% of the calls above */
+	for (b = RC_PROF_HIST_SIZE - 1; b > 0; b--) {
+		seen += ps->hist[b];
+		if (seen > skip)
+			break;
+	}
+
+	if (b == RC_PROF_HIST_SIZE - 1)
+		return ps->max;
+	return (1U << b) - 1;
+}
+#endif
+
+/* Print the profile table into a debugfs buffer of size bytes. Returns the
+ * number of written chars, like scnprintf. */
+static inline int
+rc_prof_scnprintf (char *buf, size_t size, struct rc_prof *pf)
+{
+#ifdef RC80211_USE_PROF
+	static const char * const names[RC_PROF_N_OPS] = {
+		"get_rate", "tx_status", "rate_init", "upd_stats", "normal",
+		"alloc_sta", "free_sta"
+	};
+	char *p = buf, *end = buf + size;
+	unsigned int i;
+
+	p += scnprintf (p, end - p, "\n Per-call cost:\n");
+	p += scnprintf (p, end - p, " callback  |   calls    | avg (ns) | p99.9 (ns) | max (ns) | total (us)\n");
+
+	for (i = 0; i < RC_PROF_N_OPS; i++) {
+		struct rc_prof_stat *ps = &pf->op[i];
+		u64 avg = ps->nsecs;
+		u64 total = ps->nsecs;
+
+		/* Sections not used by this algorithm (or not run yet) */
+		if (!ps->calls)
+			continue;
+
+		do_div (avg, ps->calls);
+		do_div (total, 1000);
+
+		p += scnprintf (p, end - p, " %-9s | %10u | %8llu | %10u | %8u | %10llu\n",
+				names[i], ps->calls,
+				(unsigned long long) avg,
+				rc_prof_p999 (ps), ps->max,
+				(unsigned long long) total);
+	}
+
+	return p - buf;
+#else
+	return 0;
+#endif
+}
+#endif
+
+#endif
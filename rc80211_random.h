@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2012 Luciano Jerez Chaves <luciano@lrc.ic.unicamp.br>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#ifndef __RC80211_RANDOM_H
+#define __RC80211_RANDOM_H
+
+#include <linux/random.h>
+#include <linux/string.h>
+
+/* Size of the per-station pool of random bytes */
+#define RC_RAND_POOL_SIZE		32
+
+/* Per-station random source for the rate control algorithms.
+ *
+ * Random bytes are taken one by one from a small per-station pool, which is
+ * refilled in bulk: first at rate_init, then once every RC_RAND_POOL_SIZE
+ * bytes. This keeps get_random_bytes (and the entropy pool lock) away from
+ * most update intervals.
+ *
+ * By default the pool is filled by get_random_bytes. When a non-zero seed is
+ * written to debugfs:ieee80211/phyX/rc/random_seed, stations initialized
+ * after that fill it from a xorshift32 generator seeded from it and from their
+ * MAC address instead. Two runs with the same seed and the same traffic will
+ * then make the same rate decisions. Write 0 to go back to get_random_bytes
+ * (applied on the next rate_init). */
+struct rc_rand {
+	u32 x;							// xorshift32 state (0 for get_random_bytes)
+	u8 pos;							// next unused byte in pool
+	u8 pool[RC_RAND_POOL_SIZE];		// random bytes
+};
+
+
+static inline void
+rc_rand_refill (struct rc_rand *rr)
+{
+	unsigned int i;
+	u32 x = rr->x;
+
+	if (!x) {
+		get_random_bytes (rr->pool, sizeof (rr->pool));
+	} else {
+		for (i = 0; i < RC_RAND_POOL_SIZE; i += 4) {
+			x ^= x << 13;
+			x ^= x >> 17;
+			x ^= x << 5;
+			memcpy (&rr->pool[i], &x, 4);
+		}
+		rr->x = x;
+	}
+
+	rr->pos = 0;
+}
+
+static inline void
+rc_rand_seed (struct rc_rand *rr, u32 seed, const u8 *addr)
+{
+	rr->x = 0;
+	if (seed) {
+		/* Different stations get different sequences from the same seed */
+		rr->x = seed ^ ((addr[2] << 24) | (addr[3] << 16) | (addr[4] << 8) | addr[5]);
+		if (!rr->x)
+			rr->x = seed;
+	}
+
+	rc_rand_refill (rr);
+}
+
+static inline u8
+rc_rand_u8 (struct rc_rand *rr)
+{
+	if (rr->pos >= RC_RAND_POOL_SIZE)
+		rc_rand_refill (rr);
+	return rr->pool[rr->pos++];
+}
+
+static inline u16
+rc_rand_u16 (struct rc_rand *rr)
+{
+	u16 hi = rc_rand_u8 (rr);
+
+	return (hi << 8) | rc_rand_u8 (rr);
+}
+
+#endif